@@ -6,5 +6,8 @@ layout (location = 0) out vec4 outFragColor;
 
 void main ()
 {
-    outFragColor.rgb = inColor.rgb;
+    // Premultiplied by the sprite alpha, the additive blending leaves the destination alpha untouched and the
+    // sorted one blends the sprites over the frame with their alpha
+    vec4 sprite = texture(samplerColorMap, gl_PointCoord);
+    outFragColor = vec4(inColor.rgb * sprite.rgb * sprite.a, inColor.a * sprite.a);
 }
\ No newline at end of file
@@ -2,16 +2,38 @@
 
 #extension GL_KHR_vulkan_glsl : enable
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inVel;
+layout(location = 0) in vec4 inPosition;     // w: brightness weight of the LOD when drawn from the culled copies
+layout(location = 1) in vec4 inVel;     // w: species id
+layout(location = 2) in vec4 inPreviousPosition;     // Before the last simulation step, unused for the culled copies
 
 layout (binding = 1) uniform UBO
 {
     mat4 modelMatrix;
     mat4 viewMatrix;
     mat4 projectionMatrix;
+    vec4 sprite;        // x: world size, y: pixel size cap, z: viewport height, w: intensity
+    vec4 lod;           // x: projected size under which particles are thinned out, y: weights in pos.w, z: smallest kept fraction
+    vec4 interpolation; // x: blend factor from the previous positions to the current ones
+    vec4 trail;         // x: history slot of the newest positions, y: steps held, z: history length, w: intensity
 } ubo;
 
+// Must match MAX_SPECIES in ParticleSimulation.h
+#define MAX_SPECIES 8
+
+struct Species
+{
+    vec4 color;
+    float mass;
+    float drag;
+    float charge;
+    float attractorResponse;
+};
+
+layout(binding = 2) uniform SpeciesTable
+{
+    Species speciesTable[MAX_SPECIES];
+};
+
 layout(location = 0) out vec4 fragColor;
 
 out gl_PerVertex
@@ -21,9 +43,23 @@ out gl_PerVertex
 };
 
 void main() {
-    gl_PointSize = 1.;
-    gl_Position = ubo.projectionMatrix * ubo.viewMatrix * ubo.modelMatrix * vec4(inPosition.xyz, 1.0);
+    // The culled copies are interpolated by the culling pass
+    vec3 position = ubo.lod.y > 0.0 ? inPosition.xyz : mix(inPreviousPosition.xyz, inPosition.xyz, ubo.interpolation.x);
+    gl_Position = ubo.projectionMatrix * ubo.viewMatrix * ubo.modelMatrix * vec4(position, 1.0);
+
+    // Projected diameter in pixels, capped to bound the fill of the closest sprites
+    float pixels = ubo.sprite.x * ubo.projectionMatrix[1][1] * ubo.sprite.z * 0.5 / max(gl_Position.w, 1e-4);
+    gl_PointSize = clamp(pixels, 1.0, ubo.sprite.y);
+
+    // Sprites smaller than a pixel are drawn as one pixel, their brightness follows the area they would cover
+    float coverage = min(pixels * pixels, 1.0);
 
-    float velocityFactor = length(abs(inVel) * 0.02);
-    fragColor = vec4(1.0 * velocityFactor, 1.0 - (0.5* velocityFactor), 1.0 - (velocityFactor), 1.0);
+    float velocityFactor = length(abs(inVel.xyz) * 0.02);
+    vec4 speciesColor = speciesTable[min(uint(inVel.w), MAX_SPECIES - 1u)].color;
+    fragColor = vec4(1.0 * velocityFactor, 1.0 - (0.5* velocityFactor), 1.0 - (velocityFactor), 1.0) * speciesColor;
+    // The particles dropped by the LOD are made up for by the brightness of the kept ones
+    float weight = ubo.lod.y > 0.0 ? inPosition.w : 1.0;
+    fragColor.rgb *= ubo.sprite.w * coverage * weight;
+    // Opacity of the sorted alpha blending, the additive blending ignores it
+    fragColor.a = min(fragColor.a * ubo.sprite.w * coverage * weight, 1.0);
 }
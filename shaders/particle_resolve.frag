@@ -0,0 +1,19 @@
+#version 450
+
+// Sums written by particle_splat.comp, added to the frame by the blending
+layout(binding = 3, r32ui) uniform readonly uimage2DArray accumulation;
+
+layout(location = 0) out vec4 outFragColor;
+
+// Must match particle_splat.comp
+#define FIXED_POINT_SCALE 256.0
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    uvec3 sums = uvec3(
+        imageLoad(accumulation, ivec3(pixel, 0)).r,
+        imageLoad(accumulation, ivec3(pixel, 1)).r,
+        imageLoad(accumulation, ivec3(pixel, 2)).r);
+    outFragColor = vec4(vec3(sums) / FIXED_POINT_SCALE, 0.0);
+}
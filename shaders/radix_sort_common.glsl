@@ -0,0 +1,89 @@
+// Declarations shared by the radix sort passes, layouts must match GpuRadixSort.h
+// Each pass sorts by the 8 bits of the keys at pushConstants.shift, the passes ping-pong between the two descriptor sets
+
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#extension GL_KHR_shader_subgroup_ballot : require
+
+// Must match GpuRadixSort::WorkgroupSize, KeysPerThread and Radix
+#define WORKGROUP_SIZE 256
+#define KEYS_PER_THREAD 16
+#define BLOCK_SIZE (WORKGROUP_SIZE * KEYS_PER_THREAD)
+#define RADIX 256
+
+// WORKGROUP_SIZE / subgroup size, at most as many as the invocations of a subgroup
+layout (constant_id = 0) const uint SUBGROUP_COUNT = 8;
+
+layout(push_constant) uniform PushConstants
+{
+    uint shift;
+    uint count;
+    uint blockCount;
+} pushConstants;
+
+layout(std430, binding = 0) readonly buffer KeysIn
+{
+    uint keysIn[ ];
+};
+
+layout(std430, binding = 1) readonly buffer ValuesIn
+{
+    uint valuesIn[ ];
+};
+
+layout(std430, binding = 2) writeonly buffer KeysOut
+{
+    uint keysOut[ ];
+};
+
+layout(std430, binding = 3) writeonly buffer ValuesOut
+{
+    uint valuesOut[ ];
+};
+
+// Digit major: count of each digit in each block, turned into offsets by the spine
+layout(std430, binding = 4) buffer BlockHistograms
+{
+    uint blockHistograms[ ];
+};
+
+// Count of each digit over all the keys
+layout(std430, binding = 5) buffer DigitTotals
+{
+    uint digitTotals[ ];
+};
+
+shared uint subgroupSums[SUBGROUP_COUNT];
+shared uint workgroupSum;
+
+// Exclusive prefix sum of one value per invocation in subgroup order, total receives the sum over the workgroup
+// Must be called from uniform control flow
+uint workgroupExclusiveAdd(uint value, out uint total)
+{
+    uint prefix = subgroupExclusiveAdd(value);
+    uint sum = subgroupAdd(value);
+
+    // The shared sums may still be read by a previous call
+    barrier();
+    if (subgroupElect()) {
+        subgroupSums[gl_SubgroupID] = sum;
+    }
+    barrier();
+
+    // One subgroup scans the subgroup sums
+    if (gl_SubgroupID == 0) {
+        bool active = gl_SubgroupInvocationID < SUBGROUP_COUNT;
+        uint subgroupSum = active ? subgroupSums[gl_SubgroupInvocationID] : 0;
+        uint subgroupPrefix = subgroupExclusiveAdd(subgroupSum);
+        if (active) {
+            subgroupSums[gl_SubgroupInvocationID] = subgroupPrefix;
+        }
+        if (gl_SubgroupInvocationID == SUBGROUP_COUNT - 1) {
+            workgroupSum = subgroupPrefix + subgroupSum;
+        }
+    }
+    barrier();
+
+    total = workgroupSum;
+    return subgroupSums[gl_SubgroupID] + prefix;
+}
@@ -0,0 +1,94 @@
+// Declarations shared by the simulation compute shaders, layouts must match ParticleSimulation.h
+
+struct Particle
+{
+    vec4 pos;   // w: radius
+    vec4 vel;   // w: species id
+};
+
+layout(std140, binding = 0) buffer Pos 
+{
+    Particle particles[ ];
+};
+
+layout(binding = 1) uniform UBO
+{
+    float elapsedTime;
+    float destX;
+    float destY;
+    float destZ;
+    uint particleCount;
+    float restitution;
+    vec4 sdfBoundsMin;
+    vec4 sdfBoundsMax;
+    vec4 fieldBoundsMin;
+    vec4 fieldBoundsMax;
+    uint fieldSlotA;
+    uint fieldSlotB;
+    float fieldBlend;
+    float fieldCoupling;
+    float fieldScale;
+    vec4 gridOrigin;        // w: cell size
+    uint gridDim;
+    uint demEnabled;
+    float demStiffness;
+    float demDamping;
+    uint blockTimesteps;
+    uint blockLevelCount;
+    float blockAccuracy;
+    uint trailSlot;         // History slot written by the trail pass
+} ubo;
+
+// Block timesteps: particles of level l are integrated with elapsedTime / 2^l,
+// the dispatches of each level read the particle indices binned into that level
+struct LevelDispatch
+{
+    uint groupCountX;           // Indirect dispatch arguments
+    uint groupCountY;
+    uint groupCountZ;
+    uint particleCount;
+};
+
+layout(std430, binding = 12) buffer LevelDispatches
+{
+    LevelDispatch levelDispatches[ ];
+};
+
+layout(std430, binding = 13) buffer LevelIndices
+{
+    uint levelIndices[ ];
+};
+
+// Must match MAX_SPECIES in ParticleSimulation.h
+#define MAX_SPECIES 8
+
+struct Species
+{
+    vec4 color;
+    float mass;                 // Inertia against the field drag and the contacts
+    float drag;                 // Linear damping of the velocity
+    float charge;               // Coupling to the vector field
+    float attractorResponse;    // Scale of the attractor pull, negative values repel
+};
+
+layout(binding = 10) uniform SpeciesTable
+{
+    Species speciesTable[MAX_SPECIES];
+};
+
+uint speciesId(Particle particle)
+{
+    return min(uint(particle.vel.w), MAX_SPECIES - 1u);
+}
+
+// Uniform grid of the particle - particle contacts
+ivec3 gridCell(vec3 pos)
+{
+    ivec3 cell = ivec3(floor((pos - ubo.gridOrigin.xyz) / ubo.gridOrigin.w));
+    return clamp(cell, ivec3(0), ivec3(ubo.gridDim - 1));
+}
+
+uint gridCellIndex(ivec3 cell)
+{
+    return (uint(cell.z) * ubo.gridDim + uint(cell.y)) * ubo.gridDim + uint(cell.x);
+}
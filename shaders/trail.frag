@@ -0,0 +1,10 @@
+#version 450
+
+// Added to the frame like the sprites, the color fades with the age of the trail vertices
+layout (location = 0) in vec4 inColor;
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+    outFragColor = inColor;
+}
@@ -0,0 +1,84 @@
+#version 450
+
+// Velocity trails: one line strip per instance, no vertex input
+// Vertex 0 is the particle where it is drawn, vertex a > 0 the position it started the simulation step from a steps ago,
+// read from the history ring written by the trail pass of simulation.comp
+struct Particle
+{
+    vec4 pos;   // w: radius
+    vec4 vel;   // w: species id
+};
+
+layout(std430, binding = 0) readonly buffer Pos
+{
+    Particle particles[ ];
+};
+
+layout(std430, binding = 1) readonly buffer PreviousPos
+{
+    Particle previousParticles[ ];
+};
+
+// History length slices of the particle count positions
+layout(std430, binding = 2) readonly buffer TrailHistory
+{
+    vec4 trailHistory[ ];
+};
+
+// Same block as particle.vert
+layout(binding = 3) uniform UBO
+{
+    mat4 modelMatrix;
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec4 sprite;        // x: world size, y: pixel size cap, z: viewport height, w: intensity
+    vec4 lod;           // x: projected size under which particles are thinned out, y: weights in pos.w, z: smallest kept fraction
+    vec4 interpolation; // x: blend factor from the previous positions to the current ones
+    vec4 trail;         // x: history slot of the newest positions, y: steps held, z: history length, w: intensity
+} ubo;
+
+// Must match MAX_SPECIES in ParticleSimulation.h
+#define MAX_SPECIES 8
+
+struct Species
+{
+    vec4 color;
+    float mass;
+    float drag;
+    float charge;
+    float attractorResponse;
+};
+
+layout(binding = 4) uniform SpeciesTable
+{
+    Species speciesTable[MAX_SPECIES];
+};
+
+layout(location = 0) out vec4 fragColor;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+void main()
+{
+    uint index = uint(gl_InstanceIndex);
+    uint particleCount = uint(particles.length());
+    uint newestSlot = uint(ubo.trail.x);
+    uint steps = uint(ubo.trail.y);
+    uint historyLength = uint(ubo.trail.z);
+
+    // Vertices older than the history collapse on its oldest one, or on the particle while it is empty, and are not lit
+    uint age = min(uint(gl_VertexIndex), steps);
+    vec3 position = mix(previousParticles[index].pos.xyz, particles[index].pos.xyz, ubo.interpolation.x);
+    if (age > 0) {
+        uint slot = (newestSlot + historyLength + 1 - age) % historyLength;
+        position = trailHistory[slot * particleCount + index].xyz;
+    }
+    gl_Position = ubo.projectionMatrix * ubo.viewMatrix * ubo.modelMatrix * vec4(position, 1.0);
+
+    float fade = uint(gl_VertexIndex) <= steps ? 1.0 - float(gl_VertexIndex) / float(historyLength + 1) : 0.0;
+    vec4 speciesColor = speciesTable[min(uint(particles[index].vel.w), MAX_SPECIES - 1u)].color;
+    fragColor = vec4(speciesColor.rgb * fade * ubo.trail.w, 1.0);
+}
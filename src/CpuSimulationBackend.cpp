@@ -0,0 +1,244 @@
+#include <CpuSimulationBackend.h>
+
+#include <algorithm>
+#include <cmath>
+
+CpuSimulationBackend::CpuSimulationBackend(ThreadPool* threadPool)
+    : m_threadPool(threadPool)
+{
+    // Half of the L2 for the particles of a chunk, the rest is left to the collider and field lookups
+    m_chunkBatches = std::max(static_cast<uint32_t>(ThreadPool::GetL2CacheSize() / 2 / (sizeof(Particle) * BatchSize)), 1u);
+}
+
+void CpuSimulationBackend::Step(Particle* particles, uint32_t count, const SimulationStepParams& params)
+{
+    if (!m_threadPool)
+    {
+        StepRange(particles, 0, count, params);
+        return;
+    }
+
+    // At least 4 chunks per thread so that stealing can even out the uneven collider and field costs
+    uint32_t batchCount = (count + BatchSize - 1) / BatchSize;
+    uint32_t chunkBatches = std::min(m_chunkBatches, std::max(batchCount / (4 * m_threadPool->GetThreadCount()), 1u));
+    m_threadPool->ParallelFor(batchCount, chunkBatches, [&](uint32_t begin, uint32_t end) {
+        StepRange(particles, begin * BatchSize, std::min(end * BatchSize, count), params);
+    });
+}
+
+void CpuSimulationBackend::StepRange(Particle* particles, uint32_t first, uint32_t last, const SimulationStepParams& params)
+{
+    for (; first < last; first += BatchSize)
+    {
+        uint32_t batchCount = std::min(BatchSize, last - first);
+
+        Batch batch;
+        Load(batch, particles + first, batchCount, params);
+        Integrate(batch, params);
+        Collide(batch, params);
+        Store(batch, particles + first, batchCount);
+    }
+}
+
+void CpuSimulationBackend::Load(Batch& batch, const Particle* particles, uint32_t count, const SimulationStepParams& params)
+{
+    for (uint32_t i = 0; i < BatchSize; ++i)
+    {
+        Particle particle = i < count ? particles[i] : Particle{ glm::vec4(0.0f), glm::vec4(0.0f) };
+        batch.pos.x[i] = particle.pos.x;
+        batch.pos.y[i] = particle.pos.y;
+        batch.pos.z[i] = particle.pos.z;
+        batch.vel.x[i] = particle.vel.x;
+        batch.vel.y[i] = particle.vel.y;
+        batch.vel.z[i] = particle.vel.z;
+        batch.radius[i] = particle.pos.w;
+
+        // Same clamp as speciesId() in simulation_common.glsl, padding lanes get no forces at all
+        const Species& species = params.species[std::min(static_cast<uint32_t>(particle.vel.w), MAX_SPECIES - 1u)];
+        float active = i < count ? 1.0f : 0.0f;
+        batch.attractorResponse[i] = species.attractorResponse * active;
+        batch.chargeOverMass[i] = species.charge / species.mass * active;
+        batch.drag[i] = species.drag * active;
+    }
+}
+
+void CpuSimulationBackend::Store(const Batch& batch, Particle* particles, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        particles[i].pos.x = batch.pos.x[i];
+        particles[i].pos.y = batch.pos.y[i];
+        particles[i].pos.z = batch.pos.z[i];
+        particles[i].vel.x = batch.vel.x[i];
+        particles[i].vel.y = batch.vel.y[i];
+        particles[i].vel.z = batch.vel.z[i];
+    }
+}
+
+void CpuSimulationBackend::SampleField(const Lanes3& pos, const SimulationStepParams& params, Lanes3& fieldVel)
+{
+    for (uint32_t i = 0; i < BatchSize; ++i)
+    {
+        glm::vec3 position(pos.x[i], pos.y[i], pos.z[i]);
+        glm::vec3 velocity = glm::mix(
+            params.field->Sample(params.fieldFrameA, position),
+            params.field->Sample(params.fieldFrameB, position),
+            params.fieldBlend) * params.fieldScale;
+        fieldVel.x[i] = velocity.x;
+        fieldVel.y[i] = velocity.y;
+        fieldVel.z[i] = velocity.z;
+    }
+}
+
+void CpuSimulationBackend::SampleCollider(const Batch& batch, const SimulationStepParams& params, float* distance, Lanes3& normal)
+{
+    // Same central differences as sdfNormal() in simulation.comp, one voxel apart
+    const SdfCollider& collider = *params.collider;
+    glm::vec3 texel = (collider.GetBoundsMax() - collider.GetBoundsMin()) / static_cast<float>(collider.GetResolution());
+
+    for (uint32_t i = 0; i < BatchSize; ++i)
+    {
+        glm::vec3 pos(batch.pos.x[i], batch.pos.y[i], batch.pos.z[i]);
+        distance[i] = collider.Sample(pos) - batch.radius[i];
+        glm::vec3 gradient(
+            collider.Sample(pos + glm::vec3(texel.x, 0.0f, 0.0f)) - collider.Sample(pos - glm::vec3(texel.x, 0.0f, 0.0f)),
+            collider.Sample(pos + glm::vec3(0.0f, texel.y, 0.0f)) - collider.Sample(pos - glm::vec3(0.0f, texel.y, 0.0f)),
+            collider.Sample(pos + glm::vec3(0.0f, 0.0f, texel.z)) - collider.Sample(pos - glm::vec3(0.0f, 0.0f, texel.z)));
+        gradient /= std::max(glm::length(gradient), 1e-6f);
+        normal.x[i] = gradient.x;
+        normal.y[i] = gradient.y;
+        normal.z[i] = gradient.z;
+    }
+}
+
+void CpuSimulationBackend::AccelerationLanes(const Batch& batch, const Lanes3& pos, const Lanes3& vel, const Lanes3& fieldVel, const SimulationStepParams& params, Lanes3& acceleration)
+{
+    // Attractor pull, field drag and linear damping, see attraction() and acceleration() in simulation.comp
+    const float attractionConstant = 15.45f;
+    const float attractorMass = 85.0f;
+    for (uint32_t i = 0; i < BatchSize; ++i)
+    {
+        float dx = params.attractor.x - pos.x[i];
+        float dy = params.attractor.y - pos.y[i];
+        float dz = params.attractor.z - pos.z[i];
+        float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+        float r = std::min(std::max(distance, 0.5f), 10.0f);
+
+        // normalize(delta) * G * M / r^2, scaled by the species response
+        float pull = attractionConstant * attractorMass / (r * r * std::max(distance, 1e-12f)) * batch.attractorResponse[i];
+        float coupling = params.fieldCoupling * batch.chargeOverMass[i];
+
+        acceleration.x[i] = dx * pull + (fieldVel.x[i] - vel.x[i]) * coupling - vel.x[i] * batch.drag[i];
+        acceleration.y[i] = dy * pull + (fieldVel.y[i] - vel.y[i]) * coupling - vel.y[i] * batch.drag[i];
+        acceleration.z[i] = dz * pull + (fieldVel.z[i] - vel.z[i]) * coupling - vel.z[i] * batch.drag[i];
+    }
+}
+
+void CpuSimulationBackend::MultiplyAdd(Lanes3& out, const Lanes3& a, const Lanes3& b, float scale)
+{
+    // out = a + b * scale, out may alias a
+    for (uint32_t i = 0; i < BatchSize; ++i)
+    {
+        out.x[i] = a.x[i] + b.x[i] * scale;
+        out.y[i] = a.y[i] + b.y[i] * scale;
+        out.z[i] = a.z[i] + b.z[i] * scale;
+    }
+}
+
+void CpuSimulationBackend::CollisionResponse(Batch& batch, const float* distance, const Lanes3& normal, float restitution)
+{
+    // Branchless like collide() in simulation.comp: hit is step(distance, 0.0)
+    for (uint32_t i = 0; i < BatchSize; ++i)
+    {
+        float hit = distance[i] <= 0.0f ? 1.0f : 0.0f;
+        float approachingSpeed = std::min(batch.vel.x[i] * normal.x[i] + batch.vel.y[i] * normal.y[i] + batch.vel.z[i] * normal.z[i], 0.0f);
+        float push = hit * distance[i];
+        float bounce = hit * (1.0f + restitution) * approachingSpeed;
+
+        batch.pos.x[i] -= push * normal.x[i];
+        batch.pos.y[i] -= push * normal.y[i];
+        batch.pos.z[i] -= push * normal.z[i];
+        batch.vel.x[i] -= bounce * normal.x[i];
+        batch.vel.y[i] -= bounce * normal.y[i];
+        batch.vel.z[i] -= bounce * normal.z[i];
+    }
+}
+
+void CpuSimulationBackend::Acceleration(const Batch& batch, const Lanes3& pos, const Lanes3& vel, const SimulationStepParams& params, Lanes3& acceleration)
+{
+    Lanes3 fieldVel;
+    SampleField(pos, params, fieldVel);
+    AccelerationLanes(batch, pos, vel, fieldVel, params, acceleration);
+}
+
+void CpuSimulationBackend::Integrate(Batch& batch, const SimulationStepParams& params)
+{
+    float dt = params.dt;
+    Lanes3 a0;
+    Lanes3 a1;
+
+    switch (params.integrator)
+    {
+    case INTEGRATOR_LEAPFROG:
+    {
+        // Kick - drift - kick
+        Acceleration(batch, batch.pos, batch.vel, params, a0);
+        MultiplyAdd(batch.vel, batch.vel, a0, 0.5f * dt);
+        MultiplyAdd(batch.pos, batch.pos, batch.vel, dt);
+        Acceleration(batch, batch.pos, batch.vel, params, a1);
+        MultiplyAdd(batch.vel, batch.vel, a1, 0.5f * dt);
+        break;
+    }
+    case INTEGRATOR_VELOCITY_VERLET:
+    {
+        // The end of step velocity is predicted with an Euler step, as in the shader
+        Lanes3 predictedVel;
+        Acceleration(batch, batch.pos, batch.vel, params, a0);
+        MultiplyAdd(batch.pos, batch.pos, batch.vel, dt);
+        MultiplyAdd(batch.pos, batch.pos, a0, 0.5f * dt * dt);
+        MultiplyAdd(predictedVel, batch.vel, a0, dt);
+        Acceleration(batch, batch.pos, predictedVel, params, a1);
+        MultiplyAdd(batch.vel, batch.vel, a0, 0.5f * dt);
+        MultiplyAdd(batch.vel, batch.vel, a1, 0.5f * dt);
+        break;
+    }
+    case INTEGRATOR_RK4:
+    {
+        // k1x is the velocity itself, a0 holds k1v
+        Lanes3 k2x, k2v, k3x, k3v, k4x, k4v, pos;
+        Acceleration(batch, batch.pos, batch.vel, params, a0);
+        MultiplyAdd(k2x, batch.vel, a0, 0.5f * dt);
+        MultiplyAdd(pos, batch.pos, batch.vel, 0.5f * dt);
+        Acceleration(batch, pos, k2x, params, k2v);
+        MultiplyAdd(k3x, batch.vel, k2v, 0.5f * dt);
+        MultiplyAdd(pos, batch.pos, k2x, 0.5f * dt);
+        Acceleration(batch, pos, k3x, params, k3v);
+        MultiplyAdd(k4x, batch.vel, k3v, dt);
+        MultiplyAdd(pos, batch.pos, k3x, dt);
+        Acceleration(batch, pos, k4x, params, k4v);
+
+        MultiplyAdd(batch.pos, batch.pos, batch.vel, dt / 6.0f);
+        MultiplyAdd(batch.pos, batch.pos, k2x, dt / 3.0f);
+        MultiplyAdd(batch.pos, batch.pos, k3x, dt / 3.0f);
+        MultiplyAdd(batch.pos, batch.pos, k4x, dt / 6.0f);
+        MultiplyAdd(batch.vel, batch.vel, a0, dt / 6.0f);
+        MultiplyAdd(batch.vel, batch.vel, k2v, dt / 3.0f);
+        MultiplyAdd(batch.vel, batch.vel, k3v, dt / 3.0f);
+        MultiplyAdd(batch.vel, batch.vel, k4v, dt / 6.0f);
+        break;
+    }
+    default:
+        Acceleration(batch, batch.pos, batch.vel, params, a0);
+        MultiplyAdd(batch.vel, batch.vel, a0, dt);
+        MultiplyAdd(batch.pos, batch.pos, batch.vel, dt);
+        break;
+    }
+}
+
+void CpuSimulationBackend::Collide(Batch& batch, const SimulationStepParams& params)
+{
+    alignas(64) float distance[BatchSize];
+    Lanes3 normal;
+    SampleCollider(batch, params, distance, normal);
+    CollisionResponse(batch, distance, normal, params.restitution);
+}
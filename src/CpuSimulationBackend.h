@@ -0,0 +1,64 @@
+#pragma once
+
+#include <SimulationBackend.h>
+#include <ThreadPool.h>
+
+// Reference implementation of simulation.comp on the host, used as the correctness oracle of the
+// GPU kernels and where no usable GPU is available
+// Particles are processed in batches gathered into structure of arrays form, every per lane loop is
+// free of branches and cross lane dependencies so that the compiler can vectorize it
+// With a thread pool the batches are spread over its workers in chunks sized to the L2 cache
+class CpuSimulationBackend : public SimulationBackend
+{
+public:
+    // Multiple of the widest SIMD kernel, see SimdSimulationBackend
+    static constexpr uint32_t BatchSize = 16;
+
+    // Batch of particle attributes, one array per component
+    struct Lanes3 {
+        alignas(64) float x[BatchSize];
+        alignas(64) float y[BatchSize];
+        alignas(64) float z[BatchSize];
+    };
+
+    struct Batch {
+        Lanes3 pos;
+        Lanes3 vel;
+        alignas(64) float radius[BatchSize];
+        alignas(64) float attractorResponse[BatchSize];     // Species parameters gathered per lane
+        alignas(64) float chargeOverMass[BatchSize];
+        alignas(64) float drag[BatchSize];
+    };
+
+    // The pool is not owned, null runs the step on the calling thread
+    explicit CpuSimulationBackend(ThreadPool* threadPool = nullptr);
+    virtual ~CpuSimulationBackend() = default;
+
+    const char* GetName() const override { return "CPU"; }
+
+    void Step(Particle* particles, uint32_t count, const SimulationStepParams& params) override;
+
+protected:
+    // Particles [first, last) one batch at a time
+    void StepRange(Particle* particles, uint32_t first, uint32_t last, const SimulationStepParams& params);
+
+    // Particles past count are padded with neutral lanes that are not stored back
+    static void Load(Batch& batch, const Particle* particles, uint32_t count, const SimulationStepParams& params);
+    static void Store(const Batch& batch, Particle* particles, uint32_t count);
+
+    // Per lane lookups and arithmetic, replaced by the hand vectorized kernels of SimdSimulationBackend
+    // The field and collider lookups are trilinear gathers
+    virtual void SampleField(const Lanes3& pos, const SimulationStepParams& params, Lanes3& fieldVel);
+    virtual void SampleCollider(const Batch& batch, const SimulationStepParams& params, float* distance, Lanes3& normal);
+    virtual void AccelerationLanes(const Batch& batch, const Lanes3& pos, const Lanes3& vel, const Lanes3& fieldVel, const SimulationStepParams& params, Lanes3& acceleration);
+    virtual void MultiplyAdd(Lanes3& out, const Lanes3& a, const Lanes3& b, float scale);
+    virtual void CollisionResponse(Batch& batch, const float* distance, const Lanes3& normal, float restitution);
+
+    void Acceleration(const Batch& batch, const Lanes3& pos, const Lanes3& vel, const SimulationStepParams& params, Lanes3& acceleration);
+    void Integrate(Batch& batch, const SimulationStepParams& params);
+    void Collide(Batch& batch, const SimulationStepParams& params);
+
+private:
+    ThreadPool* m_threadPool;
+    uint32_t m_chunkBatches;            // Batches per thread pool chunk
+};
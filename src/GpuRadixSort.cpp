@@ -0,0 +1,247 @@
+#include <GpuRadixSort.h>
+#include <VulkanDevice.h>
+#include <VulkanUtils.h>
+
+#include <vector>
+
+bool GpuRadixSort::IsSupported(VulkanDevice* device)
+{
+    uint32_t subgroupSize = GetSubgroupSize(device);
+    if (subgroupSize == 0)
+    {
+        return false;
+    }
+
+    // Shared memory of the downsweep: per subgroup digit offsets, digit offsets and the scan of the subgroup sums
+    uint32_t subgroupCount = WorkgroupSize / subgroupSize;
+    uint32_t sharedMemorySize = (subgroupCount * Radix + Radix + subgroupCount + 1) * sizeof(uint32_t);
+    const VkPhysicalDeviceLimits& limits = device->properties.limits;
+    return limits.maxComputeWorkGroupInvocations >= WorkgroupSize
+        && limits.maxComputeWorkGroupSize[0] >= WorkgroupSize
+        && limits.maxComputeSharedMemorySize >= sharedMemorySize;
+}
+
+uint32_t GpuRadixSort::GetSubgroupSize(VulkanDevice* device)
+{
+    if (device->properties.apiVersion < VK_API_VERSION_1_1)
+    {
+        return 0;
+    }
+
+    VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+    subgroupProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &subgroupProperties;
+    vkGetPhysicalDeviceProperties2(device->physicalDevice, &properties);
+
+    // The scan of the subgroup sums is done by a single subgroup, there are at most 16 of them
+    VkSubgroupFeatureFlags requiredOperations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+    bool supported = (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0
+        && (subgroupProperties.supportedOperations & requiredOperations) == requiredOperations
+        && subgroupProperties.subgroupSize >= 16
+        && subgroupProperties.subgroupSize <= WorkgroupSize;
+    return supported ? subgroupProperties.subgroupSize : 0;
+}
+
+void GpuRadixSort::Prepare(VulkanDevice* device, uint32_t capacity, VkBuffer keys, VkBuffer values)
+{
+    m_device = device;
+    m_capacity = capacity;
+    VkDevice logicalDevice = m_device->logicalDevice;
+
+    uint32_t blockCount = (capacity + BlockSize - 1) / BlockSize;
+    CreateBuffer(m_scratchKeys, static_cast<VkDeviceSize>(capacity) * sizeof(uint32_t));
+    CreateBuffer(m_scratchValues, static_cast<VkDeviceSize>(capacity) * sizeof(uint32_t));
+    CreateBuffer(m_blockHistograms, static_cast<VkDeviceSize>(blockCount) * Radix * sizeof(uint32_t));
+    CreateBuffer(m_digitTotals, Radix * sizeof(uint32_t));
+
+    // Bindings 0 to 3: keys and values in, keys and values out, 4: block histograms, 5: digit totals
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+    for (uint32_t binding = 0; binding < 6; ++binding)
+    {
+        VkDescriptorSetLayoutBinding layoutBinding{};
+        layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        layoutBinding.binding = binding;
+        layoutBinding.descriptorCount = 1;
+        setLayoutBindings.push_back(layoutBinding);
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.pBindings = setLayoutBindings.data();
+    descriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(logicalDevice, &descriptorSetLayoutCreateInfo, nullptr, &m_descriptorSetLayout));
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &m_descriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCreateInfo, nullptr, &m_pipelineLayout));
+
+    // Own pool so that the sort can be used next to any other descriptor allocation
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = static_cast<uint32_t>(setLayoutBindings.size() * m_descriptorSets.size());
+
+    VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+    descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolInfo.poolSizeCount = 1;
+    descriptorPoolInfo.pPoolSizes = &poolSize;
+    descriptorPoolInfo.maxSets = static_cast<uint32_t>(m_descriptorSets.size());
+    VK_CHECK_RESULT(vkCreateDescriptorPool(logicalDevice, &descriptorPoolInfo, nullptr, &m_descriptorPool));
+
+    std::array<VkDescriptorSetLayout, 2> setLayouts = { m_descriptorSetLayout, m_descriptorSetLayout };
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = m_descriptorPool;
+    descriptorSetAllocateInfo.pSetLayouts = setLayouts.data();
+    descriptorSetAllocateInfo.descriptorSetCount = static_cast<uint32_t>(m_descriptorSets.size());
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(logicalDevice, &descriptorSetAllocateInfo, m_descriptorSets.data()));
+
+    // Set 0 sorts from the caller buffers into the scratch ones, set 1 back
+    VkDeviceSize elementsSize = static_cast<VkDeviceSize>(capacity) * sizeof(uint32_t);
+    const VkDescriptorBufferInfo elementBuffers[2][2] = {
+        { { keys, 0, elementsSize }, { values, 0, elementsSize } },
+        { { m_scratchKeys.buffer, 0, elementsSize }, { m_scratchValues.buffer, 0, elementsSize } }
+    };
+    const VkDescriptorBufferInfo histogramsInfo = { m_blockHistograms.buffer, 0, VK_WHOLE_SIZE };
+    const VkDescriptorBufferInfo totalsInfo = { m_digitTotals.buffer, 0, VK_WHOLE_SIZE };
+    for (uint32_t set = 0; set < m_descriptorSets.size(); ++set)
+    {
+        const std::array<const VkDescriptorBufferInfo*, 6> bufferInfos = {
+            &elementBuffers[set][0], &elementBuffers[set][1], &elementBuffers[1 - set][0], &elementBuffers[1 - set][1], &histogramsInfo, &totalsInfo
+        };
+        std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+        for (uint32_t binding = 0; binding < bufferInfos.size(); ++binding)
+        {
+            VkWriteDescriptorSet writeDescriptorSet{};
+            writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSet.dstSet = m_descriptorSets[set];
+            writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writeDescriptorSet.dstBinding = binding;
+            writeDescriptorSet.pBufferInfo = bufferInfos[binding];
+            writeDescriptorSet.descriptorCount = 1;
+            writeDescriptorSets.push_back(writeDescriptorSet);
+        }
+        vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+    }
+
+    uint32_t subgroupCount = WorkgroupSize / GetSubgroupSize(m_device);
+    m_upsweepPipeline = CreatePipeline("../../shaders/radix_sort_upsweep.comp.spv", subgroupCount);
+    m_spinePipeline = CreatePipeline("../../shaders/radix_sort_spine.comp.spv", subgroupCount);
+    m_downsweepPipeline = CreatePipeline("../../shaders/radix_sort_downsweep.comp.spv", subgroupCount);
+}
+
+void GpuRadixSort::Destroy()
+{
+    if (!m_device)
+    {
+        return;
+    }
+
+    VkDevice logicalDevice = m_device->logicalDevice;
+    for (VkPipeline pipeline : { m_upsweepPipeline, m_spinePipeline, m_downsweepPipeline }) {
+        vkDestroyPipeline(logicalDevice, pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(logicalDevice, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorPool(logicalDevice, m_descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(logicalDevice, m_descriptorSetLayout, nullptr);
+    for (Buffer* buffer : { &m_scratchKeys, &m_scratchValues, &m_blockHistograms, &m_digitTotals }) {
+        vkFreeMemory(logicalDevice, buffer->memory, nullptr);
+        vkDestroyBuffer(logicalDevice, buffer->buffer, nullptr);
+        *buffer = Buffer();
+    }
+    m_device = nullptr;
+}
+
+void GpuRadixSort::Record(VkCommandBuffer commandBuffer, uint32_t count)
+{
+    PushConstants pushConstants{};
+    pushConstants.count = count < m_capacity ? count : m_capacity;
+    pushConstants.blockCount = (pushConstants.count + BlockSize - 1) / BlockSize;
+    if (pushConstants.blockCount == 0)
+    {
+        return;
+    }
+
+    // Also orders the scratch buffers after their use by a previous sort
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    for (uint32_t pass = 0; pass < PassCount; ++pass)
+    {
+        pushConstants.shift = pass * 8;
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets[pass % 2], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_upsweepPipeline);
+        vkCmdDispatch(commandBuffer, pushConstants.blockCount, 1, 1);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_spinePipeline);
+        vkCmdDispatch(commandBuffer, Radix, 1, 1);
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_downsweepPipeline);
+        vkCmdDispatch(commandBuffer, pushConstants.blockCount, 1, 1);
+        if (pass + 1 < PassCount)
+        {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        }
+    }
+}
+
+void GpuRadixSort::CreateBuffer(Buffer& buffer, VkDeviceSize size)
+{
+    VK_CHECK_RESULT(m_device->CreateBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &buffer.buffer,
+        &buffer.memory,
+        size));
+}
+
+VkPipeline GpuRadixSort::CreatePipeline(const char* path, uint32_t subgroupCount)
+{
+    std::vector<char> code = Utils::ReadFile(path);
+    VkShaderModuleCreateInfo shaderModuleCreateInfo{};
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.codeSize = code.size();
+    shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    VkShaderModule shaderModule;
+    VK_CHECK_RESULT(vkCreateShaderModule(m_device->logicalDevice, &shaderModuleCreateInfo, nullptr, &shaderModule));
+
+    // SUBGROUP_COUNT sizes the shared arrays of the subgroups
+    VkSpecializationMapEntry specializationEntry = { 0, 0, sizeof(uint32_t) };
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = 1;
+    specializationInfo.pMapEntries = &specializationEntry;
+    specializationInfo.dataSize = sizeof(uint32_t);
+    specializationInfo.pData = &subgroupCount;
+
+    VkComputePipelineCreateInfo pipelineCreateInfo{};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.layout = m_pipelineLayout;
+    pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCreateInfo.stage.module = shaderModule;
+    pipelineCreateInfo.stage.pName = "main";
+    pipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+    VkPipeline pipeline;
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_device->logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline));
+
+    vkDestroyShaderModule(m_device->logicalDevice, shaderModule, nullptr);
+    return pipeline;
+}
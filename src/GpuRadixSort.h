@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+
+struct VulkanDevice;
+
+// Stable least significant digit radix sort of 32 bit keys with 32 bit values, in compute shaders
+// Every pass sorts by 8 bits of the keys in three dispatches (reduce then scan): the upsweep counts the digits of
+// each block of keys, the spine scans the counts of every digit over the blocks, the downsweep ranks the keys of each
+// block with subgroup ballots and scatters them. Passes ping-pong between the caller buffers and scratch buffers of
+// the same size, four passes leave the result in the caller buffers
+class GpuRadixSort
+{
+public:
+    // Must match radix_sort_common.glsl
+    static constexpr uint32_t WorkgroupSize = 256;
+    static constexpr uint32_t KeysPerThread = 16;
+    static constexpr uint32_t BlockSize = WorkgroupSize * KeysPerThread;
+    static constexpr uint32_t Radix = 256;
+    static constexpr uint32_t PassCount = 4;
+
+    // Needs Vulkan 1.1 subgroup ballots and arithmetic in compute shaders, with subgroups of at least 16 invocations
+    static bool IsSupported(VulkanDevice* device);
+
+    // keys and values hold capacity elements and have the storage buffer usage
+    void Prepare(VulkanDevice* device, uint32_t capacity, VkBuffer keys, VkBuffer values);
+    void Destroy();
+
+    // Sorts the first count keys in ascending order, the values follow their keys and equal keys keep their order
+    // Compute shader writes of keys and values before it are waited for, the sorted ones are written by compute
+    // shaders and need a barrier before their next use
+    void Record(VkCommandBuffer commandBuffer, uint32_t count);
+
+private:
+    struct PushConstants {
+        uint32_t shift;
+        uint32_t count;
+        uint32_t blockCount;
+    };
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+    };
+
+    static uint32_t GetSubgroupSize(VulkanDevice* device);
+    void CreateBuffer(Buffer& buffer, VkDeviceSize size);
+    VkPipeline CreatePipeline(const char* path, uint32_t subgroupCount);
+
+    VulkanDevice* m_device = nullptr;
+    uint32_t m_capacity = 0;
+
+    Buffer m_scratchKeys;
+    Buffer m_scratchValues;
+    Buffer m_blockHistograms;                       // Radix counts per block, digit major
+    Buffer m_digitTotals;
+
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    std::array<VkDescriptorSet, 2> m_descriptorSets;   // Caller buffers to scratch ones, and back
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_upsweepPipeline = VK_NULL_HANDLE;
+    VkPipeline m_spinePipeline = VK_NULL_HANDLE;
+    VkPipeline m_downsweepPipeline = VK_NULL_HANDLE;
+};
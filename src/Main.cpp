@@ -1,12 +1,118 @@
 #include <ParticleSimulation.h>
 
-int main() {
+#include <cstdlib>
+#include <iostream>
+#include <string>
 
-    ParticleSimulation *simulation = new ParticleSimulation();
-    simulation->SetupWindow();
-    simulation->InitVulkan();
-    simulation->Prepare();
-    simulation->RenderLoop();
+int main(int argc, char* argv[]) {
+
+    SimulationOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        if (argument == "--deterministic") {
+            options.deterministic = true;
+        }
+        else if (argument == "--seed" && i + 1 < argc) {
+            options.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (argument == "--checksum-interval" && i + 1 < argc) {
+            options.checksumInterval = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (argument == "--backend" && i + 1 < argc) {
+            std::string backend = argv[++i];
+            if (backend == "cpu") {
+                options.backend = SIMULATION_BACKEND_CPU;
+            }
+            else if (backend == "simd") {
+                options.backend = SIMULATION_BACKEND_CPU_SIMD;
+            }
+            else if (backend == "hybrid") {
+                options.backend = SIMULATION_BACKEND_HYBRID;
+            }
+            else if (backend != "gpu") {
+                std::cerr << "Unknown backend " << backend << "\n";
+            }
+        }
+        else if (argument == "--threads" && i + 1 < argc) {
+            options.threadCount = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (argument == "--pin-threads") {
+            options.pinThreads = true;
+        }
+        else if (argument == "--validate" && i + 1 < argc) {
+            options.validateSteps = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (argument == "--validate-ulps" && i + 1 < argc) {
+            options.validateUlps = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (argument == "--validate-relative" && i + 1 < argc) {
+            options.validateRelative = std::strtof(argv[++i], nullptr);
+        }
+        else if (argument == "--validate-outliers" && i + 1 < argc) {
+            options.validateOutliers = std::strtof(argv[++i], nullptr);
+        }
+        else if (argument == "--bench-sort") {
+            options.benchmarkSort = true;
+        }
+        else if (argument == "--sim-rate" && i + 1 < argc) {
+            options.simulationRate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (argument == "--present-mode" && i + 1 < argc) {
+            std::string presentMode = argv[++i];
+            if (presentMode == "fifo") {
+                options.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            }
+            else if (presentMode == "fifo-relaxed") {
+                options.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            }
+            else if (presentMode == "mailbox") {
+                options.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            }
+            else if (presentMode == "immediate") {
+                options.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            }
+            else {
+                std::cerr << "Unknown present mode " << presentMode << "\n";
+            }
+        }
+        else if (argument == "--swapchain-images" && i + 1 < argc) {
+            options.swapchainImageCount = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (argument == "--fps-limit" && i + 1 < argc) {
+            options.frameLimit = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (argument == "--restore" && i + 1 < argc) {
+            options.restorePath = argv[++i];
+        }
+        else if (argument == "--snapshot" && i + 1 < argc) {
+            options.snapshotPath = argv[++i];
+        }
+        else if (argument == "--snapshot-interval" && i + 1 < argc) {
+            options.snapshotInterval = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (argument == "--record" && i + 1 < argc) {
+            options.recordPath = argv[++i];
+        }
+        else if (argument == "--record-interval" && i + 1 < argc) {
+            options.recordInterval = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (argument == "--record-threads" && i + 1 < argc) {
+            options.recordThreads = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else {
+            std::cerr << "Unknown argument " << argument << "\n";
+        }
+    }
+
+    ParticleSimulation *simulation = new ParticleSimulation(options);
+    // The options can already have failed, e.g. a snapshot to restore that cannot be read
+    if (simulation->GetExitCode() == 0) {
+        simulation->SetupWindow();
+        simulation->InitVulkan();
+        simulation->Prepare();
+        simulation->RenderLoop();
+    }
+    int exitCode = simulation->GetExitCode();
     delete(simulation);
-    return 0;
+    return exitCode;
 }
\ No newline at end of file
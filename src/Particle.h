@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Must match MAX_SPECIES of the simulation and particle shaders
+#define MAX_SPECIES 8
+
+// SSBO particle declaration, shared by the GPU and CPU simulation backends
+struct Particle {
+    glm::vec4 pos; // Particle position, w: radius
+    glm::vec4 vel; // Particle velocity, w: species id
+};
+
+// Parameters shared by all the particles of a species, indexed by the species id
+struct Species {
+    glm::vec4 color;
+    float mass;                 // Inertia against the field drag and the contacts
+    float drag;                 // Linear damping of the velocity
+    float charge;               // Coupling to the vector field
+    float attractorResponse;    // Scale of the attractor pull, negative values repel
+};
@@ -0,0 +1,154 @@
+#include <ParticleReadback.h>
+#include <VulkanDevice.h>
+#include <VulkanUtils.h>
+
+#include <algorithm>
+
+void ParticleReadback::Prepare(VulkanDevice* device, uint32_t capacity)
+{
+    m_device = device;
+    m_capacity = capacity;
+
+    // Cached memory keeps the host reads fast, the copies are invalidated when it is not coherent
+    VkMemoryPropertyFlags memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    VkBool32 found = VK_FALSE;
+    uint32_t memoryType = m_device->GetMemoryType(~0u, memoryFlags, &found);
+    if (!found)
+    {
+        memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        memoryType = m_device->GetMemoryType(~0u, memoryFlags);
+    }
+    m_coherent = (m_device->memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    VkDeviceSize size = static_cast<VkDeviceSize>(capacity) * sizeof(Particle);
+    for (Slot& slot : m_slots)
+    {
+        VK_CHECK_RESULT(m_device->CreateBuffer(
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            memoryFlags,
+            &slot.buffer,
+            &slot.memory,
+            size));
+        VK_CHECK_RESULT(vkMapMemory(m_device->logicalDevice, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.mapped));
+    }
+}
+
+void ParticleReadback::Destroy()
+{
+    for (Slot& slot : m_slots)
+    {
+        if (slot.buffer)
+        {
+            vkUnmapMemory(m_device->logicalDevice, slot.memory);
+            vkFreeMemory(m_device->logicalDevice, slot.memory, nullptr);
+            vkDestroyBuffer(m_device->logicalDevice, slot.buffer, nullptr);
+        }
+        slot = Slot();
+    }
+    m_requests.clear();
+}
+
+void ParticleReadback::Request(uint32_t first, uint32_t count, Callback callback)
+{
+    m_requests.push_back({ first, std::min(count, m_capacity), std::move(callback) });
+}
+
+void ParticleReadback::Record(VkCommandBuffer commandBuffer, VkBuffer storageBuffer, uint64_t submission, uint64_t step, uint32_t deviceParticleCount)
+{
+    if (m_requests.empty() || m_slots[m_nextSlot].inFlight)
+    {
+        return;
+    }
+
+    // Last compute writes before the copies
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    while (!m_requests.empty() && !m_slots[m_nextSlot].inFlight)
+    {
+        Slot& slot = m_slots[m_nextSlot];
+        slot.request = std::move(m_requests.front());
+        m_requests.pop_front();
+        slot.inFlight = true;
+        slot.submission = submission;
+        slot.step = step;
+        slot.deviceCount = deviceParticleCount > slot.request.first ? std::min(deviceParticleCount - slot.request.first, slot.request.count) : 0;
+        slot.hostPending = slot.deviceCount < slot.request.count;
+
+        if (slot.deviceCount > 0)
+        {
+            VkBufferCopy copyRegion{};
+            copyRegion.srcOffset = static_cast<VkDeviceSize>(slot.request.first) * sizeof(Particle);
+            copyRegion.dstOffset = 0;
+            copyRegion.size = static_cast<VkDeviceSize>(slot.deviceCount) * sizeof(Particle);
+            vkCmdCopyBuffer(commandBuffer, storageBuffer, slot.buffer, 1, &copyRegion);
+        }
+
+        m_nextSlot = (m_nextSlot + 1) % SlotCount;
+    }
+
+    // The copies are read by the host once the submission fence has signaled
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+void ParticleReadback::CopyHostParticles(const Particle* particles)
+{
+    // The host part goes to memory of its own, host writes to the mapped slot could be lost to the invalidation of
+    // the GPU part when the memory is not coherent
+    for (Slot& slot : m_slots)
+    {
+        if (!slot.hostPending)
+        {
+            continue;
+        }
+        slot.hostParticles.resize(slot.request.count);
+        const Particle* hostParticles = particles + slot.request.first + slot.deviceCount;
+        std::copy(hostParticles, hostParticles + (slot.request.count - slot.deviceCount), slot.hostParticles.begin() + slot.deviceCount);
+        slot.hostPending = false;
+    }
+}
+
+void ParticleReadback::Deliver(uint64_t completedSubmission)
+{
+    // Oldest slot first, the one after the last recorded
+    for (uint32_t i = 0; i < SlotCount; ++i)
+    {
+        Slot& slot = m_slots[(m_nextSlot + i) % SlotCount];
+        if (!slot.inFlight || slot.submission > completedSubmission)
+        {
+            continue;
+        }
+
+        if (!m_coherent)
+        {
+            VkMappedMemoryRange mappedRange{};
+            mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            mappedRange.memory = slot.memory;
+            mappedRange.offset = 0;
+            mappedRange.size = VK_WHOLE_SIZE;
+            VK_CHECK_RESULT(vkInvalidateMappedMemoryRanges(m_device->logicalDevice, 1, &mappedRange));
+        }
+
+        // Requests with a host part are put together next to it
+        const Particle* particles = static_cast<const Particle*>(slot.mapped);
+        if (slot.deviceCount < slot.request.count)
+        {
+            slot.hostParticles.resize(slot.request.count);
+            std::copy(particles, particles + slot.deviceCount, slot.hostParticles.begin());
+            particles = slot.hostParticles.data();
+        }
+
+        // The slot is freed first, the callback may queue the next request
+        PendingRequest request = std::move(slot.request);
+        slot.inFlight = false;
+        if (request.callback)
+        {
+            request.callback(particles, request.first, request.count, slot.step);
+        }
+    }
+}
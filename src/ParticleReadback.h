@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Particle.h>
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+struct VulkanDevice;
+
+// Copies of particle ranges back to the host that never wait on the GPU
+// Requests are copied at the end of a compute submission into a ring of host cached buffers, each slot remembers
+// the submission it was recorded in and is handed to its consumer once that submission is known to be done
+// Everything runs on the render thread: callbacks are called from Deliver(), the data is only valid during the call
+class ParticleReadback
+{
+public:
+    static constexpr uint32_t SlotCount = 3;
+
+    // particles holds count particles starting at first, step is the simulation step the copy was taken after
+    using Callback = std::function<void(const Particle* particles, uint32_t first, uint32_t count, uint64_t step)>;
+
+    // Every slot can hold capacity particles
+    void Prepare(VulkanDevice* device, uint32_t capacity);
+    void Destroy();
+
+    // Queued until a slot is free, a full ring delays requests instead of stalling
+    void Request(uint32_t first, uint32_t count, Callback callback);
+
+    // Copies the queued requests that fit in the free slots, in command buffer order after the last compute write
+    // of storageBuffer and before its release to the graphics queue
+    // Only particles [0, deviceParticleCount) are copied by the GPU, the rest of the requests is left to
+    // CopyHostParticles(): the host may still be writing them while the submission runs
+    void Record(VkCommandBuffer commandBuffer, VkBuffer storageBuffer, uint64_t submission, uint64_t step, uint32_t deviceParticleCount);
+
+    // Copies the particles past deviceParticleCount of the slots recorded last, once the host is done writing them
+    // particles is the whole particle array
+    void CopyHostParticles(const Particle* particles);
+
+    // Hands the slots recorded up to completedSubmission to their consumers and frees them
+    void Deliver(uint64_t completedSubmission);
+
+private:
+    struct PendingRequest {
+        uint32_t first;
+        uint32_t count;
+        Callback callback;
+    };
+
+    struct Slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void* mapped = nullptr;
+        bool inFlight = false;
+        uint64_t submission = 0;                    // Compute submission the copy was recorded in
+        uint64_t step = 0;
+        uint32_t deviceCount = 0;                   // Particles of the request copied by the GPU, the rest by the host
+        bool hostPending = false;                   // Waits for CopyHostParticles()
+        std::vector<Particle> hostParticles;        // The whole request once the host copies a part of it
+        PendingRequest request;
+    };
+
+    VulkanDevice* m_device = nullptr;
+    uint32_t m_capacity = 0;
+    bool m_coherent = false;
+    std::array<Slot, SlotCount> m_slots;
+    uint32_t m_nextSlot = 0;                        // Slots are reused in ring order so that deliveries keep the request order
+    std::deque<PendingRequest> m_requests;
+};
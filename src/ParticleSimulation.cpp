@@ -1,4 +1,5 @@
 #include <ParticleSimulation.h>
+#include <SimdSimulationBackend.h>
 #include <VulkanCamera.h>
 #include <VulkanUtils.h>
 
@@ -8,22 +9,118 @@
 
 #define ENABLE_VALIDATION true
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <ctime>
 #include <fstream>
+#include <iomanip>
+#include <iostream>
 #include <random>
 
-ParticleSimulation::ParticleSimulation() : VulkanCore(ENABLE_VALIDATION)
+namespace {
+
+    // Make the writes of the commands before the barrier visible to the commands after it
+    void PipelineMemoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+    {
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = srcAccessMask;
+        memoryBarrier.dstAccessMask = dstAccessMask;
+
+        vkCmdPipelineBarrier(
+            commandBuffer,
+            srcStageMask,
+            dstStageMask,
+            0,
+            1, &memoryBarrier,
+            0, nullptr,
+            0, nullptr);
+    }
+
+    void ComputeToComputeBarrier(VkCommandBuffer commandBuffer)
+    {
+        PipelineMemoryBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+} // anonymous
+
+ParticleSimulation::ParticleSimulation(const SimulationOptions& options) : VulkanCore(ENABLE_VALIDATION), m_options(options)
 {
     float aspect = (float)m_width / (float)m_height;
     m_camera = VulkanCamera(glm::vec3(0, 0, -5), glm::vec3(0), 45.0, aspect, 0.0, 100.);
     m_camera.SetRotationSpeed(0.3f);
     m_camera.SetMovementSpeed(10.f);
     m_attractorMouse = false;
+
+    // The validation compares the compute shader with the reference from the same seed and with the same time steps
+    if (m_options.validateSteps > 0)
+    {
+        if (m_options.backend != SIMULATION_BACKEND_GPU)
+        {
+            std::cerr << "Validation checks the GPU backend, ignoring the requested one\n";
+            m_options.backend = SIMULATION_BACKEND_GPU;
+        }
+        m_options.deterministic = true;
+        m_validation.reference = std::make_unique<CpuSimulationBackend>();
+
+        // Nothing is presented, the run needs neither a window nor a display
+        m_headless = true;
+    }
+
+    // The split follows the timings and the two sides do not round alike, the results could not be reproduced
+    if (m_options.deterministic && m_options.backend == SIMULATION_BACKEND_HYBRID)
+    {
+        std::cerr << "The hybrid backend is not available in deterministic mode, using the GPU one\n";
+        m_options.backend = SIMULATION_BACKEND_GPU;
+    }
+
+    if (m_options.backend != SIMULATION_BACKEND_GPU)
+    {
+        m_threadPool = std::make_unique<ThreadPool>(m_options.threadCount, m_options.pinThreads);
+    }
+    if (m_options.backend == SIMULATION_BACKEND_CPU)
+    {
+        m_cpuBackend = std::make_unique<CpuSimulationBackend>(m_threadPool.get());
+    }
+    else if (m_options.backend == SIMULATION_BACKEND_CPU_SIMD || m_options.backend == SIMULATION_BACKEND_HYBRID)
+    {
+        m_cpuBackend = std::make_unique<SimdSimulationBackend>(m_threadPool.get());
+    }
+    m_hybrid.enabled = m_options.backend == SIMULATION_BACKEND_HYBRID;
+    m_swapChain.SetPresentPreferences(m_options.presentMode, m_options.swapchainImageCount);
+    m_framePacing.targetFps = static_cast<int32_t>(m_options.frameLimit);
+    if (m_options.simulationRate > 0)
+    {
+        m_fixedRate.enabled = true;
+        m_fixedRate.rate = static_cast<int32_t>(m_options.simulationRate);
+    }
+    if (m_cpuBackend)
+    {
+        std::cout << "Simulation backend: " << m_cpuBackend->GetName() << ", " << m_threadPool->GetThreadCount() << " threads\n";
+    }
+
+    // A restored simulation reads its particles and state from the mapped snapshot while the resources are prepared
+    // Nothing is prepared when the requested snapshot cannot be read rather than silently starting a new simulation
+    if (!m_options.restorePath.empty() && !m_snapshot.restore.Open(m_options.restorePath, sizeof(SnapshotState), PARTICLE_COUNT))
+    {
+        m_exitCode = 1;
+    }
 }
 
 ParticleSimulation::~ParticleSimulation()
 {
+    // Nothing was created when the simulation stopped before Vulkan was initialized
+    if (m_logicalDevice == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
     // Destroy fences
     for (auto& fence : m_queueCompleteFences) {
         vkDestroyFence(m_logicalDevice, fence, nullptr);
@@ -31,23 +128,97 @@ ParticleSimulation::~ParticleSimulation()
 
     // Destroy textures
     m_textures.particle.Destroy();
+    m_textures.sdf.Destroy();
+    for (auto& field : m_textures.field) {
+        field.Destroy();
+    }
+
+    // Destroy field streaming
+    vkDestroyFence(m_logicalDevice, m_fieldStream.fence, nullptr);
+    vkUnmapMemory(m_logicalDevice, m_fieldStream.stagingBuffer.memory);
+    vkFreeMemory(m_logicalDevice, m_fieldStream.stagingBuffer.memory, nullptr);
+    vkDestroyBuffer(m_logicalDevice, m_fieldStream.stagingBuffer.buffer, nullptr);
+    vkFreeCommandBuffers(m_logicalDevice, m_compute.commandPool, 1, &m_fieldStream.commandBuffer);
 
     // Destroy compute
+    if (m_compute.storageBuffer.mapped)
+    {
+        vkUnmapMemory(m_logicalDevice, m_compute.storageBuffer.memory);
+    }
     vkFreeMemory(m_logicalDevice, m_compute.storageBuffer.memory, nullptr);
     vkDestroyBuffer(m_logicalDevice, m_compute.storageBuffer.buffer, nullptr);
+    if (m_fixedRate.previousParticles.mapped)
+    {
+        vkUnmapMemory(m_logicalDevice, m_fixedRate.previousParticles.memory);
+    }
+    vkFreeMemory(m_logicalDevice, m_fixedRate.previousParticles.memory, nullptr);
+    vkDestroyBuffer(m_logicalDevice, m_fixedRate.previousParticles.buffer, nullptr);
+    if (m_trails.history.mapped)
+    {
+        vkUnmapMemory(m_logicalDevice, m_trails.history.memory);
+    }
+    vkFreeMemory(m_logicalDevice, m_trails.history.memory, nullptr);
+    vkDestroyBuffer(m_logicalDevice, m_trails.history.buffer, nullptr);
     vkFreeMemory(m_logicalDevice, m_compute.uniformBuffer.memory, nullptr);
     vkDestroyBuffer(m_logicalDevice, m_compute.uniformBuffer.buffer, nullptr);
+    vkFreeMemory(m_logicalDevice, m_species.uniformBuffer.memory, nullptr);
+    vkDestroyBuffer(m_logicalDevice, m_species.uniformBuffer.buffer, nullptr);
+
+    // Destroy contact grid
+    for (BufferWrapper* buffer : { &m_grid.cellCounts, &m_grid.cellStarts, &m_grid.blockSums, &m_grid.particleCells, &m_grid.sortedIndices, &m_grid.contactAccelerations }) {
+        vkFreeMemory(m_logicalDevice, buffer->memory, nullptr);
+        vkDestroyBuffer(m_logicalDevice, buffer->buffer, nullptr);
+    }
+    vkDestroyPipeline(m_logicalDevice, m_grid.countPipeline, nullptr);
+    for (auto& pipeline : m_grid.scanPipelines) {
+        vkDestroyPipeline(m_logicalDevice, pipeline, nullptr);
+    }
+    vkDestroyPipeline(m_logicalDevice, m_grid.scatterPipeline, nullptr);
+    vkDestroyPipeline(m_logicalDevice, m_grid.contactsPipeline, nullptr);
+
+    // Destroy block timesteps
+    for (BufferWrapper* buffer : { &m_blockTimesteps.levelDispatches, &m_blockTimesteps.levelIndices }) {
+        vkFreeMemory(m_logicalDevice, buffer->memory, nullptr);
+        vkDestroyBuffer(m_logicalDevice, buffer->buffer, nullptr);
+    }
+    vkDestroyPipeline(m_logicalDevice, m_blockTimesteps.binPipeline, nullptr);
+    vkDestroyPipeline(m_logicalDevice, m_blockTimesteps.dispatchPipeline, nullptr);
+
+    // Destroy trails
+    vkDestroyPipeline(m_logicalDevice, m_trails.storePipeline, nullptr);
+    vkDestroyPipeline(m_logicalDevice, m_trails.pipeline, nullptr);
+    vkDestroyPipelineLayout(m_logicalDevice, m_trails.pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(m_logicalDevice, m_trails.descriptorSetLayout, nullptr);
+
+    // Destroy checksum
+    vkUnmapMemory(m_logicalDevice, m_checksum.buffer.memory);
+    vkFreeMemory(m_logicalDevice, m_checksum.buffer.memory, nullptr);
+    vkDestroyBuffer(m_logicalDevice, m_checksum.buffer.buffer, nullptr);
+    vkDestroyPipeline(m_logicalDevice, m_checksum.pipeline, nullptr);
+
+    // Destroy hybrid timestamps
+    if (m_hybrid.queryPool)
+    {
+        vkDestroyQueryPool(m_logicalDevice, m_hybrid.queryPool, nullptr);
+    }
 
     vkDestroyDescriptorSetLayout(m_logicalDevice, m_compute.descriptorSetLayout, nullptr);
     vkDestroySemaphore(m_logicalDevice, m_compute.semaphore, nullptr);
+    vkDestroyFence(m_logicalDevice, m_compute.fence, nullptr);
+
+    m_readback.Destroy();
 
     vkDestroyPipelineLayout(m_logicalDevice, m_compute.pipelineLayout, nullptr);
-    vkDestroyPipeline(m_logicalDevice, m_compute.pipeline, nullptr);
+    for (auto& pipeline : m_compute.pipelines) {
+        vkDestroyPipeline(m_logicalDevice, pipeline, nullptr);
+    }
 
     vkFreeCommandBuffers(m_logicalDevice, m_compute.commandPool, 1, &m_compute.commandBuffer);
     vkDestroyCommandPool(m_logicalDevice, m_compute.commandPool, nullptr);
 
     // Destroy graphics
+    vkFreeCommandBuffers(m_logicalDevice, m_cmdPool, static_cast<uint32_t>(m_graphics.prePassCmdBuffers.size()), m_graphics.prePassCmdBuffers.data());
+    vkFreeCommandBuffers(m_logicalDevice, m_cmdPool, static_cast<uint32_t>(m_graphics.sceneCmdBuffers.size()), m_graphics.sceneCmdBuffers.data());
     vkFreeMemory(m_logicalDevice, m_graphics.cubeVertexBuffer.memory, nullptr);
     vkDestroyBuffer(m_logicalDevice, m_graphics.cubeVertexBuffer.buffer, nullptr);
     vkFreeMemory(m_logicalDevice, m_graphics.uniformBuffer.memory, nullptr);
@@ -59,8 +230,52 @@ ParticleSimulation::~ParticleSimulation()
     vkDestroyPipelineLayout(m_logicalDevice, m_graphics.cube.pipelineLayout, nullptr);
 
     vkDestroyPipeline(m_logicalDevice, m_graphics.particle.pipeline, nullptr);
+    vkDestroyPipeline(m_logicalDevice, m_graphics.sortedParticlePipeline, nullptr);
     vkDestroyPipeline(m_logicalDevice, m_graphics.cube.pipeline, nullptr);
     vkDestroySemaphore(m_logicalDevice, m_graphics.semaphore, nullptr);
+
+    if (m_sprites.statisticsPool)
+    {
+        vkDestroyQueryPool(m_logicalDevice, m_sprites.statisticsPool, nullptr);
+    }
+
+    // Destroy culling
+    if (m_culling.supported)
+    {
+        vkUnmapMemory(m_logicalDevice, m_culling.drawCommand.memory);
+        for (BufferWrapper* buffer : { &m_culling.visibleParticles, &m_culling.drawCommand }) {
+            vkFreeMemory(m_logicalDevice, buffer->memory, nullptr);
+            vkDestroyBuffer(m_logicalDevice, buffer->buffer, nullptr);
+        }
+        vkDestroyPipeline(m_logicalDevice, m_culling.pipeline, nullptr);
+        vkDestroyPipelineLayout(m_logicalDevice, m_culling.pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(m_logicalDevice, m_culling.descriptorSetLayout, nullptr);
+    }
+
+    // Destroy splatting
+    if (m_splatting.supported)
+    {
+        vkDestroyImageView(m_logicalDevice, m_splatting.view, nullptr);
+        vkDestroyImage(m_logicalDevice, m_splatting.image, nullptr);
+        vkFreeMemory(m_logicalDevice, m_splatting.memory, nullptr);
+        vkDestroyPipeline(m_logicalDevice, m_splatting.splatPipeline, nullptr);
+        vkDestroyPipeline(m_logicalDevice, m_splatting.resolvePipeline, nullptr);
+        vkDestroyPipelineLayout(m_logicalDevice, m_splatting.pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(m_logicalDevice, m_splatting.descriptorSetLayout, nullptr);
+    }
+
+    // Destroy depth sort
+    if (m_depthSort.supported)
+    {
+        m_depthSort.sort.Destroy();
+        for (BufferWrapper* buffer : { &m_depthSort.keys, &m_depthSort.indices }) {
+            vkFreeMemory(m_logicalDevice, buffer->memory, nullptr);
+            vkDestroyBuffer(m_logicalDevice, buffer->buffer, nullptr);
+        }
+        vkDestroyPipeline(m_logicalDevice, m_depthSort.keyPipeline, nullptr);
+        vkDestroyPipelineLayout(m_logicalDevice, m_depthSort.pipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(m_logicalDevice, m_depthSort.descriptorSetLayout, nullptr);
+    }
 }
 
 
@@ -71,12 +286,38 @@ void ParticleSimulation::Render()
         return;
     }
 
-    Draw();
+    // The previous compute submission has to be done before its uniforms and command buffer are updated
+    VK_CHECK_RESULT(vkWaitForFences(m_logicalDevice, 1, &m_compute.fence, VK_TRUE, UINT64_MAX));
+    ReadChecksum();
+    m_readback.Deliver(m_compute.submissions);
+    UpdateHybridSplit();
+    UpdateSpriteCap();
+    UpdateLodThreshold();
+    UpdateFixedRate();
+    UpdateTrails();
+
     UpdateUniformBuffers();
+    RequestStepReadbacks();
+    Draw();
 }
 
 void ParticleSimulation::Draw()
 {
+    // The compute command buffer is recorded again every frame, see Render() for the wait on its previous submission
+    VK_CHECK_RESULT(vkResetFences(m_logicalDevice, 1, &m_compute.fence));
+    if (m_cpuBackend && !m_hybrid.enabled && m_fixedRate.step)
+    {
+        StepCpuBackend(0);
+    }
+    if (m_validation.reference && m_fixedRate.step)
+    {
+        StepValidation();
+    }
+    BuildComputeCommandBuffer();
+
+    // Field uploads go first on the compute queue, the simulation samples the slots they fill
+    StreamFieldSlices();
+
     VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 
     // Submit graphics commands
@@ -84,18 +325,37 @@ void ParticleSimulation::Draw()
     computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     computeSubmitInfo.commandBufferCount = 1;
     computeSubmitInfo.pCommandBuffers = &m_compute.commandBuffer;
-    computeSubmitInfo.waitSemaphoreCount = 1;
+    // Headless frames have no graphics submission to wait for nor to signal
+    computeSubmitInfo.waitSemaphoreCount = m_headless ? 0 : 1;
     computeSubmitInfo.pWaitSemaphores = &m_graphics.semaphore;
     computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
-    computeSubmitInfo.signalSemaphoreCount = 1;
+    computeSubmitInfo.signalSemaphoreCount = m_headless ? 0 : 1;
     computeSubmitInfo.pSignalSemaphores = &m_compute.semaphore;
-    VK_CHECK_RESULT(vkQueueSubmit(m_compute.queue, 1, &computeSubmitInfo, VK_NULL_HANDLE));
+    VK_CHECK_RESULT(vkQueueSubmit(m_compute.queue, 1, &computeSubmitInfo, m_compute.fence));
+    m_compute.submissions++;
+
+    // The host slice is integrated while the GPU works on its own, both are done before the graphics submission
+    if (m_hybrid.enabled && m_fixedRate.step)
+    {
+        auto start = std::chrono::steady_clock::now();
+        StepCpuBackend(m_hybrid.gpuCount);
+        m_hybrid.cpuTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Nothing is drawn without a swapchain, the next frame waits for the compute fence
+    if (m_headless)
+    {
+        return;
+    }
+
     // Acquire the next image
     // Note the cpu wait if there is image ready to be rendered in. However with 3 frames in flights and using a mail box presenting more
     // we should always have at least one image ready
     VulkanCore::PrepareFrame();
+    RecordDrawCommandBuffer();
 
-    VkPipelineStageFlags graphicsWaitStageMasks[] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    // The culling pass reads the particles in a compute dispatch ahead of the draw
+    VkPipelineStageFlags graphicsWaitStageMasks[] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
     VkSemaphore graphicsWaitSemaphores[] = { m_compute.semaphore, m_semaphores.presentComplete };
     VkSemaphore graphicsSignalSemaphores[] = { m_graphics.semaphore, m_semaphores.renderComplete };
 
@@ -108,6 +368,10 @@ void ParticleSimulation::Draw()
     m_submitInfo.signalSemaphoreCount = 2;
     m_submitInfo.pSignalSemaphores = graphicsSignalSemaphores;
     VK_CHECK_RESULT(vkQueueSubmit(m_graphicsQueue, 1, &m_submitInfo, VK_NULL_HANDLE));
+    if (m_sprites.statisticsPool)
+    {
+        m_sprites.statisticsPending[m_currentBuffer] = true;
+    }
 
     // Present the Frame to the queue
     // NOTE: Submit Frame does an vkQueueWaitIdle on the graphics Queue
@@ -122,27 +386,95 @@ void ParticleSimulation::Prepare()
     m_graphics.queueFamilyIndex = m_vulkanDevice->queueFamilyIndices.graphics;
     m_compute.queueFamilyIndex = m_vulkanDevice->queueFamilyIndices.compute;
 
+    // Headless frames only submit the compute work, on the graphics family so that no queue ever has to take the
+    // buffers back, see RecordOwnershipTransfer()
+    if (m_headless)
+    {
+        m_compute.queueFamilyIndex = m_graphics.queueFamilyIndex;
+    }
+
     LoadAssets();
     SetupParticleDescriptorPool();
 
+    // species table shared between compute / vertex shader
+    PrepareSpecies();
+
     // create storagee buffer shared betweem compute / vertex shader
     PrepareStorageBuffers();
+    PrepareGridBuffers();
+    PrepareBlockTimestepBuffers();
+    PrepareChecksum();
+    m_readback.Prepare(m_vulkanDevice, PARTICLE_COUNT);
+
+    // Particles are kept inside the collider domain, the positions are quantized over it
+    if (!m_options.recordPath.empty())
+    {
+        m_recording.recorder.Open(m_options.recordPath, PARTICLE_COUNT, glm::vec3(m_compute.ubo.sdfBoundsMin), glm::vec3(m_compute.ubo.sdfBoundsMax),
+            m_options.recordThreads);
+    }
 
     PrepareCubeVextexBuffers();
 
     // create compute UBO and get host accessible mapping
     PrepareUniformBuffers();
+    RestoreSnapshotState();
 
     PrepareGraphics();
     PrepareCompute();
 
     BuildCommandBuffers();
     m_prepared = true;
+
+    if (m_options.benchmarkSort)
+    {
+        RunSortBenchmark();
+    }
 }
 
 void ParticleSimulation::LoadAssets()
 {
     m_textures.particle.LoadFromFile("../../textures/particle_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, m_vulkanDevice, m_graphicsQueue);
+
+    // Collision scene: particles are kept inside the cube and bounce on a sphere
+    // Baking is cached on disk, only a scene change pays for it
+    glm::vec3 sdfBoundsMin(-SDF_DOMAIN_EXTENT);
+    glm::vec3 sdfBoundsMax(SDF_DOMAIN_EXTENT);
+    m_collider.AddBox(glm::vec3(0.0f), glm::vec3(1.0f), true);
+    m_collider.AddSphere(glm::vec3(0.5f, -0.5f, 0.0f), 0.3f);
+    m_collider.Bake(SDF_RESOLUTION, sdfBoundsMin, sdfBoundsMax, "../../cache");
+
+    std::vector<uint16_t> sdfData = m_collider.GetHalfData();
+    m_textures.sdf.FromBuffer(sdfData.data(), sdfData.size() * sizeof(uint16_t), VK_FORMAT_R16_SFLOAT,
+        SDF_RESOLUTION, SDF_RESOLUTION, SDF_RESOLUTION, m_vulkanDevice, m_graphicsQueue);
+
+    m_compute.ubo.sdfBoundsMin = glm::vec4(sdfBoundsMin, 0.0f);
+    m_compute.ubo.sdfBoundsMax = glm::vec4(sdfBoundsMax, 0.0f);
+
+    // The contact grid covers the collider domain, particles cannot leave it
+    m_compute.ubo.gridOrigin = glm::vec4(sdfBoundsMin, (sdfBoundsMax.x - sdfBoundsMin.x) / GRID_DIM);
+
+    // Vector field: an imported wind field when available, procedural curl noise otherwise
+    if (!m_vectorField.LoadFromFile("../../fields/wind.vfld"))
+    {
+        m_vectorField.GenerateCurlNoise(32, 8, 1.5f, 0.025f, 1337);
+    }
+
+    // Fill the slots with the first keyframes, the following ones are streamed while the simulation runs
+    // A restored simulation starts from the keyframe it was saved at
+    const SnapshotState* restoredState = GetRestoredState();
+    uint32_t firstKeyframe = restoredState ? restoredState->fieldKeyframe : 0;
+    uint32_t frameCount = m_vectorField.GetFrameCount();
+    for (uint32_t keyframe = firstKeyframe; keyframe < firstKeyframe + FIELD_SLOT_COUNT; ++keyframe)
+    {
+        // Slots are kept in the general layout so that slices can be copied in without layout transitions
+        m_textures.field[keyframe % FIELD_SLOT_COUNT].FromBuffer(m_vectorField.GetFrame(keyframe % frameCount), m_vectorField.GetFrameSize(), VK_FORMAT_R16G16B16A16_SFLOAT,
+            m_vectorField.GetWidth(), m_vectorField.GetHeight(), m_vectorField.GetDepth(), m_vulkanDevice, m_graphicsQueue,
+            VK_FILTER_LINEAR, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_GENERAL);
+    }
+    m_fieldStream.streamedSlices = m_vectorField.GetDepth();
+
+    m_compute.ubo.fieldBoundsMin = glm::vec4(m_vectorField.GetBoundsMin(), 0.0f);
+    m_compute.ubo.fieldBoundsMax = glm::vec4(m_vectorField.GetBoundsMax(), 0.0f);
 }
 
 void ParticleSimulation::SetupParticleDescriptorSetLayout()
@@ -159,9 +491,16 @@ void ParticleSimulation::SetupParticleDescriptorSetLayout()
     particleSamplerBinding.binding = 0;
     particleSamplerBinding.descriptorCount = 1;
 
+    VkDescriptorSetLayoutBinding speciesBinding{};
+    speciesBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    speciesBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    speciesBinding.binding = 2;
+    speciesBinding.descriptorCount = 1;
+
     std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
         uboBinding,
-        particleSamplerBinding
+        particleSamplerBinding,
+        speciesBinding
     };
 
     VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
@@ -192,28 +531,33 @@ void ParticleSimulation::SetupParticleDescriptorPool()
 {
     VkDescriptorPoolSize descriptorPoolUniformSize{};
     descriptorPoolUniformSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorPoolUniformSize.descriptorCount = 3;
+    descriptorPoolUniformSize.descriptorCount = 11;
 
     VkDescriptorPoolSize descriptorPoolStorageBufferSize{};
     descriptorPoolStorageBufferSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    descriptorPoolStorageBufferSize.descriptorCount = 1;
+    descriptorPoolStorageBufferSize.descriptorCount = 24;
 
     VkDescriptorPoolSize descriptorPoolImageSampler{};
     descriptorPoolImageSampler.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorPoolImageSampler.descriptorCount = 1;
+    descriptorPoolImageSampler.descriptorCount = 2 + FIELD_SLOT_COUNT;
+
+    VkDescriptorPoolSize descriptorPoolStorageImage{};
+    descriptorPoolStorageImage.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorPoolStorageImage.descriptorCount = 1;
 
     std::vector<VkDescriptorPoolSize> poolSizes =
     {
         descriptorPoolUniformSize,
         descriptorPoolStorageBufferSize,
-        descriptorPoolImageSampler
+        descriptorPoolImageSampler,
+        descriptorPoolStorageImage
     };
 
     VkDescriptorPoolCreateInfo descriptorPoolInfo{};
     descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     descriptorPoolInfo.pPoolSizes = poolSizes.data();
-    descriptorPoolInfo.maxSets = 4;
+    descriptorPoolInfo.maxSets = 8;
 
     VK_CHECK_RESULT(vkCreateDescriptorPool(m_logicalDevice, &descriptorPoolInfo, nullptr, &m_descriptorPool));
 }
@@ -244,10 +588,19 @@ void ParticleSimulation::SetupParticleDescriptorSet()
     writeUboDescriptorSet.pBufferInfo = &m_graphics.uniformBuffer.descriptor;
     writeUboDescriptorSet.descriptorCount = 1;
 
+    VkWriteDescriptorSet writeSpeciesDescriptorSet{};
+    writeSpeciesDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeSpeciesDescriptorSet.dstSet = m_graphics.particle.descriptorSet;
+    writeSpeciesDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    writeSpeciesDescriptorSet.dstBinding = 2;
+    writeSpeciesDescriptorSet.pBufferInfo = &m_species.uniformBuffer.descriptor;
+    writeSpeciesDescriptorSet.descriptorCount = 1;
+
     std::vector<VkWriteDescriptorSet> writeDescriptorSets
     {
         writeUboDescriptorSet,
-        writeSamplerDescriptorSet
+        writeSamplerDescriptorSet,
+        writeSpeciesDescriptorSet
     };
 
     vkUpdateDescriptorSets(m_logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
@@ -357,17 +710,40 @@ void ParticleSimulation::PrepareCubeVextexBuffers()
 
 void ParticleSimulation::PrepareStorageBuffers()
 {
-    std::default_random_engine rndEngine((unsigned)time(nullptr));
-    std::uniform_real_distribution<float> rndDist(-1.f, 1.f);
+    // A restored simulation uploads the particles straight from the mapped snapshot
+    std::vector<Particle> particleBuffer;
+    const Particle* particles = nullptr;
+    const SnapshotState* restoredState = GetRestoredState();
+    if (restoredState)
+    {
+        m_snapshot.seed = restoredState->seed;
+        particles = m_snapshot.restore.GetParticles();
+    }
+    else
+    {
+        // Deterministic runs start from the same state
+        m_snapshot.seed = m_options.deterministic ? m_options.seed : (unsigned)time(nullptr);
+        std::default_random_engine rndEngine(m_snapshot.seed);
+        std::uniform_real_distribution<float> rndDist(-1.f, 1.f);
+        std::uniform_real_distribution<float> rndRadius(PARTICLE_RADIUS_MIN, PARTICLE_RADIUS_MAX);
+
+        // Initial particle positions and radii, species are evenly distributed
+        particleBuffer.resize(PARTICLE_COUNT);
+        uint32_t speciesCount = static_cast<uint32_t>(m_species.names.size());
+        for (uint32_t i = 0; i < particleBuffer.size(); ++i) {
+            Particle& particle = particleBuffer[i];
+            particle.pos = glm::vec4(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine), rndRadius(rndEngine));
+            particle.vel = glm::vec4(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine), static_cast<float>(i % speciesCount));
+        }
+        particles = particleBuffer.data();
+    }
+    VkDeviceSize storageBufferSize = static_cast<VkDeviceSize>(PARTICLE_COUNT) * sizeof(Particle);
 
-    // Initial particle positions
-    std::vector<Particle> particleBuffer(PARTICLE_COUNT);
-    for (auto& particle : particleBuffer) {
-        particle.pos = glm::vec4(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine), 1.0);
-        particle.vel = glm::vec4(rndDist(rndEngine), rndDist(rndEngine), rndDist(rndEngine), 1.0);
+    if (m_validation.reference)
+    {
+        m_validation.particles.assign(particles, particles + PARTICLE_COUNT);
+        m_validation.step = restoredState ? restoredState->step : 0;
     }
-    auto sizeParticule = sizeof(Particle);
-    VkDeviceSize storageBufferSize = particleBuffer.size() * sizeof(Particle);
 
     // Staging
     // SSBO won't be changed on the host after upload so copy to device local memory
@@ -379,87 +755,123 @@ void ParticleSimulation::PrepareStorageBuffers()
         &stagingBuffer.buffer,
         &stagingBuffer.memory,
         storageBufferSize,
-        particleBuffer.data());
+        const_cast<Particle*>(particles));
+
+    // Device local memory mapped by the host where available, the host backends write the particles in place
+    // Without it they fall back to host memory read by the GPU over the bus
+    VkMemoryPropertyFlags storageMemoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    VkBool32 storageMemoryFound = VK_FALSE;
+    m_vulkanDevice->GetMemoryType(~0u, storageMemoryFlags, &storageMemoryFound);
+    if (!storageMemoryFound)
+    {
+        storageMemoryFlags = m_cpuBackend ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    }
 
     m_vulkanDevice->CreateBuffer(
         // The SSBO will be used as a storage buffer for the compute pipeline and as a vertex buffer in the graphics pipeline
         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+        storageMemoryFlags,
         &m_compute.storageBuffer.buffer,
         &m_compute.storageBuffer.memory,
         storageBufferSize);
 
-    // Copy from staging buffer to storage buffer
+    // Positions before the last step of the fixed rate simulation, written by the same sides as the storage buffer
+    m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        storageMemoryFlags,
+        &m_fixedRate.previousParticles.buffer,
+        &m_fixedRate.previousParticles.memory,
+        storageBufferSize);
+
+    // Trail history, only read back for the steps stored since the trails were enabled so it needs no initial content
+    // The host slice of the hybrid backend is stored by StepCpuBackend(), the history is mapped like the particles
+    VkDeviceSize historySize = static_cast<VkDeviceSize>(TRAIL_LENGTH) * PARTICLE_COUNT * sizeof(glm::vec4);
+    m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        m_hybrid.enabled ? storageMemoryFlags : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &m_trails.history.buffer,
+        &m_trails.history.memory,
+        historySize);
+    m_trails.history.descriptor.buffer = m_trails.history.buffer;
+    m_trails.history.descriptor.offset = 0;
+    m_trails.history.descriptor.range = historySize;
+
+    // Copy from staging buffer to storage buffer, the previous positions start equal to the current ones
     VkCommandBuffer copyCmd = m_vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
     VkBufferCopy copyRegion = {};
     copyRegion.size = storageBufferSize;
     vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, m_compute.storageBuffer.buffer, 1, &copyRegion);
+    vkCmdCopyBuffer(copyCmd, stagingBuffer.buffer, m_fixedRate.previousParticles.buffer, 1, &copyRegion);
 
     // Set descriptor
     m_compute.storageBuffer.descriptor.buffer = m_compute.storageBuffer.buffer;
     m_compute.storageBuffer.descriptor.offset = 0;
     m_compute.storageBuffer.descriptor.range = VK_WHOLE_SIZE;
-
-    // Execute a transfer barrier to the compute queue // FIXME: refactor
-    if (m_graphics.queueFamilyIndex != m_compute.queueFamilyIndex)
-    {
-        VkBufferMemoryBarrier buffer_barrier =
-        {
-            VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-            nullptr,
-            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-            0,
-            m_graphics.queueFamilyIndex,
-            m_compute.queueFamilyIndex,
-            m_compute.storageBuffer.buffer,
-            0,
-            m_compute.storageBuffer.descriptor.range
-        };
-
-        vkCmdPipelineBarrier(
-            copyCmd,
-            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-            0,
-            0, nullptr,
-            1, &buffer_barrier,
-            0, nullptr);
-    }
+    m_fixedRate.previousParticles.descriptor.buffer = m_fixedRate.previousParticles.buffer;
+    m_fixedRate.previousParticles.descriptor.offset = 0;
+    m_fixedRate.previousParticles.descriptor.range = VK_WHOLE_SIZE;
+
+    // Execute a transfer barrier to the compute queue
+    RecordOwnershipTransfer(copyCmd, m_graphics.queueFamilyIndex, m_compute.queueFamilyIndex,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
     m_vulkanDevice->FlushCommandBuffer(copyCmd, m_graphicsQueue, true);
 
     // Cleanup
     vkDestroyBuffer(m_logicalDevice, stagingBuffer.buffer, nullptr);
     vkFreeMemory(m_logicalDevice, stagingBuffer.memory, nullptr);
 
+    // The host backend integrates the particles in place, the storage buffer stays mapped
+    if (m_cpuBackend)
+    {
+        VK_CHECK_RESULT(vkMapMemory(m_logicalDevice, m_compute.storageBuffer.memory, 0, VK_WHOLE_SIZE, 0, &m_compute.storageBuffer.mapped));
+        VK_CHECK_RESULT(vkMapMemory(m_logicalDevice, m_fixedRate.previousParticles.memory, 0, VK_WHOLE_SIZE, 0, &m_fixedRate.previousParticles.mapped));
+    }
+    if (m_hybrid.enabled)
+    {
+        VK_CHECK_RESULT(vkMapMemory(m_logicalDevice, m_trails.history.memory, 0, VK_WHOLE_SIZE, 0, &m_trails.history.mapped));
+    }
+
     // Binding description
     VkVertexInputBindingDescription vInputBindDescription{};
     vInputBindDescription.binding = VERTEX_BUFFER_BIND_ID;
     vInputBindDescription.stride = sizeof(Particle);
     vInputBindDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-    m_particleVertices.bindingDescriptions.resize(1);
+    m_particleVertices.bindingDescriptions.resize(2);
     m_particleVertices.bindingDescriptions[0] = vInputBindDescription;
+    vInputBindDescription.binding = PREVIOUS_VERTEX_BUFFER_BIND_ID;
+    m_particleVertices.bindingDescriptions[1] = vInputBindDescription;
 
     // Attribute descriptions
     // Describes memory layout and shader positions
     VkVertexInputAttributeDescription vInputPositionAttribDescriptionPosition{};
     vInputPositionAttribDescriptionPosition.location = 0;
     vInputPositionAttribDescriptionPosition.binding = VERTEX_BUFFER_BIND_ID;
-    vInputPositionAttribDescriptionPosition.format = VK_FORMAT_R32G32B32_SFLOAT;
+    vInputPositionAttribDescriptionPosition.format = VK_FORMAT_R32G32B32A32_SFLOAT;
     vInputPositionAttribDescriptionPosition.offset = offsetof(Particle, pos);
 
     VkVertexInputAttributeDescription vInputPositionAttribDescriptionVelocity{};
     vInputPositionAttribDescriptionVelocity.location = 1;
     vInputPositionAttribDescriptionVelocity.binding = VERTEX_BUFFER_BIND_ID;
-    vInputPositionAttribDescriptionVelocity.format = VK_FORMAT_R32G32B32_SFLOAT;
+    vInputPositionAttribDescriptionVelocity.format = VK_FORMAT_R32G32B32A32_SFLOAT;
     vInputPositionAttribDescriptionVelocity.offset = offsetof(Particle, vel);
 
+    VkVertexInputAttributeDescription vInputPositionAttribDescriptionPreviousPosition{};
+    vInputPositionAttribDescriptionPreviousPosition.location = 2;
+    vInputPositionAttribDescriptionPreviousPosition.binding = PREVIOUS_VERTEX_BUFFER_BIND_ID;
+    vInputPositionAttribDescriptionPreviousPosition.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    vInputPositionAttribDescriptionPreviousPosition.offset = offsetof(Particle, pos);
+
     m_particleVertices.attributeDescriptions = {
         // Location 0: Position
         vInputPositionAttribDescriptionPosition,
 
         // Location 1: Velocity
-        vInputPositionAttribDescriptionVelocity
+        vInputPositionAttribDescriptionVelocity,
+
+        // Location 2: Position before the last step
+        vInputPositionAttribDescriptionPreviousPosition
     };
 
     // Assign to vertex buffer
@@ -472,6 +884,106 @@ void ParticleSimulation::PrepareStorageBuffers()
     m_particleVertices.inputState.pVertexAttributeDescriptions = m_particleVertices.attributeDescriptions.data();
 }
 
+void ParticleSimulation::PrepareGridBuffers()
+{
+    // Scratch buffers of the contact grid, only accessed by the compute shaders
+    auto createBuffer = [this](BufferWrapper& buffer, VkDeviceSize size) {
+        VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &buffer.buffer,
+            &buffer.memory,
+            size));
+        buffer.descriptor.buffer = buffer.buffer;
+        buffer.descriptor.offset = 0;
+        buffer.descriptor.range = size;
+    };
+
+    createBuffer(m_grid.cellCounts, GRID_CELL_COUNT * sizeof(uint32_t));
+    createBuffer(m_grid.cellStarts, GRID_CELL_COUNT * sizeof(uint32_t));
+    createBuffer(m_grid.blockSums, GRID_CELL_COUNT / GRID_SCAN_BLOCK_SIZE * sizeof(uint32_t));
+    createBuffer(m_grid.particleCells, PARTICLE_COUNT * sizeof(glm::uvec2));
+    createBuffer(m_grid.sortedIndices, PARTICLE_COUNT * sizeof(uint32_t));
+    createBuffer(m_grid.contactAccelerations, PARTICLE_COUNT * sizeof(glm::vec4));
+}
+
+void ParticleSimulation::PrepareBlockTimestepBuffers()
+{
+    // The level dispatches are written by block_dispatch.comp and consumed as indirect dispatch arguments
+    VkDeviceSize dispatchesSize = BLOCK_MAX_LEVELS * sizeof(BlockLevelDispatch);
+    VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &m_blockTimesteps.levelDispatches.buffer,
+        &m_blockTimesteps.levelDispatches.memory,
+        dispatchesSize));
+    m_blockTimesteps.levelDispatches.descriptor.buffer = m_blockTimesteps.levelDispatches.buffer;
+    m_blockTimesteps.levelDispatches.descriptor.offset = 0;
+    m_blockTimesteps.levelDispatches.descriptor.range = dispatchesSize;
+
+    // Every level can hold all the particles, so that the binning never overflows
+    VkDeviceSize indicesSize = BLOCK_MAX_LEVELS * PARTICLE_COUNT * sizeof(uint32_t);
+    VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &m_blockTimesteps.levelIndices.buffer,
+        &m_blockTimesteps.levelIndices.memory,
+        indicesSize));
+    m_blockTimesteps.levelIndices.descriptor.buffer = m_blockTimesteps.levelIndices.buffer;
+    m_blockTimesteps.levelIndices.descriptor.offset = 0;
+    m_blockTimesteps.levelIndices.descriptor.range = indicesSize;
+}
+
+void ParticleSimulation::PrepareSpecies()
+{
+    // Default species, unused entries of the table stay neutral
+    Species neutral{ glm::vec4(1.0f), 1.0f, 0.0f, 1.0f, 1.0f };
+    m_species.table.fill(neutral);
+
+    m_species.names = { "Dust", "Heavy", "Light", "Repelled" };
+    m_species.table[0] = neutral;
+    m_species.table[1] = { glm::vec4(1.0f, 0.6f, 0.2f, 1.0f), 4.0f, 0.1f, 0.5f, 1.0f };
+    m_species.table[2] = { glm::vec4(0.3f, 0.8f, 1.0f, 1.0f), 0.25f, 0.5f, 2.0f, 0.5f };
+    m_species.table[3] = { glm::vec4(1.0f, 0.3f, 0.8f, 1.0f), 1.0f, 0.2f, 1.0f, -0.5f };
+
+    // A restored simulation keeps the species edited before it was saved
+    const SnapshotState* restoredState = GetRestoredState();
+    if (restoredState)
+    {
+        m_species.table = restoredState->species;
+    }
+
+    VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &m_species.uniformBuffer.buffer,
+        &m_species.uniformBuffer.memory,
+        sizeof(m_species.table)));
+    vkMapMemory(m_logicalDevice, m_species.uniformBuffer.memory, 0, sizeof(m_species.table), 0, &m_species.uniformBuffer.mapped);
+    memcpy(m_species.uniformBuffer.mapped, m_species.table.data(), sizeof(m_species.table));
+
+    m_species.uniformBuffer.descriptor.buffer = m_species.uniformBuffer.buffer;
+    m_species.uniformBuffer.descriptor.offset = 0;
+    m_species.uniformBuffer.descriptor.range = sizeof(m_species.table);
+}
+
+void ParticleSimulation::PrepareChecksum()
+{
+    // Host visible so that the result can be read once the compute submission is done
+    VkDeviceSize size = 2 * sizeof(uint32_t);
+    VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &m_checksum.buffer.buffer,
+        &m_checksum.buffer.memory,
+        size));
+    VK_CHECK_RESULT(vkMapMemory(m_logicalDevice, m_checksum.buffer.memory, 0, size, 0, &m_checksum.buffer.mapped));
+
+    m_checksum.buffer.descriptor.buffer = m_checksum.buffer.buffer;
+    m_checksum.buffer.descriptor.offset = 0;
+    m_checksum.buffer.descriptor.range = size;
+}
+
 void ParticleSimulation::PrepareUniformBuffers()
 {
     // Graphics UBO
@@ -514,26 +1026,40 @@ void ParticleSimulation::UpdateViewUniformBuffers()
     m_graphics.ubo.model = glm::rotate(m_graphics.ubo.model, glm::radians(m_frameTimer * 25.0f), glm::vec3(0, 1, 0));
     m_graphics.ubo.view = m_camera.GetViewMatrix();
     m_graphics.ubo.projection = m_camera.GetProjectionMatrix();
+    m_graphics.ubo.sprite = glm::vec4(m_sprites.size, m_sprites.pixelCap, static_cast<float>(m_height), m_sprites.intensity);
+    bool culledDraw = m_culling.enabled && !m_splatting.enabled && !m_depthSort.enabled;
+    m_graphics.ubo.lod = glm::vec4(m_lod.thresholdPixels, culledDraw ? 1.0f : 0.0f, LOD_MIN_KEEP, 0.0f);
+    m_graphics.ubo.interpolation = glm::vec4(m_fixedRate.alpha, 0.0f, 0.0f, 0.0f);
+    m_graphics.ubo.trail = glm::vec4(static_cast<float>(m_trails.slot), static_cast<float>(m_trails.steps), static_cast<float>(TRAIL_LENGTH), m_trails.intensity);
     memcpy(m_graphics.uniformBuffer.mapped, &m_graphics.ubo, sizeof(m_graphics.ubo));
 }
 
 void ParticleSimulation::UpdateUniformBuffers()
 {
     UpdateViewUniformBuffers();
-    static float timer = 0.0f;
     static float timerSpeed = .08f;
-    timer += timerSpeed * m_frameTimer;
-    if (timer > 1.0)
+    m_attractorTimer += timerSpeed * SimulationFrameTime();
+    if (m_attractorTimer > 1.0)
     {
-        timer -= 1.0f;
+        m_attractorTimer -= 1.0f;
     }
+    m_simulationTime += SimulationFrameTime() * SIMULATION_TIME_SCALE;
 
-    m_compute.ubo.elapsedTime = m_frameTimer / 80;
+    // The frame time is split between the substeps dispatched in the compute command buffer
+    // With block timesteps each level subdivides the whole frame step instead
+    m_compute.ubo.elapsedTime = SimulationFrameTime() * SIMULATION_TIME_SCALE;
+    if (!m_compute.blockTimesteps)
+    {
+        m_compute.ubo.elapsedTime /= m_compute.substeps;
+    }
+    m_compute.ubo.blockTimesteps = m_compute.blockTimesteps ? 1 : 0;
+    m_compute.ubo.blockLevelCount = static_cast<uint32_t>(m_compute.blockLevelCount);
+    m_compute.ubo.trailSlot = m_trails.slot;
     if (!m_attractorMouse)
     {
-        m_compute.ubo.destX = sin(glm::radians(timer * 360));
-        m_compute.ubo.destY = sin(glm::radians(timer * 360));
-        m_compute.ubo.destZ = sin(glm::radians(timer * 360));
+        m_compute.ubo.destX = sin(glm::radians(m_attractorTimer * 360));
+        m_compute.ubo.destY = sin(glm::radians(m_attractorTimer * 360));
+        m_compute.ubo.destZ = sin(glm::radians(m_attractorTimer * 360));
     }
     else
     {
@@ -543,6 +1069,8 @@ void ParticleSimulation::UpdateUniformBuffers()
         m_compute.ubo.destY = normalizedMy;
     }
 
+    UpdateFieldKeyframes();
+
     memcpy(m_compute.uniformBuffer.mapped, &m_compute.ubo, sizeof(m_compute.ubo));
 }
 
@@ -691,9 +1219,17 @@ void ParticleSimulation::PrepareParticlePipeline()
     rasterizationStateCreateInfo.depthClampEnable = VK_FALSE;
     rasterizationStateCreateInfo.lineWidth = 1.0f;
 
+    // Additive blending of the premultiplied sprites, the sum does not depend on the draw order so no sort and no
+    // depth writes are needed
     VkPipelineColorBlendAttachmentState colorBlendAttachmentState{};
     colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachmentState.blendEnable = VK_FALSE;
+    colorBlendAttachmentState.blendEnable = VK_TRUE;
+    colorBlendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
 
     VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo{};
     colorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -749,12 +1285,33 @@ void ParticleSimulation::PrepareParticlePipeline()
 
     VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_graphics.particle.pipeline));
 
+    // Premultiplied "over" blending of the depth sorted sprites, the alpha is the sprite texture alpha times the particle opacity
+    colorBlendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_graphics.sortedParticlePipeline));
+
     SetupParticleDescriptorSet();
 }
 
 void ParticleSimulation::PrepareGraphics()
 {
     PrepareGraphicsPipelines();
+    PrepareCulling();
+    PrepareSplatting();
+    PrepareDepthSort();
+    PrepareTrails();
+
+    // Secondary command buffers of the scene, recorded by BuildCommandBuffers()
+    m_graphics.prePassCmdBuffers.resize(m_drawCmdBuffers.size());
+    m_graphics.sceneCmdBuffers.resize(m_drawCmdBuffers.size());
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo{};
+    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocateInfo.commandPool = m_cmdPool;
+    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    commandBufferAllocateInfo.commandBufferCount = static_cast<uint32_t>(m_drawCmdBuffers.size());
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(m_logicalDevice, &commandBufferAllocateInfo, m_graphics.prePassCmdBuffers.data()));
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(m_logicalDevice, &commandBufferAllocateInfo, m_graphics.sceneCmdBuffers.data()));
 
     // Semaphore for compute & graphics sync
     VkSemaphoreCreateInfo semaphoreCreateInfo{};
@@ -779,88 +1336,844 @@ void ParticleSimulation::PrepareGraphics()
     {
         VK_CHECK_RESULT(vkCreateFence(m_logicalDevice, &fenceCreateInfo, nullptr, &fence));
     }
+
+    // Fragments shaded by the particle draw of each command buffer, the sprite cap stays at its UI value without them
+    if (m_enabledFeatures.pipelineStatisticsQuery)
+    {
+        VkQueryPoolCreateInfo queryPoolCreateInfo{};
+        queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        queryPoolCreateInfo.queryCount = static_cast<uint32_t>(m_drawCmdBuffers.size());
+        queryPoolCreateInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        VK_CHECK_RESULT(vkCreateQueryPool(m_logicalDevice, &queryPoolCreateInfo, nullptr, &m_sprites.statisticsPool));
+        m_sprites.statisticsPending.assign(m_drawCmdBuffers.size(), false);
+    }
 }
 
-void ParticleSimulation::PrepareCompute()
+void ParticleSimulation::PrepareCulling()
 {
-    // Create a compute capable device queue
-    // The VulkanDevice::createLogicalDevice functions finds a compute capable queue and prefers queue families that only support compute
-    // Depending on the implementation this may result in different queue family indices for graphics and computes,
-    // requiring proper synchronization (see the memory and pipeline barriers)
-    vkGetDeviceQueue(m_logicalDevice, m_compute.queueFamilyIndex, 0, &m_compute.queue);
-
-    // Create compute pipeline
-    // Compute pipelines are created separate from graphics pipelines even if they use the same queue (family index)
-    VkDescriptorSetLayoutBinding particleSSBOBinding{};
-    particleSSBOBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    particleSSBOBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    particleSSBOBinding.binding = 0;
-    particleSSBOBinding.descriptorCount = 1;
-
-    VkDescriptorSetLayoutBinding particleUBOBinding{};
-    particleUBOBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    particleUBOBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    particleUBOBinding.binding = 1;
-    particleUBOBinding.descriptorCount = 1;
+    // Vulkan only guarantees compute support on some family with graphics, without it every particle is drawn
+    m_culling.supported = (m_vulkanDevice->queueFamilyProperties[m_graphics.queueFamilyIndex].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+    if (!m_culling.supported)
+    {
+        m_culling.enabled = false;
+        return;
+    }
 
-    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-        particleSSBOBinding,
-        particleUBOBinding
-    };
+    VkDeviceSize visibleSize = static_cast<VkDeviceSize>(PARTICLE_COUNT) * sizeof(Particle);
+    VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &m_culling.visibleParticles.buffer,
+        &m_culling.visibleParticles.memory,
+        visibleSize));
+    m_culling.visibleParticles.descriptor.buffer = m_culling.visibleParticles.buffer;
+    m_culling.visibleParticles.descriptor.offset = 0;
+    m_culling.visibleParticles.descriptor.range = visibleSize;
+
+    // Device local where the host can map it, the global atomics of the pass stay on the GPU side of the bus
+    VkMemoryPropertyFlags drawCommandMemoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    VkBool32 drawCommandMemoryFound = VK_FALSE;
+    m_vulkanDevice->GetMemoryType(~0u, drawCommandMemoryFlags, &drawCommandMemoryFound);
+    if (!drawCommandMemoryFound)
+    {
+        drawCommandMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+    VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        drawCommandMemoryFlags,
+        &m_culling.drawCommand.buffer,
+        &m_culling.drawCommand.memory,
+        sizeof(VkDrawIndirectCommand)));
+    VK_CHECK_RESULT(vkMapMemory(m_logicalDevice, m_culling.drawCommand.memory, 0, VK_WHOLE_SIZE, 0, &m_culling.drawCommand.mapped));
+    memset(m_culling.drawCommand.mapped, 0, sizeof(VkDrawIndirectCommand));
+    m_culling.drawCommand.descriptor.buffer = m_culling.drawCommand.buffer;
+    m_culling.drawCommand.descriptor.offset = 0;
+    m_culling.drawCommand.descriptor.range = sizeof(VkDrawIndirectCommand);
+
+    // Bindings 0 to 2: particles, visible particles, draw command, binding 3: graphics UBO, binding 4: previous particles
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+    for (uint32_t binding = 0; binding < 5; ++binding)
+    {
+        VkDescriptorSetLayoutBinding layoutBinding{};
+        layoutBinding.descriptorType = binding == 3 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        layoutBinding.binding = binding;
+        layoutBinding.descriptorCount = 1;
+        setLayoutBindings.push_back(layoutBinding);
+    }
 
     VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
     descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     descriptorSetLayoutCreateInfo.pBindings = setLayoutBindings.data();
     descriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-    descriptorSetLayoutCreateInfo.pNext = nullptr;
-    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_logicalDevice, &descriptorSetLayoutCreateInfo, nullptr, &m_compute.descriptorSetLayout));
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_logicalDevice, &descriptorSetLayoutCreateInfo, nullptr, &m_culling.descriptorSetLayout));
 
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
     pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutCreateInfo.setLayoutCount = 1;
-    pipelineLayoutCreateInfo.pNext = nullptr;
-    pipelineLayoutCreateInfo.pSetLayouts = &m_compute.descriptorSetLayout;
-    VK_CHECK_RESULT(vkCreatePipelineLayout(m_logicalDevice, &pipelineLayoutCreateInfo, nullptr, &m_compute.pipelineLayout));
+    pipelineLayoutCreateInfo.pSetLayouts = &m_culling.descriptorSetLayout;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(m_logicalDevice, &pipelineLayoutCreateInfo, nullptr, &m_culling.pipelineLayout));
 
-
-    // Write descriptor sets
     VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{};
     descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     descriptorSetAllocateInfo.descriptorPool = m_descriptorPool;
-    descriptorSetAllocateInfo.pSetLayouts = &m_compute.descriptorSetLayout;
+    descriptorSetAllocateInfo.pSetLayouts = &m_culling.descriptorSetLayout;
     descriptorSetAllocateInfo.descriptorSetCount = 1;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(m_logicalDevice, &descriptorSetAllocateInfo, &m_culling.descriptorSet));
 
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(m_logicalDevice, &descriptorSetAllocateInfo, &m_compute.descriptorSet));
-
-    VkWriteDescriptorSet particleSSBODescriptorSet{};
-    particleSSBODescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    particleSSBODescriptorSet.dstSet = m_compute.descriptorSet;
-    particleSSBODescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    particleSSBODescriptorSet.dstBinding = 0;
-    particleSSBODescriptorSet.pBufferInfo = &m_compute.storageBuffer.descriptor;
-    particleSSBODescriptorSet.descriptorCount = 1;
+    const std::array<const VkDescriptorBufferInfo*, 5> bufferInfos = {
+        &m_compute.storageBuffer.descriptor, &m_culling.visibleParticles.descriptor, &m_culling.drawCommand.descriptor, &m_graphics.uniformBuffer.descriptor,
+        &m_fixedRate.previousParticles.descriptor
+    };
+    std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+    for (uint32_t binding = 0; binding < bufferInfos.size(); ++binding)
+    {
+        VkWriteDescriptorSet writeDescriptorSet{};
+        writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSet.dstSet = m_culling.descriptorSet;
+        writeDescriptorSet.descriptorType = setLayoutBindings[binding].descriptorType;
+        writeDescriptorSet.dstBinding = binding;
+        writeDescriptorSet.pBufferInfo = bufferInfos[binding];
+        writeDescriptorSet.descriptorCount = 1;
+        writeDescriptorSets.push_back(writeDescriptorSet);
+    }
+    vkUpdateDescriptorSets(m_logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 
-    VkWriteDescriptorSet particleUBODescriptorSet{};
-    particleUBODescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    particleUBODescriptorSet.dstSet = m_compute.descriptorSet;
-    particleUBODescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    particleUBODescriptorSet.dstBinding = 1;
-    particleUBODescriptorSet.pBufferInfo = &m_compute.uniformBuffer.descriptor;
-    particleUBODescriptorSet.descriptorCount = 1;
+    VkComputePipelineCreateInfo pipelineCreateInfo{};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.layout = m_culling.pipelineLayout;
+    pipelineCreateInfo.stage = LoadShader(m_logicalDevice, "../../shaders/particle_cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_culling.pipeline));
+}
 
-    std::vector<VkWriteDescriptorSet> writeDescriptorSets
+void ParticleSimulation::PrepareSplatting()
+{
+    m_splatting.supported = (m_vulkanDevice->queueFamilyProperties[m_graphics.queueFamilyIndex].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+    if (!m_splatting.supported)
     {
-        particleSSBODescriptorSet,
-        particleUBODescriptorSet
-    };
-    vkUpdateDescriptorSets(m_logicalDevice, (uint32_t)writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
+        m_splatting.enabled = false;
+        return;
+    }
 
-    VkComputePipelineCreateInfo computePipelineCreateInfo{};
-    computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-    computePipelineCreateInfo.layout = m_compute.pipelineLayout;
-    computePipelineCreateInfo.flags = 0;
-    computePipelineCreateInfo.stage = LoadShader(m_logicalDevice, "../../shaders/simulation.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
-    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &m_compute.pipeline));
+    // Atomics on R32_UINT storage images are always supported
+    VkImageCreateInfo imageCreateInfo{};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = VK_FORMAT_R32_UINT;
+    imageCreateInfo.extent = { m_width, m_height, 1 };
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 3;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VK_CHECK_RESULT(vkCreateImage(m_logicalDevice, &imageCreateInfo, nullptr, &m_splatting.image));
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(m_logicalDevice, m_splatting.image, &memoryRequirements);
+    VkMemoryAllocateInfo memoryAllocateInfo{};
+    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memoryAllocateInfo.allocationSize = memoryRequirements.size;
+    memoryAllocateInfo.memoryTypeIndex = m_vulkanDevice->GetMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VK_CHECK_RESULT(vkAllocateMemory(m_logicalDevice, &memoryAllocateInfo, nullptr, &m_splatting.memory));
+    VK_CHECK_RESULT(vkBindImageMemory(m_logicalDevice, m_splatting.image, m_splatting.memory, 0));
+
+    VkImageViewCreateInfo viewCreateInfo{};
+    viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    viewCreateInfo.format = VK_FORMAT_R32_UINT;
+    viewCreateInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 3 };
+    viewCreateInfo.image = m_splatting.image;
+    VK_CHECK_RESULT(vkCreateImageView(m_logicalDevice, &viewCreateInfo, nullptr, &m_splatting.view));
+
+    // The image stays in the general layout, cleared, written and read in place every frame
+    VkCommandBuffer layoutCmd = m_vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    Utils::SetImageLayout(layoutCmd, m_splatting.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, viewCreateInfo.subresourceRange);
+    m_vulkanDevice->FlushCommandBuffer(layoutCmd, m_graphicsQueue, true);
+
+    m_splatting.descriptor.sampler = VK_NULL_HANDLE;
+    m_splatting.descriptor.imageView = m_splatting.view;
+    m_splatting.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    // Bindings 0 to 2: particles, graphics UBO, species table, binding 3: accumulation image, also read by the resolve,
+    // binding 4: previous particles
+    const std::array<VkDescriptorType, 5> descriptorTypes = {
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+    };
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+    for (uint32_t binding = 0; binding < descriptorTypes.size(); ++binding)
+    {
+        VkDescriptorSetLayoutBinding layoutBinding{};
+        layoutBinding.descriptorType = descriptorTypes[binding];
+        layoutBinding.stageFlags = binding == 3 ? VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT : VK_SHADER_STAGE_COMPUTE_BIT;
+        layoutBinding.binding = binding;
+        layoutBinding.descriptorCount = 1;
+        setLayoutBindings.push_back(layoutBinding);
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.pBindings = setLayoutBindings.data();
+    descriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_logicalDevice, &descriptorSetLayoutCreateInfo, nullptr, &m_splatting.descriptorSetLayout));
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &m_splatting.descriptorSetLayout;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(m_logicalDevice, &pipelineLayoutCreateInfo, nullptr, &m_splatting.pipelineLayout));
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = m_descriptorPool;
+    descriptorSetAllocateInfo.pSetLayouts = &m_splatting.descriptorSetLayout;
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(m_logicalDevice, &descriptorSetAllocateInfo, &m_splatting.descriptorSet));
+
+    const std::array<const VkDescriptorBufferInfo*, 5> bufferInfos = {
+        &m_compute.storageBuffer.descriptor, &m_graphics.uniformBuffer.descriptor, &m_species.uniformBuffer.descriptor, nullptr,
+        &m_fixedRate.previousParticles.descriptor
+    };
+    std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+    for (uint32_t binding = 0; binding < descriptorTypes.size(); ++binding)
+    {
+        VkWriteDescriptorSet writeDescriptorSet{};
+        writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSet.dstSet = m_splatting.descriptorSet;
+        writeDescriptorSet.descriptorType = descriptorTypes[binding];
+        writeDescriptorSet.dstBinding = binding;
+        if (bufferInfos[binding])
+        {
+            writeDescriptorSet.pBufferInfo = bufferInfos[binding];
+        }
+        else
+        {
+            writeDescriptorSet.pImageInfo = &m_splatting.descriptor;
+        }
+        writeDescriptorSet.descriptorCount = 1;
+        writeDescriptorSets.push_back(writeDescriptorSet);
+    }
+    vkUpdateDescriptorSets(m_logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+    VkComputePipelineCreateInfo computePipelineCreateInfo{};
+    computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    computePipelineCreateInfo.layout = m_splatting.pipelineLayout;
+    computePipelineCreateInfo.stage = LoadShader(m_logicalDevice, "../../shaders/particle_splat.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &m_splatting.splatPipeline));
+
+    // Resolve: fullscreen triangle added to the frame like the sprites
+    VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo{};
+    vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo{};
+    inputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo{};
+    rasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizationStateCreateInfo.cullMode = VK_CULL_MODE_NONE;
+    rasterizationStateCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizationStateCreateInfo.lineWidth = 1.0f;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachmentState{};
+    colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachmentState.blendEnable = VK_TRUE;
+    colorBlendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo{};
+    colorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendStateCreateInfo.attachmentCount = 1;
+    colorBlendStateCreateInfo.pAttachments = &colorBlendAttachmentState;
+
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo{};
+    viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportStateCreateInfo.viewportCount = 1;
+    viewportStateCreateInfo.scissorCount = 1;
+
+    VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo{};
+    multisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    std::vector<VkDynamicState> dynamicStateEnables = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.pDynamicStates = dynamicStateEnables.data();
+    dynamicState.dynamicStateCount = (uint32_t)dynamicStateEnables.size();
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
+    shaderStages[0] = LoadShader(m_logicalDevice, "../../shaders/particle_resolve.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+    shaderStages[1] = LoadShader(m_logicalDevice, "../../shaders/particle_resolve.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.layout = m_splatting.pipelineLayout;
+    pipelineCreateInfo.renderPass = m_renderPass;
+    pipelineCreateInfo.basePipelineIndex = -1;
+    pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineCreateInfo.pVertexInputState = &vertexInputStateCreateInfo;
+    pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStateCreateInfo;
+    pipelineCreateInfo.pRasterizationState = &rasterizationStateCreateInfo;
+    pipelineCreateInfo.pColorBlendState = &colorBlendStateCreateInfo;
+    pipelineCreateInfo.pMultisampleState = &multisampleStateCreateInfo;
+    pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+    pipelineCreateInfo.pDepthStencilState = nullptr;
+    pipelineCreateInfo.pDynamicState = &dynamicState;
+    pipelineCreateInfo.stageCount = (uint32_t)shaderStages.size();
+    pipelineCreateInfo.pStages = shaderStages.data();
+    VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_splatting.resolvePipeline));
+}
+
+void ParticleSimulation::PrepareDepthSort()
+{
+    // The sort runs on the graphics queue like the culling, and needs subgroup operations
+    m_depthSort.supported = (m_vulkanDevice->queueFamilyProperties[m_graphics.queueFamilyIndex].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0
+        && GpuRadixSort::IsSupported(m_vulkanDevice);
+    if (!m_depthSort.supported)
+    {
+        m_depthSort.enabled = false;
+        return;
+    }
+
+    VkDeviceSize size = static_cast<VkDeviceSize>(PARTICLE_COUNT) * sizeof(uint32_t);
+    VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &m_depthSort.keys.buffer,
+        &m_depthSort.keys.memory,
+        size));
+    VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        &m_depthSort.indices.buffer,
+        &m_depthSort.indices.memory,
+        size));
+    for (BufferWrapper* buffer : { &m_depthSort.keys, &m_depthSort.indices }) {
+        buffer->descriptor.buffer = buffer->buffer;
+        buffer->descriptor.offset = 0;
+        buffer->descriptor.range = size;
+    }
+
+    m_depthSort.sort.Prepare(m_vulkanDevice, PARTICLE_COUNT, m_depthSort.keys.buffer, m_depthSort.indices.buffer);
+
+    // Bindings 0 to 2: particles, keys, indices, binding 3: graphics UBO, binding 4: previous particles
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+    for (uint32_t binding = 0; binding < 5; ++binding)
+    {
+        VkDescriptorSetLayoutBinding layoutBinding{};
+        layoutBinding.descriptorType = binding == 3 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        layoutBinding.binding = binding;
+        layoutBinding.descriptorCount = 1;
+        setLayoutBindings.push_back(layoutBinding);
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.pBindings = setLayoutBindings.data();
+    descriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_logicalDevice, &descriptorSetLayoutCreateInfo, nullptr, &m_depthSort.descriptorSetLayout));
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &m_depthSort.descriptorSetLayout;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(m_logicalDevice, &pipelineLayoutCreateInfo, nullptr, &m_depthSort.pipelineLayout));
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = m_descriptorPool;
+    descriptorSetAllocateInfo.pSetLayouts = &m_depthSort.descriptorSetLayout;
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(m_logicalDevice, &descriptorSetAllocateInfo, &m_depthSort.descriptorSet));
+
+    const std::array<const VkDescriptorBufferInfo*, 5> bufferInfos = {
+        &m_compute.storageBuffer.descriptor, &m_depthSort.keys.descriptor, &m_depthSort.indices.descriptor, &m_graphics.uniformBuffer.descriptor,
+        &m_fixedRate.previousParticles.descriptor
+    };
+    std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+    for (uint32_t binding = 0; binding < bufferInfos.size(); ++binding)
+    {
+        VkWriteDescriptorSet writeDescriptorSet{};
+        writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSet.dstSet = m_depthSort.descriptorSet;
+        writeDescriptorSet.descriptorType = setLayoutBindings[binding].descriptorType;
+        writeDescriptorSet.dstBinding = binding;
+        writeDescriptorSet.pBufferInfo = bufferInfos[binding];
+        writeDescriptorSet.descriptorCount = 1;
+        writeDescriptorSets.push_back(writeDescriptorSet);
+    }
+    vkUpdateDescriptorSets(m_logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+    VkComputePipelineCreateInfo pipelineCreateInfo{};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.layout = m_depthSort.pipelineLayout;
+    pipelineCreateInfo.stage = LoadShader(m_logicalDevice, "../../shaders/particle_depth_keys.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_depthSort.keyPipeline));
+}
+
+void ParticleSimulation::PrepareTrails()
+{
+    // Bindings 0 to 2: particles, previous particles, trail history, binding 3: graphics UBO, binding 4: species table
+    const std::array<VkDescriptorType, 5> descriptorTypes = {
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+    };
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+    for (uint32_t binding = 0; binding < descriptorTypes.size(); ++binding)
+    {
+        VkDescriptorSetLayoutBinding layoutBinding{};
+        layoutBinding.descriptorType = descriptorTypes[binding];
+        layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        layoutBinding.binding = binding;
+        layoutBinding.descriptorCount = 1;
+        setLayoutBindings.push_back(layoutBinding);
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.pBindings = setLayoutBindings.data();
+    descriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_logicalDevice, &descriptorSetLayoutCreateInfo, nullptr, &m_trails.descriptorSetLayout));
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &m_trails.descriptorSetLayout;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(m_logicalDevice, &pipelineLayoutCreateInfo, nullptr, &m_trails.pipelineLayout));
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = m_descriptorPool;
+    descriptorSetAllocateInfo.pSetLayouts = &m_trails.descriptorSetLayout;
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(m_logicalDevice, &descriptorSetAllocateInfo, &m_trails.descriptorSet));
+
+    const std::array<const VkDescriptorBufferInfo*, 5> bufferInfos = {
+        &m_compute.storageBuffer.descriptor, &m_fixedRate.previousParticles.descriptor, &m_trails.history.descriptor, &m_graphics.uniformBuffer.descriptor,
+        &m_species.uniformBuffer.descriptor
+    };
+    std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+    for (uint32_t binding = 0; binding < bufferInfos.size(); ++binding)
+    {
+        VkWriteDescriptorSet writeDescriptorSet{};
+        writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSet.dstSet = m_trails.descriptorSet;
+        writeDescriptorSet.descriptorType = descriptorTypes[binding];
+        writeDescriptorSet.dstBinding = binding;
+        writeDescriptorSet.pBufferInfo = bufferInfos[binding];
+        writeDescriptorSet.descriptorCount = 1;
+        writeDescriptorSets.push_back(writeDescriptorSet);
+    }
+    vkUpdateDescriptorSets(m_logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+    // One line strip per particle instance, the vertex shader reads the positions from the history, no vertex input
+    VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo{};
+    vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo{};
+    inputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_LINE_STRIP;
+    inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo{};
+    rasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizationStateCreateInfo.cullMode = VK_CULL_MODE_NONE;
+    rasterizationStateCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizationStateCreateInfo.lineWidth = 1.0f;
+
+    // Additive like the sprites, the trails need no sort either
+    VkPipelineColorBlendAttachmentState colorBlendAttachmentState{};
+    colorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachmentState.blendEnable = VK_TRUE;
+    colorBlendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo{};
+    colorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendStateCreateInfo.attachmentCount = 1;
+    colorBlendStateCreateInfo.pAttachments = &colorBlendAttachmentState;
+
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo{};
+    viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportStateCreateInfo.viewportCount = 1;
+    viewportStateCreateInfo.scissorCount = 1;
+
+    VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo{};
+    multisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    std::vector<VkDynamicState> dynamicStateEnables = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.pDynamicStates = dynamicStateEnables.data();
+    dynamicState.dynamicStateCount = (uint32_t)dynamicStateEnables.size();
+
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
+    shaderStages[0] = LoadShader(m_logicalDevice, "../../shaders/trail.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+    shaderStages[1] = LoadShader(m_logicalDevice, "../../shaders/trail.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.layout = m_trails.pipelineLayout;
+    pipelineCreateInfo.renderPass = m_renderPass;
+    pipelineCreateInfo.basePipelineIndex = -1;
+    pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineCreateInfo.pVertexInputState = &vertexInputStateCreateInfo;
+    pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStateCreateInfo;
+    pipelineCreateInfo.pRasterizationState = &rasterizationStateCreateInfo;
+    pipelineCreateInfo.pColorBlendState = &colorBlendStateCreateInfo;
+    pipelineCreateInfo.pMultisampleState = &multisampleStateCreateInfo;
+    pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+    pipelineCreateInfo.pDepthStencilState = nullptr;
+    pipelineCreateInfo.pDynamicState = &dynamicState;
+    pipelineCreateInfo.stageCount = (uint32_t)shaderStages.size();
+    pipelineCreateInfo.pStages = shaderStages.data();
+    VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &m_trails.pipeline));
+}
+
+void ParticleSimulation::PrepareCompute()
+{
+    // Create a compute capable device queue
+    // The VulkanDevice::createLogicalDevice functions finds a compute capable queue and prefers queue families that only support compute
+    // Depending on the implementation this may result in different queue family indices for graphics and computes,
+    // requiring proper synchronization (see the memory and pipeline barriers)
+    vkGetDeviceQueue(m_logicalDevice, m_compute.queueFamilyIndex, 0, &m_compute.queue);
+
+    // Create compute pipeline
+    // Compute pipelines are created separate from graphics pipelines even if they use the same queue (family index)
+    VkDescriptorSetLayoutBinding particleSSBOBinding{};
+    particleSSBOBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    particleSSBOBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    particleSSBOBinding.binding = 0;
+    particleSSBOBinding.descriptorCount = 1;
+
+    VkDescriptorSetLayoutBinding particleUBOBinding{};
+    particleUBOBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    particleUBOBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    particleUBOBinding.binding = 1;
+    particleUBOBinding.descriptorCount = 1;
+
+    VkDescriptorSetLayoutBinding sdfSamplerBinding{};
+    sdfSamplerBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    sdfSamplerBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    sdfSamplerBinding.binding = 2;
+    sdfSamplerBinding.descriptorCount = 1;
+
+    VkDescriptorSetLayoutBinding fieldSamplersBinding{};
+    fieldSamplersBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    fieldSamplersBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    fieldSamplersBinding.binding = 3;
+    fieldSamplersBinding.descriptorCount = FIELD_SLOT_COUNT;
+
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+        particleSSBOBinding,
+        particleUBOBinding,
+        sdfSamplerBinding,
+        fieldSamplersBinding
+    };
+
+    // Contact grid buffers, bindings 4 to 9 (see simulation_common.glsl and the grid shaders)
+    const std::array<BufferWrapper*, 6> gridBuffers = {
+        &m_grid.cellCounts, &m_grid.cellStarts, &m_grid.blockSums, &m_grid.particleCells, &m_grid.sortedIndices, &m_grid.contactAccelerations
+    };
+    for (uint32_t i = 0; i < gridBuffers.size(); ++i)
+    {
+        VkDescriptorSetLayoutBinding gridBufferBinding{};
+        gridBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        gridBufferBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        gridBufferBinding.binding = 4 + i;
+        gridBufferBinding.descriptorCount = 1;
+        setLayoutBindings.push_back(gridBufferBinding);
+    }
+
+    VkDescriptorSetLayoutBinding speciesBinding{};
+    speciesBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    speciesBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    speciesBinding.binding = 10;
+    speciesBinding.descriptorCount = 1;
+    setLayoutBindings.push_back(speciesBinding);
+
+    VkDescriptorSetLayoutBinding checksumBinding{};
+    checksumBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    checksumBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    checksumBinding.binding = 11;
+    checksumBinding.descriptorCount = 1;
+    setLayoutBindings.push_back(checksumBinding);
+
+    // Block timestep level dispatches and particle lists, bindings 12 and 13
+    for (uint32_t binding : { 12u, 13u })
+    {
+        VkDescriptorSetLayoutBinding blockBufferBinding{};
+        blockBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        blockBufferBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        blockBufferBinding.binding = binding;
+        blockBufferBinding.descriptorCount = 1;
+        setLayoutBindings.push_back(blockBufferBinding);
+    }
+
+    VkDescriptorSetLayoutBinding trailHistoryBinding{};
+    trailHistoryBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    trailHistoryBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    trailHistoryBinding.binding = 14;
+    trailHistoryBinding.descriptorCount = 1;
+    setLayoutBindings.push_back(trailHistoryBinding);
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.pBindings = setLayoutBindings.data();
+    descriptorSetLayoutCreateInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+    descriptorSetLayoutCreateInfo.pNext = nullptr;
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(m_logicalDevice, &descriptorSetLayoutCreateInfo, nullptr, &m_compute.descriptorSetLayout));
+
+    // Level integrated by a block timestep dispatch
+    VkPushConstantRange blockLevelRange{};
+    blockLevelRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    blockLevelRange.offset = 0;
+    blockLevelRange.size = sizeof(uint32_t);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pNext = nullptr;
+    pipelineLayoutCreateInfo.pSetLayouts = &m_compute.descriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &blockLevelRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(m_logicalDevice, &pipelineLayoutCreateInfo, nullptr, &m_compute.pipelineLayout));
+
+
+    // Write descriptor sets
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = m_descriptorPool;
+    descriptorSetAllocateInfo.pSetLayouts = &m_compute.descriptorSetLayout;
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(m_logicalDevice, &descriptorSetAllocateInfo, &m_compute.descriptorSet));
+
+    VkWriteDescriptorSet particleSSBODescriptorSet{};
+    particleSSBODescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    particleSSBODescriptorSet.dstSet = m_compute.descriptorSet;
+    particleSSBODescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    particleSSBODescriptorSet.dstBinding = 0;
+    particleSSBODescriptorSet.pBufferInfo = &m_compute.storageBuffer.descriptor;
+    particleSSBODescriptorSet.descriptorCount = 1;
+
+    VkWriteDescriptorSet particleUBODescriptorSet{};
+    particleUBODescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    particleUBODescriptorSet.dstSet = m_compute.descriptorSet;
+    particleUBODescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    particleUBODescriptorSet.dstBinding = 1;
+    particleUBODescriptorSet.pBufferInfo = &m_compute.uniformBuffer.descriptor;
+    particleUBODescriptorSet.descriptorCount = 1;
+
+    VkWriteDescriptorSet sdfSamplerDescriptorSet{};
+    sdfSamplerDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    sdfSamplerDescriptorSet.dstSet = m_compute.descriptorSet;
+    sdfSamplerDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    sdfSamplerDescriptorSet.dstBinding = 2;
+    sdfSamplerDescriptorSet.pImageInfo = &m_textures.sdf.m_descriptor;
+    sdfSamplerDescriptorSet.descriptorCount = 1;
+
+    std::array<VkDescriptorImageInfo, FIELD_SLOT_COUNT> fieldDescriptors;
+    for (uint32_t slot = 0; slot < FIELD_SLOT_COUNT; ++slot)
+    {
+        fieldDescriptors[slot] = m_textures.field[slot].m_descriptor;
+    }
+
+    VkWriteDescriptorSet fieldSamplersDescriptorSet{};
+    fieldSamplersDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    fieldSamplersDescriptorSet.dstSet = m_compute.descriptorSet;
+    fieldSamplersDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    fieldSamplersDescriptorSet.dstBinding = 3;
+    fieldSamplersDescriptorSet.pImageInfo = fieldDescriptors.data();
+    fieldSamplersDescriptorSet.descriptorCount = FIELD_SLOT_COUNT;
+
+    std::vector<VkWriteDescriptorSet> writeDescriptorSets
+    {
+        particleSSBODescriptorSet,
+        particleUBODescriptorSet,
+        sdfSamplerDescriptorSet,
+        fieldSamplersDescriptorSet
+    };
+    for (uint32_t i = 0; i < gridBuffers.size(); ++i)
+    {
+        VkWriteDescriptorSet gridBufferDescriptorSet{};
+        gridBufferDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        gridBufferDescriptorSet.dstSet = m_compute.descriptorSet;
+        gridBufferDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        gridBufferDescriptorSet.dstBinding = 4 + i;
+        gridBufferDescriptorSet.pBufferInfo = &gridBuffers[i]->descriptor;
+        gridBufferDescriptorSet.descriptorCount = 1;
+        writeDescriptorSets.push_back(gridBufferDescriptorSet);
+    }
+
+    VkWriteDescriptorSet speciesDescriptorSet{};
+    speciesDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    speciesDescriptorSet.dstSet = m_compute.descriptorSet;
+    speciesDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    speciesDescriptorSet.dstBinding = 10;
+    speciesDescriptorSet.pBufferInfo = &m_species.uniformBuffer.descriptor;
+    speciesDescriptorSet.descriptorCount = 1;
+    writeDescriptorSets.push_back(speciesDescriptorSet);
+
+    VkWriteDescriptorSet checksumDescriptorSet{};
+    checksumDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    checksumDescriptorSet.dstSet = m_compute.descriptorSet;
+    checksumDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    checksumDescriptorSet.dstBinding = 11;
+    checksumDescriptorSet.pBufferInfo = &m_checksum.buffer.descriptor;
+    checksumDescriptorSet.descriptorCount = 1;
+    writeDescriptorSets.push_back(checksumDescriptorSet);
+
+    VkWriteDescriptorSet levelDispatchesDescriptorSet{};
+    levelDispatchesDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    levelDispatchesDescriptorSet.dstSet = m_compute.descriptorSet;
+    levelDispatchesDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    levelDispatchesDescriptorSet.dstBinding = 12;
+    levelDispatchesDescriptorSet.pBufferInfo = &m_blockTimesteps.levelDispatches.descriptor;
+    levelDispatchesDescriptorSet.descriptorCount = 1;
+    writeDescriptorSets.push_back(levelDispatchesDescriptorSet);
+
+    VkWriteDescriptorSet levelIndicesDescriptorSet{};
+    levelIndicesDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    levelIndicesDescriptorSet.dstSet = m_compute.descriptorSet;
+    levelIndicesDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    levelIndicesDescriptorSet.dstBinding = 13;
+    levelIndicesDescriptorSet.pBufferInfo = &m_blockTimesteps.levelIndices.descriptor;
+    levelIndicesDescriptorSet.descriptorCount = 1;
+    writeDescriptorSets.push_back(levelIndicesDescriptorSet);
+
+    VkWriteDescriptorSet trailHistoryDescriptorSet{};
+    trailHistoryDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    trailHistoryDescriptorSet.dstSet = m_compute.descriptorSet;
+    trailHistoryDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    trailHistoryDescriptorSet.dstBinding = 14;
+    trailHistoryDescriptorSet.pBufferInfo = &m_trails.history.descriptor;
+    trailHistoryDescriptorSet.descriptorCount = 1;
+    writeDescriptorSets.push_back(trailHistoryDescriptorSet);
+    vkUpdateDescriptorSets(m_logicalDevice, (uint32_t)writeDescriptorSets.size(), writeDescriptorSets.data(), 0, nullptr);
+
+    // One pipeline per integration scheme, the scheme is baked in through the specialization constant 0
+    // so that the selected integrator does not branch at runtime
+    VkPipelineShaderStageCreateInfo simulationStage = LoadShader(m_logicalDevice, "../../shaders/simulation.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+
+    std::array<uint32_t, INTEGRATOR_COUNT> integrators;
+    std::array<VkSpecializationInfo, INTEGRATOR_COUNT> specializationInfos;
+    std::array<VkComputePipelineCreateInfo, INTEGRATOR_COUNT> computePipelineCreateInfos;
+
+    VkSpecializationMapEntry integratorMapEntry{};
+    integratorMapEntry.constantID = 0;
+    integratorMapEntry.offset = 0;
+    integratorMapEntry.size = sizeof(uint32_t);
+
+    for (uint32_t i = 0; i < INTEGRATOR_COUNT; ++i)
+    {
+        integrators[i] = i;
+
+        specializationInfos[i] = {};
+        specializationInfos[i].mapEntryCount = 1;
+        specializationInfos[i].pMapEntries = &integratorMapEntry;
+        specializationInfos[i].dataSize = sizeof(uint32_t);
+        specializationInfos[i].pData = &integrators[i];
+
+        computePipelineCreateInfos[i] = {};
+        computePipelineCreateInfos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        computePipelineCreateInfos[i].layout = m_compute.pipelineLayout;
+        computePipelineCreateInfos[i].flags = 0;
+        computePipelineCreateInfos[i].stage = simulationStage;
+        computePipelineCreateInfos[i].stage.pSpecializationInfo = &specializationInfos[i];
+    }
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, INTEGRATOR_COUNT, computePipelineCreateInfos.data(), nullptr, m_compute.pipelines.data()));
+
+    // The block timestep binning is the same shader with the pass specialization constant 1 set,
+    // so that it evaluates exactly the accelerations of the integration
+    std::array<VkSpecializationMapEntry, 2> binMapEntries{};
+    binMapEntries[0] = integratorMapEntry;
+    binMapEntries[1].constantID = 1;
+    binMapEntries[1].offset = sizeof(uint32_t);
+    binMapEntries[1].size = sizeof(uint32_t);
+    std::array<uint32_t, 2> binConstants = { INTEGRATOR_SYMPLECTIC_EULER, 1 };
+
+    VkSpecializationInfo binSpecializationInfo{};
+    binSpecializationInfo.mapEntryCount = static_cast<uint32_t>(binMapEntries.size());
+    binSpecializationInfo.pMapEntries = binMapEntries.data();
+    binSpecializationInfo.dataSize = sizeof(binConstants);
+    binSpecializationInfo.pData = binConstants.data();
+
+    VkComputePipelineCreateInfo binPipelineCreateInfo = computePipelineCreateInfos[0];
+    binPipelineCreateInfo.stage.pSpecializationInfo = &binSpecializationInfo;
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &binPipelineCreateInfo, nullptr, &m_blockTimesteps.binPipeline));
+
+    // So is the store of the positions into the trail history, pass 2
+    std::array<uint32_t, 2> trailConstants = { INTEGRATOR_SYMPLECTIC_EULER, 2 };
+    VkSpecializationInfo trailSpecializationInfo = binSpecializationInfo;
+    trailSpecializationInfo.pData = trailConstants.data();
+
+    VkComputePipelineCreateInfo trailPipelineCreateInfo = computePipelineCreateInfos[0];
+    trailPipelineCreateInfo.stage.pSpecializationInfo = &trailSpecializationInfo;
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &trailPipelineCreateInfo, nullptr, &m_trails.storePipeline));
+
+    // Contact grid pipelines share the simulation layout
+    VkComputePipelineCreateInfo gridPipelineCreateInfo{};
+    gridPipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    gridPipelineCreateInfo.layout = m_compute.pipelineLayout;
+
+    gridPipelineCreateInfo.stage = LoadShader(m_logicalDevice, "../../shaders/grid_count.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &gridPipelineCreateInfo, nullptr, &m_grid.countPipeline));
+
+    gridPipelineCreateInfo.stage = LoadShader(m_logicalDevice, "../../shaders/grid_scatter.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &gridPipelineCreateInfo, nullptr, &m_grid.scatterPipeline));
+
+    gridPipelineCreateInfo.stage = LoadShader(m_logicalDevice, "../../shaders/dem_contacts.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &gridPipelineCreateInfo, nullptr, &m_grid.contactsPipeline));
+
+    // The three scan passes are specializations of the same shader
+    VkPipelineShaderStageCreateInfo scanStage = LoadShader(m_logicalDevice, "../../shaders/grid_scan.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    std::array<uint32_t, GRID_SCAN_PASS_COUNT> scanPasses;
+    std::array<VkSpecializationInfo, GRID_SCAN_PASS_COUNT> scanSpecializationInfos;
+    std::array<VkComputePipelineCreateInfo, GRID_SCAN_PASS_COUNT> scanPipelineCreateInfos;
+    for (uint32_t i = 0; i < GRID_SCAN_PASS_COUNT; ++i)
+    {
+        scanPasses[i] = i;
+
+        scanSpecializationInfos[i] = {};
+        scanSpecializationInfos[i].mapEntryCount = 1;
+        scanSpecializationInfos[i].pMapEntries = &integratorMapEntry;
+        scanSpecializationInfos[i].dataSize = sizeof(uint32_t);
+        scanSpecializationInfos[i].pData = &scanPasses[i];
+
+        scanPipelineCreateInfos[i] = gridPipelineCreateInfo;
+        scanPipelineCreateInfos[i].stage = scanStage;
+        scanPipelineCreateInfos[i].stage.pSpecializationInfo = &scanSpecializationInfos[i];
+    }
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, GRID_SCAN_PASS_COUNT, scanPipelineCreateInfos.data(), nullptr, m_grid.scanPipelines.data()));
+
+    gridPipelineCreateInfo.stage = LoadShader(m_logicalDevice, "../../shaders/checksum.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &gridPipelineCreateInfo, nullptr, &m_checksum.pipeline));
+
+    gridPipelineCreateInfo.stage = LoadShader(m_logicalDevice, "../../shaders/block_dispatch.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
+    VK_CHECK_RESULT(vkCreateComputePipelines(m_logicalDevice, VK_NULL_HANDLE, 1, &gridPipelineCreateInfo, nullptr, &m_blockTimesteps.dispatchPipeline));
 
     VkCommandPoolCreateInfo computeCommandPoolCreateInfo{};
     computeCommandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
@@ -868,200 +2181,1412 @@ void ParticleSimulation::PrepareCompute()
     computeCommandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     VK_CHECK_RESULT(vkCreateCommandPool(m_logicalDevice, &computeCommandPoolCreateInfo, nullptr, &m_compute.commandPool));
 
-    // Create a command buffer for compute operations
-    m_compute.commandBuffer = m_vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_compute.commandPool);
+    // Create a command buffer for compute operations
+    m_compute.commandBuffer = m_vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_compute.commandPool);
+
+    // Semaphore for compute & graphics sync
+    VkSemaphoreCreateInfo semaphoreCreateInfo{};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VK_CHECK_RESULT(vkCreateSemaphore(m_logicalDevice, &semaphoreCreateInfo, nullptr, &m_compute.semaphore));
+
+    // Signaled so that the first frame does not wait
+    VkFenceCreateInfo fenceCreateInfo{};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    VK_CHECK_RESULT(vkCreateFence(m_logicalDevice, &fenceCreateInfo, nullptr, &m_compute.fence));
+
+    // Timestamps of the GPU side of the hybrid split, the split stays manual when the compute queue has none
+    uint32_t timestampValidBits = m_vulkanDevice->queueFamilyProperties[m_compute.queueFamilyIndex].timestampValidBits;
+    if (m_hybrid.enabled && timestampValidBits > 0)
+    {
+        VkQueryPoolCreateInfo queryPoolCreateInfo{};
+        queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolCreateInfo.queryCount = 2;
+        VK_CHECK_RESULT(vkCreateQueryPool(m_logicalDevice, &queryPoolCreateInfo, nullptr, &m_hybrid.queryPool));
+        m_hybrid.timestampMask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+    }
+    else
+    {
+        m_hybrid.adaptive = false;
+    }
+
+    PrepareFieldStreaming();
+
+    // The compute command buffer is recorded every frame in Draw()
+}
+
+void ParticleSimulation::BuildCommandBuffers()
+{
+    for (int32_t i = 0; i < m_drawCmdBuffers.size(); ++i)
+    {
+        // Compute passes ahead of the render pass
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+
+        VkCommandBufferBeginInfo cmdBufInfo{};
+        cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
+
+        VkCommandBuffer prePassCmdBuffer = m_graphics.prePassCmdBuffers[i];
+        VK_CHECK_RESULT(vkBeginCommandBuffer(prePassCmdBuffer, &cmdBufInfo));
+        if (m_splatting.enabled)
+        {
+            RecordSplatting(prePassCmdBuffer);
+        }
+        else if (m_depthSort.enabled)
+        {
+            RecordDepthSort(prePassCmdBuffer);
+        }
+        else if (m_culling.enabled)
+        {
+            RecordCulling(prePassCmdBuffer);
+        }
+        VK_CHECK_RESULT(vkEndCommandBuffer(prePassCmdBuffer));
+
+        // Draws of the render pass, the overlay excepted
+        inheritanceInfo.renderPass = m_renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = m_frameBuffers[i];
+        cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+
+        VkCommandBuffer sceneCmdBuffer = m_graphics.sceneCmdBuffers[i];
+        VK_CHECK_RESULT(vkBeginCommandBuffer(sceneCmdBuffer, &cmdBufInfo));
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float)m_width;
+        viewport.height = (float)m_height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(sceneCmdBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.extent.width = m_width;
+        scissor.extent.height = m_height;
+        scissor.offset.x = 0;
+        scissor.offset.y = 0;
+
+        vkCmdSetScissor(sceneCmdBuffer, 0, 1, &scissor);
+
+        VkDeviceSize offsets[1] = { 0 };
+        // Under the particles, whichever way they are drawn
+        if (m_trails.enabled)
+        {
+            vkCmdBindPipeline(sceneCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_trails.pipeline);
+            vkCmdBindDescriptorSets(sceneCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_trails.pipelineLayout, 0, 1, &m_trails.descriptorSet, 0, nullptr);
+            vkCmdDraw(sceneCmdBuffer, TRAIL_LENGTH + 1, PARTICLE_COUNT, 0, 0);
+        }
+
+        if (!m_splatting.enabled)
+        {
+            VkPipeline particlePipeline = m_depthSort.enabled ? m_graphics.sortedParticlePipeline : m_graphics.particle.pipeline;
+            vkCmdBindPipeline(sceneCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, particlePipeline);
+            vkCmdBindDescriptorSets(sceneCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics.particle.pipelineLayout, 0, 1, &m_graphics.particle.descriptorSet, 0, nullptr);
+            if (m_sprites.statisticsPool)
+            {
+                vkCmdBeginQuery(sceneCmdBuffer, m_sprites.statisticsPool, i, 0);
+            }
+            // The culled copies are interpolated already, particle.vert ignores the previous positions when drawing them
+            vkCmdBindVertexBuffers(sceneCmdBuffer, PREVIOUS_VERTEX_BUFFER_BIND_ID, 1, &m_fixedRate.previousParticles.buffer, offsets);
+            if (m_depthSort.enabled)
+            {
+                vkCmdBindVertexBuffers(sceneCmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &m_compute.storageBuffer.buffer, offsets);
+                vkCmdBindIndexBuffer(sceneCmdBuffer, m_depthSort.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+                vkCmdDrawIndexed(sceneCmdBuffer, PARTICLE_COUNT, 1, 0, 0, 0);
+            }
+            else if (m_culling.enabled)
+            {
+                vkCmdBindVertexBuffers(sceneCmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &m_culling.visibleParticles.buffer, offsets);
+                vkCmdDrawIndirect(sceneCmdBuffer, m_culling.drawCommand.buffer, 0, 1, sizeof(VkDrawIndirectCommand));
+            }
+            else
+            {
+                vkCmdBindVertexBuffers(sceneCmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &m_compute.storageBuffer.buffer, offsets);
+                vkCmdDraw(sceneCmdBuffer, PARTICLE_COUNT, 1, 0, 0);
+            }
+            if (m_sprites.statisticsPool)
+            {
+                vkCmdEndQuery(sceneCmdBuffer, m_sprites.statisticsPool, i);
+            }
+        }
+
+        vkCmdBindPipeline(sceneCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics.cube.pipeline);
+        vkCmdBindDescriptorSets(sceneCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics.cube.pipelineLayout, 0, 1, &m_graphics.cube.descriptorSet, 0, nullptr);
+        vkCmdBindVertexBuffers(sceneCmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &m_graphics.cubeVertexBuffer.buffer, offsets);
+        vkCmdDraw(sceneCmdBuffer, 21, 1, 0, 0); // 8 Vertices for a cube
+
+        // The splatted particles are added over the cube, the sums do not depend on the draw order either
+        if (m_splatting.enabled)
+        {
+            vkCmdBindPipeline(sceneCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_splatting.resolvePipeline);
+            vkCmdBindDescriptorSets(sceneCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_splatting.pipelineLayout, 0, 1, &m_splatting.descriptorSet, 0, nullptr);
+            vkCmdDraw(sceneCmdBuffer, 3, 1, 0, 0);
+        }
+
+        VK_CHECK_RESULT(vkEndCommandBuffer(sceneCmdBuffer));
+    }
+}
+
+void ParticleSimulation::RecordDrawCommandBuffer()
+{
+    // Recorded every frame, it only executes the secondary command buffers of the frame buffer and the overlay
+    uint32_t i = m_currentBuffer;
+
+    VkCommandBufferBeginInfo cmdBufInfo{};
+    cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkClearValue clearValues = { {m_defaultClearColor} };
+
+    VkRenderPassBeginInfo renderPassBeginInfo{};
+    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassBeginInfo.renderPass = m_renderPass;
+    renderPassBeginInfo.renderArea.offset.x = 0;
+    renderPassBeginInfo.renderArea.offset.y = 0;
+    renderPassBeginInfo.renderArea.extent.width = m_width;
+    renderPassBeginInfo.renderArea.extent.height = m_height;
+    renderPassBeginInfo.clearValueCount = 1;
+    renderPassBeginInfo.pClearValues = &clearValues;
+    renderPassBeginInfo.framebuffer = m_frameBuffers[i];
+
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_drawCmdBuffers[i], &cmdBufInfo));
+
+    if (m_sprites.statisticsPool)
+    {
+        vkCmdResetQueryPool(m_drawCmdBuffers[i], m_sprites.statisticsPool, i, 1);
+    }
+
+    // Acquire barrier
+    RecordOwnershipTransfer(m_drawCmdBuffers[i], m_compute.queueFamilyIndex, m_graphics.queueFamilyIndex,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+    vkCmdExecuteCommands(m_drawCmdBuffers[i], 1, &m_graphics.prePassCmdBuffers[i]);
+
+    vkCmdBeginRenderPass(m_drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    std::array<VkCommandBuffer, 2> renderPassCmdBuffers = { m_graphics.sceneCmdBuffers[i], RecordUICommandBuffer(i) };
+    vkCmdExecuteCommands(m_drawCmdBuffers[i], static_cast<uint32_t>(renderPassCmdBuffers.size()), renderPassCmdBuffers.data());
+    vkCmdEndRenderPass(m_drawCmdBuffers[i]);
+
+    // Release barrier
+    RecordOwnershipTransfer(m_drawCmdBuffers[i], m_graphics.queueFamilyIndex, m_compute.queueFamilyIndex,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(m_drawCmdBuffers[i]));
+}
+
+void ParticleSimulation::BuildComputeCommandBuffer()
+{
+    VkCommandBufferBeginInfo cmdBufInfo{};
+    cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_compute.commandBuffer, &cmdBufInfo));
+
+    // make sure ssbo ownership is passed to compute queue
+    RecordOwnershipTransfer(m_compute.commandBuffer, m_graphics.queueFamilyIndex, m_compute.queueFamilyIndex,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    // Between two steps of the fixed rate simulation the buffers are only handed back to the graphics queue
+    if (m_fixedRate.step)
+    {
+        RecordSimulationStep(m_compute.commandBuffer);
+    }
+
+    // Add barrier to ensure that compute shader has finished writing to the buffer
+    // Without this the (rendering) vertex shader may display incomplete results (partial data from last frame)
+    // The release also waits for the readback copies and the copy of the previous positions
+    RecordOwnershipTransfer(m_compute.commandBuffer, m_compute.queueFamilyIndex, m_graphics.queueFamilyIndex,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+
+    vkEndCommandBuffer(m_compute.commandBuffer);
+}
+
+void ParticleSimulation::RecordSimulationStep(VkCommandBuffer commandBuffer)
+{
+    if (m_trails.store)
+    {
+        RecordTrailStore(commandBuffer);
+    }
+
+    // Positions before the step for the interpolation, the host backends copy their own particles
+    uint32_t gpuParticleCount = m_cpuBackend ? (m_hybrid.enabled ? m_hybrid.gpuCount : 0) : PARTICLE_COUNT;
+    if (m_fixedRate.enabled && gpuParticleCount > 0)
+    {
+        VkBufferCopy copyRegion{};
+        copyRegion.size = static_cast<VkDeviceSize>(gpuParticleCount) * sizeof(Particle);
+        vkCmdCopyBuffer(commandBuffer, m_compute.storageBuffer.buffer, m_fixedRate.previousParticles.buffer, 1, &copyRegion);
+        PipelineMemoryBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+    }
+
+    // Dispatch the compute job
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compute.pipelines[m_compute.integrator]);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compute.pipelineLayout, 0, 1, &m_compute.descriptorSet, 0, 0);
+    if (m_hybrid.queryPool)
+    {
+        vkCmdResetQueryPool(commandBuffer, m_hybrid.queryPool, 0, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_hybrid.queryPool, 0);
+    }
+
+    // With the hybrid backend ubo.particleCount only covers the GPU slice
+    uint32_t particleGroupCount = (m_compute.ubo.particleCount + SIMULATION_WORKGROUP_SIZE - 1) / SIMULATION_WORKGROUP_SIZE;
+    if (m_cpuBackend && !m_hybrid.enabled)
+    {
+        // The particles have already been integrated on the host, see StepCpuBackend()
+    }
+    else if (m_compute.blockTimesteps)
+    {
+        RecordBlockTimesteps(commandBuffer);
+    }
+    else
+    {
+        for (int32_t substep = 0; substep < m_compute.substeps; ++substep)
+        {
+            if (substep > 0)
+            {
+                // Each substep reads the particles written by the previous one
+                ComputeToComputeBarrier(commandBuffer);
+            }
+
+            if (m_compute.contacts)
+            {
+                // The grid skin keeps the neighbor lists valid for a few substeps
+                if (substep % m_compute.gridRebuildInterval == 0)
+                {
+                    RecordGridBuild(commandBuffer);
+                }
+
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_grid.contactsPipeline);
+                vkCmdDispatch(commandBuffer, (PARTICLE_COUNT + SIMULATION_WORKGROUP_SIZE - 1) / SIMULATION_WORKGROUP_SIZE, 1, 1);
+                ComputeToComputeBarrier(commandBuffer);
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compute.pipelines[m_compute.integrator]);
+            }
+
+            vkCmdDispatch(commandBuffer, particleGroupCount, 1, 1);
+        }
+    }
+
+    if (m_hybrid.enabled)
+    {
+        if (m_hybrid.queryPool)
+        {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_hybrid.queryPool, 1);
+            m_hybrid.timestampsPending = true;
+        }
+
+        // The GPU slice of this frame may be in the host slice of the next one
+        PipelineMemoryBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    }
+
+    m_checksum.step++;
+    m_checksum.pending = m_options.deterministic && m_options.checksumInterval > 0 && m_checksum.step % m_options.checksumInterval == 0;
+    if (m_checksum.pending)
+    {
+        RecordChecksum(commandBuffer);
+    }
+    // The host slice of the hybrid backend is written while the submission runs, StepCpuBackend() copies it
+    m_readback.Record(commandBuffer, m_compute.storageBuffer.buffer, m_compute.submissions + 1, m_checksum.step,
+        m_hybrid.enabled ? m_hybrid.gpuCount : PARTICLE_COUNT);
+}
+
+void ParticleSimulation::RecordOwnershipTransfer(VkCommandBuffer commandBuffer, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+    VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+{
+    // The particle buffers are shared by the graphics and compute queues, release and acquire pairs move them
+    // between the two families when they differ
+    if (srcQueueFamilyIndex == dstQueueFamilyIndex)
+    {
+        return;
+    }
+
+    std::array<VkBufferMemoryBarrier, 3> bufferMemoryBarriers{};
+    std::array<VkBuffer, 3> buffers = { m_compute.storageBuffer.buffer, m_fixedRate.previousParticles.buffer, m_trails.history.buffer };
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+        bufferMemoryBarriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferMemoryBarriers[i].srcAccessMask = srcAccessMask;
+        bufferMemoryBarriers[i].dstAccessMask = dstAccessMask;
+        bufferMemoryBarriers[i].srcQueueFamilyIndex = srcQueueFamilyIndex;
+        bufferMemoryBarriers[i].dstQueueFamilyIndex = dstQueueFamilyIndex;
+        bufferMemoryBarriers[i].buffer = buffers[i];
+        bufferMemoryBarriers[i].offset = 0;
+        bufferMemoryBarriers[i].size = VK_WHOLE_SIZE;
+    }
+
+    vkCmdPipelineBarrier(
+        commandBuffer,
+        srcStageMask,
+        dstStageMask,
+        0,
+        0, nullptr,
+        static_cast<uint32_t>(bufferMemoryBarriers.size()), bufferMemoryBarriers.data(),
+        0, nullptr);
+}
+
+void ParticleSimulation::RecordGridBuild(VkCommandBuffer commandBuffer)
+{
+    uint32_t particleGroupCount = (PARTICLE_COUNT + SIMULATION_WORKGROUP_SIZE - 1) / SIMULATION_WORKGROUP_SIZE;
+    uint32_t scanGroupCount = GRID_CELL_COUNT / GRID_SCAN_BLOCK_SIZE;
+
+    // The previous contacts pass may still read the counts
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdFillBuffer(commandBuffer, m_grid.cellCounts.buffer, 0, VK_WHOLE_SIZE, 0);
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    // Counting sort: count the particles per cell, scan the counts into cell starts, scatter the particle indices
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_grid.countPipeline);
+    vkCmdDispatch(commandBuffer, particleGroupCount, 1, 1);
+    ComputeToComputeBarrier(commandBuffer);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_grid.scanPipelines[0]);
+    vkCmdDispatch(commandBuffer, scanGroupCount, 1, 1);
+    ComputeToComputeBarrier(commandBuffer);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_grid.scanPipelines[1]);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    ComputeToComputeBarrier(commandBuffer);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_grid.scanPipelines[2]);
+    vkCmdDispatch(commandBuffer, scanGroupCount, 1, 1);
+    ComputeToComputeBarrier(commandBuffer);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_grid.scatterPipeline);
+    vkCmdDispatch(commandBuffer, particleGroupCount, 1, 1);
+    ComputeToComputeBarrier(commandBuffer);
+}
+
+void ParticleSimulation::RecordBlockTimesteps(VkCommandBuffer commandBuffer)
+{
+    uint32_t levelCount = static_cast<uint32_t>(m_compute.blockLevelCount);
+
+    // The indirect dispatches of the previous frame may still read the level arguments
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    vkCmdFillBuffer(commandBuffer, m_blockTimesteps.levelDispatches.buffer, 0, VK_WHOLE_SIZE, 0);
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    // Bin the particles into their levels from the start of frame accelerations, then size the level dispatches
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_blockTimesteps.binPipeline);
+    vkCmdDispatch(commandBuffer, (PARTICLE_COUNT + SIMULATION_WORKGROUP_SIZE - 1) / SIMULATION_WORKGROUP_SIZE, 1, 1);
+    ComputeToComputeBarrier(commandBuffer);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_blockTimesteps.dispatchPipeline);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+    // Level l takes 2^l steps per frame: walk the finest steps and integrate every level whose step starts there
+    // Only the particles of the active levels are dispatched, the indirect arguments skip the empty ones
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compute.pipelines[m_compute.integrator]);
+    uint32_t fineStepCount = 1u << (levelCount - 1);
+    for (uint32_t fineStep = 0; fineStep < fineStepCount; ++fineStep)
+    {
+        if (fineStep > 0)
+        {
+            ComputeToComputeBarrier(commandBuffer);
+        }
+
+        for (uint32_t level = 0; level < levelCount; ++level)
+        {
+            if (fineStep % (1u << (levelCount - 1 - level)) != 0)
+            {
+                continue;
+            }
+
+            vkCmdPushConstants(commandBuffer, m_compute.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &level);
+            vkCmdDispatchIndirect(commandBuffer, m_blockTimesteps.levelDispatches.buffer, level * sizeof(BlockLevelDispatch));
+        }
+    }
+}
+
+void ParticleSimulation::RecordCulling(VkCommandBuffer commandBuffer)
+{
+    // The draw of the previous frame is done with the buffers before they are written again
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+    VkDrawIndirectCommand drawCommand = { 0, 1, 0, 0 };
+    vkCmdUpdateBuffer(commandBuffer, m_culling.drawCommand.buffer, 0, sizeof(drawCommand), &drawCommand);
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_culling.pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_culling.pipelineLayout, 0, 1, &m_culling.descriptorSet, 0, nullptr);
+    vkCmdDispatch(commandBuffer, (PARTICLE_COUNT + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+    // The draw reads the vertex count and the compacted particles, the host reads the count for the UI
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+}
+
+void ParticleSimulation::RecordSplatting(VkCommandBuffer commandBuffer)
+{
+    // The resolve of the previous frame is done reading the sums before they are cleared
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+    VkClearColorValue clearValue{};
+    VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 3 };
+    vkCmdClearColorImage(commandBuffer, m_splatting.image, VK_IMAGE_LAYOUT_GENERAL, &clearValue, 1, &subresourceRange);
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_splatting.splatPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_splatting.pipelineLayout, 0, 1, &m_splatting.descriptorSet, 0, nullptr);
+    vkCmdDispatch(commandBuffer, (PARTICLE_COUNT + SPLAT_WORKGROUP_SIZE - 1) / SPLAT_WORKGROUP_SIZE, 1, 1);
+
+    // Read by the resolve in the render pass
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+}
+
+void ParticleSimulation::RecordDepthSort(VkCommandBuffer commandBuffer)
+{
+    // The draw of the previous frame is done with the indices before they are written again
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_depthSort.keyPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_depthSort.pipelineLayout, 0, 1, &m_depthSort.descriptorSet, 0, nullptr);
+    vkCmdDispatch(commandBuffer, (PARTICLE_COUNT + DEPTH_KEYS_WORKGROUP_SIZE - 1) / DEPTH_KEYS_WORKGROUP_SIZE, 1, 1);
+
+    m_depthSort.sort.Record(commandBuffer, PARTICLE_COUNT);
+
+    // Read by the indexed draw in the render pass
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+}
+
+void ParticleSimulation::RecordTrailStore(VkCommandBuffer commandBuffer)
+{
+    // Positions the step starts from, into the slot picked by UpdateTrails(): one slice of the history per step
+    // The host backend has integrated the step already, its trails start from the end of the step instead
+    // The hybrid backend only stores the GPU slice here, see StepCpuBackend()
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_trails.storePipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compute.pipelineLayout, 0, 1, &m_compute.descriptorSet, 0, 0);
+    vkCmdDispatch(commandBuffer, (PARTICLE_COUNT + SIMULATION_WORKGROUP_SIZE - 1) / SIMULATION_WORKGROUP_SIZE, 1, 1);
+
+    // The integration overwrites the particles read by the store
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+}
+
+void ParticleSimulation::RunSortBenchmark()
+{
+    // The window is closed once the benchmark is done, the exit code reports a wrong order
+    glfwSetWindowShouldClose(m_pWindow, GLFW_TRUE);
+
+    uint32_t timestampValidBits = m_vulkanDevice->queueFamilyProperties[m_graphics.queueFamilyIndex].timestampValidBits;
+    if (!m_depthSort.supported || timestampValidBits == 0)
+    {
+        std::cerr << "The radix sort benchmark needs subgroup operations and timestamps on the graphics queue\n";
+        m_exitCode = 1;
+        return;
+    }
+    uint64_t timestampMask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+
+    // Sorted keys and values on the device, the random input and the sorted copy share the staging buffer
+    VkDeviceSize size = static_cast<VkDeviceSize>(SORT_BENCHMARK_MAX_KEYS) * sizeof(uint32_t);
+    BufferWrapper keys, values, staging;
+    for (BufferWrapper* buffer : { &keys, &values }) {
+        VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &buffer->buffer,
+            &buffer->memory,
+            size));
+    }
+    VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &staging.buffer,
+        &staging.memory,
+        2 * size));
+    VK_CHECK_RESULT(vkMapMemory(m_logicalDevice, staging.memory, 0, VK_WHOLE_SIZE, 0, &staging.mapped));
+    uint32_t* stagingKeys = static_cast<uint32_t*>(staging.mapped);
+    uint32_t* stagingValues = stagingKeys + SORT_BENCHMARK_MAX_KEYS;
+
+    GpuRadixSort sort;
+    sort.Prepare(m_vulkanDevice, SORT_BENCHMARK_MAX_KEYS, keys.buffer, values.buffer);
+
+    VkQueryPool queryPool;
+    VkQueryPoolCreateInfo queryPoolCreateInfo{};
+    queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCreateInfo.queryCount = 2 * SORT_BENCHMARK_ITERATIONS;
+    VK_CHECK_RESULT(vkCreateQueryPool(m_logicalDevice, &queryPoolCreateInfo, nullptr, &queryPool));
+
+    std::mt19937 generator(m_options.seed);
+    std::vector<uint32_t> input;
+    for (uint32_t count = SORT_BENCHMARK_MIN_KEYS; count <= SORT_BENCHMARK_MAX_KEYS; count *= 2)
+    {
+        input.resize(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            input[i] = generator();
+            stagingValues[i] = i;
+        }
+        memcpy(stagingKeys, input.data(), count * sizeof(uint32_t));
+
+        VkCommandBuffer commandBuffer = m_vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2 * SORT_BENCHMARK_ITERATIONS);
+
+        VkDeviceSize copySize = static_cast<VkDeviceSize>(count) * sizeof(uint32_t);
+        VkBufferCopy keysRegion = { 0, 0, copySize };
+        VkBufferCopy valuesRegion = { size, 0, copySize };
+        for (uint32_t iteration = 0; iteration < SORT_BENCHMARK_ITERATIONS; ++iteration)
+        {
+            // Every iteration sorts the same random keys, the timestamps only cover the sort
+            PipelineMemoryBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+            vkCmdCopyBuffer(commandBuffer, staging.buffer, keys.buffer, 1, &keysRegion);
+            vkCmdCopyBuffer(commandBuffer, staging.buffer, values.buffer, 1, &valuesRegion);
+            PipelineMemoryBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2 * iteration);
+            sort.Record(commandBuffer, count);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 2 * iteration + 1);
+        }
+
+        // Sorted copy back to the staging buffer for the check
+        PipelineMemoryBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        VkBufferCopy keysReadbackRegion = { 0, 0, copySize };
+        VkBufferCopy valuesReadbackRegion = { 0, size, copySize };
+        vkCmdCopyBuffer(commandBuffer, keys.buffer, staging.buffer, 1, &keysReadbackRegion);
+        vkCmdCopyBuffer(commandBuffer, values.buffer, staging.buffer, 1, &valuesReadbackRegion);
+        PipelineMemoryBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+
+        m_vulkanDevice->FlushCommandBuffer(commandBuffer, m_graphicsQueue, true);
+
+        std::array<uint64_t, 2 * SORT_BENCHMARK_ITERATIONS> timestamps;
+        VK_CHECK_RESULT(vkGetQueryPoolResults(m_logicalDevice, queryPool, 0, 2 * SORT_BENCHMARK_ITERATIONS, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+        double bestTime = 0.0;
+        double totalTime = 0.0;
+        for (uint32_t iteration = 0; iteration < SORT_BENCHMARK_ITERATIONS; ++iteration)
+        {
+            uint64_t ticks = (timestamps[2 * iteration + 1] - timestamps[2 * iteration]) & timestampMask;
+            double time = ticks * m_vulkanDevice->properties.limits.timestampPeriod * 1.0e-6;
+            bestTime = iteration == 0 ? time : std::min(bestTime, time);
+            totalTime += time;
+        }
+
+        // Keys in order, each one with the index it had in the input, and the indices of equal keys in order
+        bool sorted = true;
+        for (uint32_t i = 0; i < count && sorted; ++i)
+        {
+            uint32_t key = stagingKeys[i];
+            uint32_t value = stagingValues[i];
+            sorted = value < count && input[value] == key;
+            if (sorted && i > 0)
+            {
+                sorted = key > stagingKeys[i - 1] || (key == stagingKeys[i - 1] && value > stagingValues[i - 1]);
+            }
+        }
+        if (!sorted)
+        {
+            m_exitCode = 1;
+        }
+
+        std::cout << std::fixed << std::setprecision(3)
+            << "Radix sort of " << count << " keys: best " << bestTime << " ms, mean " << totalTime / SORT_BENCHMARK_ITERATIONS << " ms, "
+            << std::setprecision(1) << count / (bestTime * 1.0e3) << " Mkeys/s"
+            << (sorted ? "" : ", WRONG ORDER") << "\n";
+    }
+
+    vkDestroyQueryPool(m_logicalDevice, queryPool, nullptr);
+    sort.Destroy();
+    vkUnmapMemory(m_logicalDevice, staging.memory);
+    for (BufferWrapper* buffer : { &keys, &values, &staging }) {
+        vkFreeMemory(m_logicalDevice, buffer->memory, nullptr);
+        vkDestroyBuffer(m_logicalDevice, buffer->buffer, nullptr);
+    }
+}
+
+SimulationStepParams ParticleSimulation::BuildStepParams() const
+{
+    // Same inputs as the compute UBO
+    SimulationStepParams params{};
+    params.dt = m_compute.ubo.elapsedTime;
+    params.integrator = static_cast<uint32_t>(m_compute.integrator);
+    params.attractor = glm::vec3(m_compute.ubo.destX, m_compute.ubo.destY, m_compute.ubo.destZ);
+    params.restitution = m_compute.ubo.restitution;
+    params.species = m_species.table.data();
+    params.collider = &m_collider;
+    params.field = &m_vectorField;
+    params.fieldFrameA = m_fieldStream.keyframe % m_vectorField.GetFrameCount();
+    params.fieldFrameB = (m_fieldStream.keyframe + 1) % m_vectorField.GetFrameCount();
+    params.fieldBlend = m_compute.ubo.fieldBlend;
+    params.fieldCoupling = m_compute.ubo.fieldCoupling;
+    params.fieldScale = m_compute.ubo.fieldScale;
+    return params;
+}
+
+void ParticleSimulation::StepCpuBackend(uint32_t firstParticle)
+{
+    // The previous submissions are done with the storage buffer (see Render())
+    // Only particles [firstParticle, PARTICLE_COUNT) are touched, the GPU may be working on the others
+    SimulationStepParams params = BuildStepParams();
+
+    // The storage memory is not requested host coherent, the slice may hold particles last written by the GPU
+    // The slice starts on a workgroup boundary, far past any non coherent atom
+    VkDeviceSize atomSize = m_vulkanDevice->properties.limits.nonCoherentAtomSize;
+    VkMappedMemoryRange mappedRange{};
+    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    mappedRange.memory = m_compute.storageBuffer.memory;
+    mappedRange.offset = firstParticle * sizeof(Particle) / atomSize * atomSize;
+    mappedRange.size = VK_WHOLE_SIZE;
+    VK_CHECK_RESULT(vkInvalidateMappedMemoryRanges(m_logicalDevice, 1, &mappedRange));
+
+    Particle* particles = static_cast<Particle*>(m_compute.storageBuffer.mapped) + firstParticle;
+
+    // Positions before the step for the interpolation, in the same range of the previous particles
+    if (m_fixedRate.enabled)
+    {
+        Particle* previousParticles = static_cast<Particle*>(m_fixedRate.previousParticles.mapped) + firstParticle;
+        memcpy(previousParticles, particles, (PARTICLE_COUNT - firstParticle) * sizeof(Particle));
+        VkMappedMemoryRange previousRange = mappedRange;
+        previousRange.memory = m_fixedRate.previousParticles.memory;
+        VK_CHECK_RESULT(vkFlushMappedMemoryRanges(m_logicalDevice, 1, &previousRange));
+    }
+
+    // Positions the step starts from for the trails, the GPU stores its own slice of the slot meanwhile
+    // The flushed range stays within the host slice: it starts on a workgroup boundary and ends with the slot
+    static_assert(PARTICLE_COUNT * sizeof(glm::vec4) % 256 == 0, "Trail slots must end on a non coherent atom");
+    if (m_trails.store && m_trails.history.mapped)
+    {
+        glm::vec4* history = static_cast<glm::vec4*>(m_trails.history.mapped) + static_cast<size_t>(m_trails.slot) * PARTICLE_COUNT;
+        for (uint32_t i = firstParticle; i < PARTICLE_COUNT; ++i)
+        {
+            history[i] = particles[i - firstParticle].pos;
+        }
+        VkMappedMemoryRange historyRange{};
+        historyRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        historyRange.memory = m_trails.history.memory;
+        historyRange.offset = (static_cast<VkDeviceSize>(m_trails.slot) * PARTICLE_COUNT + firstParticle) * sizeof(glm::vec4) / atomSize * atomSize;
+        historyRange.size = (static_cast<VkDeviceSize>(m_trails.slot + 1) * PARTICLE_COUNT * sizeof(glm::vec4) - historyRange.offset + atomSize - 1) / atomSize * atomSize;
+        VK_CHECK_RESULT(vkFlushMappedMemoryRanges(m_logicalDevice, 1, &historyRange));
+    }
+
+    for (int32_t substep = 0; substep < m_compute.substeps; ++substep)
+    {
+        m_cpuBackend->Step(particles, PARTICLE_COUNT - firstParticle, params);
+    }
 
-    // Semaphore for compute & graphics sync
-    VkSemaphoreCreateInfo semaphoreCreateInfo{};
-    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    VK_CHECK_RESULT(vkCreateSemaphore(m_logicalDevice, &semaphoreCreateInfo, nullptr, &m_compute.semaphore));
+    VK_CHECK_RESULT(vkFlushMappedMemoryRanges(m_logicalDevice, 1, &mappedRange));
 
-    // Build a single command buffer containing the compute dispatch commands
-    BuildComputeCommandBuffer();
+    // The readback copies of the hybrid backend only cover the GPU slice, the step of both slices is done
+    if (firstParticle > 0)
+    {
+        m_readback.CopyHostParticles(static_cast<const Particle*>(m_compute.storageBuffer.mapped));
+    }
 }
 
-void ParticleSimulation::BuildCommandBuffers()
+void ParticleSimulation::StepValidation()
 {
-    VkCommandBufferBeginInfo cmdBufInfo{};
-    cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    // Done, waiting for the readbacks of the last steps
+    if (m_validation.steps == m_options.validateSteps)
+    {
+        return;
+    }
+    m_validation.steps++;
+
+    // Same substeps as the ones recorded by BuildComputeCommandBuffer() for this frame, the reference takes them
+    // once the GPU state they start from is back
+    m_validation.pending.push_back({ m_checksum.step + 1, BuildStepParams(), m_compute.substeps });
+    RequestParticles(0, PARTICLE_COUNT, [this](const Particle* particles, uint32_t, uint32_t, uint64_t copiedStep) {
+        CompareValidationStep(particles, copiedStep);
+    });
+}
 
-    VkClearValue clearValues = { {m_defaultClearColor} };
+void ParticleSimulation::CompareValidationStep(const Particle* particles, uint64_t copiedStep)
+{
+    // The steps the copies were delayed past are not compared
+    while (!m_validation.pending.empty() && m_validation.pending.front().step < copiedStep)
+    {
+        m_validation.pending.pop_front();
+    }
 
-    VkRenderPassBeginInfo renderPassBeginInfo{};
-    renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassBeginInfo.renderPass = m_renderPass;
-    renderPassBeginInfo.renderArea.offset.x = 0;
-    renderPassBeginInfo.renderArea.offset.y = 0;
-    renderPassBeginInfo.renderArea.extent.width = m_width;
-    renderPassBeginInfo.renderArea.extent.height = m_height;
-    renderPassBeginInfo.clearValueCount = 1;
-    renderPassBeginInfo.pClearValues = &clearValues;
+    if (!m_validation.pending.empty() && m_validation.pending.front().step == copiedStep)
+    {
+        // The reference only has the GPU state to start from when the step before was delivered as well
+        if (copiedStep == m_validation.step + 1)
+        {
+            const auto& pending = m_validation.pending.front();
+            for (int32_t substep = 0; substep < pending.substeps; ++substep)
+            {
+                m_validation.reference->Step(m_validation.particles.data(), PARTICLE_COUNT, pending.params);
+            }
+
+            // Floats mapped to integers in the same order, their difference is the distance in units in the last place
+            auto orderedBits = [](float value) {
+                int32_t bits;
+                memcpy(&bits, &value, sizeof(bits));
+                return bits < 0 ? static_cast<int64_t>(INT32_MIN) - bits : static_cast<int64_t>(bits);
+            };
 
-    for (int32_t i = 0; i < m_drawCmdBuffers.size(); ++i)
+            auto compare = [&](ValidationStats& stats, const glm::vec4& gpu, const glm::vec4& reference) {
+                for (int component = 0; component < 3; ++component)
+                {
+                    float a = gpu[component];
+                    float b = reference[component];
+                    stats.components++;
+                    if (!std::isfinite(a) || !std::isfinite(b))
+                    {
+                        stats.nonFinite++;
+                        continue;
+                    }
+                    double error = std::abs(static_cast<double>(a) - b);
+                    double relative = error / std::max({ std::abs(static_cast<double>(a)), std::abs(static_cast<double>(b)), 1.0 });
+                    int64_t ulps = std::abs(orderedBits(a) - orderedBits(b));
+                    stats.maxError = std::max(stats.maxError, error);
+                    stats.sumError += error;
+                    stats.maxUlps = std::max(stats.maxUlps, ulps);
+                    if (ulps > m_options.validateUlps && relative > m_options.validateRelative)
+                    {
+                        stats.outliers++;
+                    }
+                }
+            };
+
+            for (uint32_t i = 0; i < PARTICLE_COUNT; ++i)
+            {
+                compare(m_validation.positions, particles[i].pos, m_validation.particles[i].pos);
+                compare(m_validation.velocities, particles[i].vel, m_validation.particles[i].vel);
+            }
+            m_validation.comparedSteps++;
+        }
+        m_validation.pending.pop_front();
+    }
+
+    // The next step of the reference starts from this GPU state
+    m_validation.particles.assign(particles, particles + PARTICLE_COUNT);
+    m_validation.step = copiedStep;
+
+    if (++m_validation.deliveredSteps == m_options.validateSteps)
     {
-        // Set target frame buffer
-        renderPassBeginInfo.framebuffer = m_frameBuffers[i];
+        ReportValidation();
+    }
+}
+
+void ParticleSimulation::ReportValidation()
+{
+    auto report = [](const char* name, const ValidationStats& stats) {
+        uint64_t finite = std::max(stats.components - stats.nonFinite, static_cast<uint64_t>(1));
+        std::cout << name << ": max error " << stats.maxError << ", mean error " << stats.sumError / finite
+            << ", max ulps " << stats.maxUlps << ", " << stats.outliers << " of " << stats.components
+            << " components out of tolerance, " << stats.nonFinite << " not finite\n";
+    };
+    std::cout << "Validation of " << m_validation.comparedSteps << " of " << m_validation.steps << " steps of " << m_compute.substeps
+        << " substeps, " << PARTICLE_COUNT << " particles, each step taken from the GPU state before it (tolerance "
+        << m_options.validateUlps << " ulps or " << m_options.validateRelative << " relative)\n";
+    report("positions", m_validation.positions);
+    report("velocities", m_validation.velocities);
+
+    // A collision decided the other way on one side is out of tolerance now and then, only their share is checked
+    uint64_t components = m_validation.positions.components + m_validation.velocities.components;
+    uint64_t outliers = m_validation.positions.outliers + m_validation.velocities.outliers;
+    double outlierFraction = components > 0 ? static_cast<double>(outliers) / components : 0.0;
+    std::cout << "Out of tolerance " << outlierFraction << " of the components, at most " << m_options.validateOutliers << " allowed\n";
+
+    bool passed = m_validation.comparedSteps > 0 && outlierFraction <= m_options.validateOutliers &&
+        m_validation.positions.nonFinite == 0 && m_validation.velocities.nonFinite == 0;
+    std::cout << (passed ? "PASSED" : "FAILED") << "\n";
+    m_exitCode = passed ? 0 : 1;
+    RequestClose();
+}
 
-        VK_CHECK_RESULT(vkBeginCommandBuffer(m_drawCmdBuffers[i], &cmdBufInfo));
+void ParticleSimulation::UpdateHybridSplit()
+{
+    if (!m_hybrid.enabled)
+    {
+        return;
+    }
 
-        // Acquire barrier
-        if (m_graphics.queueFamilyIndex != m_compute.queueFamilyIndex)
+    // Timestamps of the previous submission, its fence has been waited on in Render()
+    if (m_hybrid.timestampsPending)
+    {
+        std::array<uint64_t, 2> timestamps;
+        VkResult result = vkGetQueryPoolResults(m_logicalDevice, m_hybrid.queryPool, 0, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS)
         {
-            VkBufferMemoryBarrier buffer_barrier =
-            {
-                VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-                nullptr,
-                0,
-                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-                m_compute.queueFamilyIndex,
-                m_graphics.queueFamilyIndex,
-                m_compute.storageBuffer.buffer,
-                0,
-                m_compute.storageBuffer.descriptor.range
-            };
+            uint64_t ticks = (timestamps[1] - timestamps[0]) & m_hybrid.timestampMask;
+            m_hybrid.gpuTime = ticks * m_vulkanDevice->properties.limits.timestampPeriod * 1.0e-6;
+        }
+        m_hybrid.timestampsPending = false;
+    }
+
+    // Both sides should finish together, each one gets a share proportional to its measured throughput
+    if (m_hybrid.adaptive && m_hybrid.gpuTime > 0.0 && m_hybrid.cpuTime > 0.0)
+    {
+        double gpuRate = m_hybrid.gpuCount / m_hybrid.gpuTime;
+        double cpuRate = (PARTICLE_COUNT - m_hybrid.gpuCount) / m_hybrid.cpuTime;
+        float target = static_cast<float>(gpuRate / (gpuRate + cpuRate));
+        m_hybrid.gpuShare += (target - m_hybrid.gpuShare) * HYBRID_SPLIT_SMOOTHING;
+    }
+    m_hybrid.gpuShare = glm::clamp(m_hybrid.gpuShare, HYBRID_MIN_SHARE, 1.0f - HYBRID_MIN_SHARE);
+
+    // The split falls on a workgroup boundary, the GPU slice is dispatched without a partial group
+    uint32_t groupCount = (PARTICLE_COUNT + SIMULATION_WORKGROUP_SIZE - 1) / SIMULATION_WORKGROUP_SIZE;
+    uint32_t gpuGroups = static_cast<uint32_t>(std::lround(m_hybrid.gpuShare * groupCount));
+    gpuGroups = std::min(std::max(gpuGroups, 1u), groupCount - 1);
+    m_hybrid.gpuCount = gpuGroups * SIMULATION_WORKGROUP_SIZE;
+    m_compute.ubo.particleCount = m_hybrid.gpuCount;
+}
+
+void ParticleSimulation::UpdateSpriteCap()
+{
+    // Single pixel points when large points are not available
+    float pixelLimit = m_enabledFeatures.largePoints ? std::min(SPRITE_MAX_PIXELS, m_deviceProperties.limits.pointSizeRange[1]) : SPRITE_MIN_PIXELS;
+    m_sprites.maxPixels = glm::clamp(m_sprites.maxPixels, SPRITE_MIN_PIXELS, pixelLimit);
 
-            vkCmdPipelineBarrier(
-                m_drawCmdBuffers[i],
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-                0,
-                0, nullptr,
-                1, &buffer_barrier,
-                0, nullptr);
+    // The current buffer is still the last submitted one, SubmitFrame() waited for it
+    if (m_sprites.statisticsPool && m_sprites.statisticsPending[m_currentBuffer])
+    {
+        uint64_t fragments = 0;
+        VkResult result = vkGetQueryPoolResults(m_logicalDevice, m_sprites.statisticsPool, m_currentBuffer, 1, sizeof(fragments), &fragments, sizeof(fragments), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS)
+        {
+            m_sprites.overdraw = static_cast<float>(fragments) / (static_cast<float>(m_width) * static_cast<float>(m_height));
         }
+        m_sprites.statisticsPending[m_currentBuffer] = false;
+    }
 
-        vkCmdBeginRenderPass(m_drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    // The fragments of the capped sprites grow with the square of the cap
+    if (m_sprites.statisticsPool && m_sprites.overdraw > 0.0f)
+    {
+        float scale = std::sqrt(m_sprites.overdrawBudget / m_sprites.overdraw);
+        m_sprites.pixelCap *= std::min(scale, SPRITE_CAP_GROWTH);
+    }
+    else
+    {
+        m_sprites.pixelCap = m_sprites.maxPixels;
+    }
+    m_sprites.pixelCap = glm::clamp(m_sprites.pixelCap, SPRITE_MIN_PIXELS, m_sprites.maxPixels);
+}
 
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float)m_width;
-        viewport.height = (float)m_height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(m_drawCmdBuffers[i], 0, 1, &viewport);
+void ParticleSimulation::UpdateLodThreshold()
+{
+    // The LOD is applied by the culling pass
+    if (!m_lod.enabled || !m_culling.enabled || m_splatting.enabled || m_depthSort.enabled)
+    {
+        m_lod.thresholdPixels = 0.0f;
+        return;
+    }
 
-        VkRect2D scissor{};
-        scissor.extent.width = m_width;
-        scissor.extent.height = m_height;
-        scissor.offset.x = 0;
-        scissor.offset.y = 0;
+    // Proportional to the relative error of the last frame time, more particles are dropped while over budget
+    // The wait of the frame limiter is not an overrun
+    float frameTime = m_renderTimer * 1000.0f;
+    m_lod.thresholdPixels += LOD_GAIN * (frameTime / m_lod.frameBudget - 1.0f);
+    m_lod.thresholdPixels = glm::clamp(m_lod.thresholdPixels, 0.0f, LOD_MAX_PIXELS);
+}
 
-        vkCmdSetScissor(m_drawCmdBuffers[i], 0, 1, &scissor);
+void ParticleSimulation::UpdateFixedRate()
+{
+    if (!m_fixedRate.enabled)
+    {
+        m_fixedRate.step = true;
+        m_fixedRate.alpha = 1.0f;
+        return;
+    }
 
-        VkDeviceSize offsets[1] = { 0 };
-        vkCmdBindPipeline(m_drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics.particle.pipeline);
-        vkCmdBindDescriptorSets(m_drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics.particle.pipelineLayout, 0, 1, &m_graphics.particle.descriptorSet, 0, nullptr);
-        vkCmdBindVertexBuffers(m_drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &m_compute.storageBuffer.buffer, offsets);
-        vkCmdDraw(m_drawCmdBuffers[i], PARTICLE_COUNT, 1, 0, 0);
+    // At most one step per frame, below the simulation rate the simulated time falls behind instead of piling up steps
+    // The frame draws the particles one step late, at the fraction of the step covered by the time left over
+    float stepTime = 1.0f / m_fixedRate.rate;
+    m_fixedRate.accumulator += m_options.deterministic ? DETERMINISTIC_FRAME_TIME : m_frameTimer;
+    m_fixedRate.step = m_fixedRate.accumulator >= stepTime;
+    if (m_fixedRate.step)
+    {
+        m_fixedRate.accumulator = std::min(m_fixedRate.accumulator - stepTime, stepTime);
+    }
+    m_fixedRate.alpha = m_fixedRate.accumulator / stepTime;
+}
+
+void ParticleSimulation::UpdateTrails()
+{
+    // Every simulation step stores its positions into the next slot, the frames in between only draw the history
+    m_trails.store = m_trails.enabled && m_fixedRate.step;
+    if (!m_trails.enabled)
+    {
+        m_trails.steps = 0;
+    }
+    else if (m_trails.store)
+    {
+        m_trails.slot = (m_trails.slot + 1) % TRAIL_LENGTH;
+        m_trails.steps = std::min(m_trails.steps + 1, static_cast<uint32_t>(TRAIL_LENGTH));
+    }
+}
 
-        vkCmdBindPipeline(m_drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics.cube.pipeline);
-        vkCmdBindDescriptorSets(m_drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics.cube.pipelineLayout, 0, 1, &m_graphics.cube.descriptorSet, 0, nullptr);
-        vkCmdBindVertexBuffers(m_drawCmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &m_graphics.cubeVertexBuffer.buffer, offsets);
-        vkCmdDraw(m_drawCmdBuffers[i], 21, 1, 0, 0); // 8 Vertices for a cube
+void ParticleSimulation::RequestStepReadbacks()
+{
+    if (!m_fixedRate.step)
+    {
+        return;
+    }
 
-        DrawUI(m_drawCmdBuffers[i]);
+    // Step the copies are taken after, RecordSimulationStep() counts the step of this frame once it is recorded
+    uint64_t step = m_checksum.step + 1;
+    RequestSnapshot(step);
+    RequestTrajectoryFrame(step);
+}
 
-        vkCmdEndRenderPass(m_drawCmdBuffers[i]);
+void ParticleSimulation::RequestSnapshot(uint64_t step)
+{
+    bool due = m_options.snapshotInterval > 0 && step % m_options.snapshotInterval == 0;
+    if (!m_snapshot.requested && !due)
+    {
+        return;
+    }
 
-        // Release barrier
-        if (m_graphics.queueFamilyIndex != m_compute.queueFamilyIndex)
+    // The previous snapshot is still written, a later step is saved once the writer is done
+    if (m_snapshot.writer.IsSaving())
+    {
+        m_snapshot.requested = true;
+        return;
+    }
+    m_snapshot.requested = false;
+
+    // The uniforms of the step are up to date, the state is the one the next step starts from
+    SnapshotState state{};
+    state.step = step;
+    state.seed = m_snapshot.seed;
+    state.fieldKeyframe = m_fieldStream.keyframe;
+    state.fieldTime = m_fieldStream.time;
+    state.attractorTimer = m_attractorTimer;
+    state.simulationTime = m_simulationTime;
+    state.integrator = m_compute.integrator;
+    state.substeps = m_compute.substeps;
+    state.gridRebuildInterval = m_compute.gridRebuildInterval;
+    state.blockLevelCount = m_compute.blockLevelCount;
+    state.contacts = m_compute.contacts ? 1 : 0;
+    state.blockTimesteps = m_compute.blockTimesteps ? 1 : 0;
+    state.computeUbo = m_compute.ubo;
+    state.species = m_species.table;
+
+    RequestParticles(0, PARTICLE_COUNT, [this, state](const Particle* particles, uint32_t first, uint32_t count, uint64_t copiedStep) {
+        // A full readback ring delays the copy past the step of the state, the next step is saved instead
+        if (copiedStep != state.step)
         {
-            VkBufferMemoryBarrier buffer_barrier =
-            {
-                VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-                nullptr,
-                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-                0,
-                m_graphics.queueFamilyIndex,
-                m_compute.queueFamilyIndex,
-                m_compute.storageBuffer.buffer,
-                0,
-                m_compute.storageBuffer.descriptor.range
-            };
+            m_snapshot.requested = true;
+            return;
+        }
+        if (!m_snapshot.writer.Save(m_options.snapshotPath, &state, sizeof(state), particles, count))
+        {
+            m_snapshot.requested = true;
+            return;
+        }
+        std::cout << "Saving snapshot of step " << state.step << "\n";
+    });
+}
+
+void ParticleSimulation::RequestTrajectoryFrame(uint64_t step)
+{
+    if (!m_recording.recorder.IsOpen() || step % std::max(m_options.recordInterval, 1u) != 0)
+    {
+        return;
+    }
+
+    // A busy readback ring delays the copies, the steps that come meanwhile are dropped rather than queued
+    if (m_recording.pendingCopies >= RECORD_MAX_PENDING_COPIES)
+    {
+        m_recording.recorder.Drop();
+        return;
+    }
+    m_recording.pendingCopies++;
+    RequestParticles(0, PARTICLE_COUNT, [this](const Particle* particles, uint32_t first, uint32_t count, uint64_t copiedStep) {
+        m_recording.pendingCopies--;
 
-            vkCmdPipelineBarrier(
-                m_drawCmdBuffers[i],
-                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
-                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                0,
-                0, nullptr,
-                1, &buffer_barrier,
-                0, nullptr);
+        // A delayed copy can be taken after the step a later request already got, the frame would be written twice
+        // or out of order
+        if (copiedStep <= m_recording.lastStep)
+        {
+            m_recording.recorder.Drop();
+            return;
         }
+        m_recording.lastStep = copiedStep;
+        m_recording.recorder.Submit(particles, copiedStep);
+    });
+}
 
-        VK_CHECK_RESULT(vkEndCommandBuffer(m_drawCmdBuffers[i]));
+void ParticleSimulation::RestoreSnapshotState()
+{
+    const SnapshotState* state = GetRestoredState();
+    if (!state)
+    {
+        return;
     }
+
+    // The uniform buffers were updated once by their preparation, the restored timers replace the advanced ones
+    // The field slots around the keyframe were filled by LoadAssets()
+    m_checksum.step = state->step;
+    m_fieldStream.keyframe = state->fieldKeyframe;
+    m_fieldStream.time = state->fieldTime;
+    m_fieldStream.streamedSlices = m_vectorField.GetDepth();
+    m_attractorTimer = state->attractorTimer;
+    m_simulationTime = state->simulationTime;
+    m_compute.integrator = std::min(std::max(state->integrator, 0), INTEGRATOR_COUNT - 1);
+    m_compute.substeps = std::min(std::max(state->substeps, 1), MAX_SUBSTEPS);
+    m_compute.gridRebuildInterval = std::min(std::max(state->gridRebuildInterval, 1), MAX_SUBSTEPS);
+    m_compute.blockLevelCount = std::min(std::max(state->blockLevelCount, 1), BLOCK_MAX_LEVELS);
+    // Neither is mirrored by the host backends nor by the reference of the validation
+    bool integrationOnly = m_cpuBackend || m_validation.reference;
+    m_compute.contacts = state->contacts != 0 && !integrationOnly;
+    m_compute.blockTimesteps = state->blockTimesteps != 0 && !integrationOnly;
+    m_compute.ubo = state->computeUbo;
+    // The GPU slice of a hybrid run is not the one of this backend, UpdateHybridSplit() sets it again if it is hybrid
+    m_compute.ubo.particleCount = PARTICLE_COUNT;
+    m_compute.ubo.demEnabled = m_compute.contacts && !m_compute.blockTimesteps ? 1 : 0;
+    std::cout << "Restored step " << state->step << " from " << m_options.restorePath << "\n";
+
+    m_snapshot.restore.Close();
 }
 
-void ParticleSimulation::BuildComputeCommandBuffer()
+const ParticleSimulation::SnapshotState* ParticleSimulation::GetRestoredState() const
 {
-    VkCommandBufferBeginInfo cmdBufInfo{};
-    cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    return m_snapshot.restore.IsOpen() ? static_cast<const SnapshotState*>(m_snapshot.restore.GetState()) : nullptr;
+}
 
-    VK_CHECK_RESULT(vkBeginCommandBuffer(m_compute.commandBuffer, &cmdBufInfo));
+void ParticleSimulation::RequestParticles(uint32_t first, uint32_t count, ParticleReadback::Callback callback)
+{
+    first = std::min(first, static_cast<uint32_t>(PARTICLE_COUNT));
+    count = std::min(count, PARTICLE_COUNT - first);
+    m_readback.Request(first, count, std::move(callback));
+}
 
-    // make sure ssbo ownership is passed to compute queue
-    if (m_graphics.queueFamilyIndex != m_compute.queueFamilyIndex)
-    {
-        VkBufferMemoryBarrier bufferMemoryBarrier{};
-        bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-        bufferMemoryBarrier.srcAccessMask = 0;
-        bufferMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-        bufferMemoryBarrier.srcQueueFamilyIndex = m_graphics.queueFamilyIndex;
-        bufferMemoryBarrier.dstQueueFamilyIndex = m_compute.queueFamilyIndex;
-        bufferMemoryBarrier.pNext = nullptr;
-        bufferMemoryBarrier.size = m_compute.storageBuffer.descriptor.range; // range == size
-        bufferMemoryBarrier.buffer = m_compute.storageBuffer.buffer;
+void ParticleSimulation::RecordChecksum(VkCommandBuffer commandBuffer)
+{
+    // Wait for the last substep, then reduce the particle state into the two sums
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    vkCmdFillBuffer(commandBuffer, m_checksum.buffer.buffer, 0, VK_WHOLE_SIZE, 0);
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_checksum.pipeline);
+    vkCmdDispatch(commandBuffer, (PARTICLE_COUNT + SIMULATION_WORKGROUP_SIZE - 1) / SIMULATION_WORKGROUP_SIZE, 1, 1);
+
+    PipelineMemoryBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+}
 
-        vkCmdPipelineBarrier(
-            m_compute.commandBuffer,
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            0,
-            0, nullptr,
-            1, &bufferMemoryBarrier,
-            0, nullptr);
+void ParticleSimulation::ReadChecksum()
+{
+    if (!m_checksum.pending)
+    {
+        return;
     }
 
-    // Dispatch the compute job
-    vkCmdBindPipeline(m_compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compute.pipeline);
-    vkCmdBindDescriptorSets(m_compute.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_compute.pipelineLayout, 0, 1, &m_compute.descriptorSet, 0, 0);
-    vkCmdDispatch(m_compute.commandBuffer, PARTICLE_COUNT / 1024, 1, 1);
+    const uint32_t* sums = static_cast<const uint32_t*>(m_checksum.buffer.mapped);
+    std::cout << "step " << m_checksum.step << " checksum "
+        << std::hex << std::setfill('0') << std::setw(8) << sums[1] << std::setw(8) << sums[0] << std::dec << std::setfill(' ') << "\n";
+    m_checksum.pending = false;
+}
 
-    // Add barrier to ensure that compute shader has finished writing to the buffer
-    // Without this the (rendering) vertex shader may display incomplete results (partial data from last frame)
-    if (m_graphics.queueFamilyIndex != m_compute.queueFamilyIndex)
-    {
-        VkBufferMemoryBarrier bufferMemoryBarrier{};
-        bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-        bufferMemoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-        bufferMemoryBarrier.dstAccessMask = 0;
-        bufferMemoryBarrier.srcQueueFamilyIndex = m_compute.queueFamilyIndex;
-        bufferMemoryBarrier.dstQueueFamilyIndex = m_graphics.queueFamilyIndex;
-        bufferMemoryBarrier.pNext = nullptr;
-        bufferMemoryBarrier.size = m_compute.storageBuffer.descriptor.range; // range == size
-        bufferMemoryBarrier.buffer = m_compute.storageBuffer.buffer;
+float ParticleSimulation::SimulationFrameTime() const
+{
+    if (m_fixedRate.enabled)
+    {
+        return m_fixedRate.step ? 1.0f / m_fixedRate.rate : 0.0f;
+    }
+    return m_options.deterministic ? DETERMINISTIC_FRAME_TIME : m_frameTimer;
+}
 
-        vkCmdPipelineBarrier(
-            m_compute.commandBuffer,
-            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-            0,
-            0, nullptr,
-            1, &bufferMemoryBarrier,
-            0, nullptr);
+void ParticleSimulation::PrepareFieldStreaming()
+{
+    // Staging memory for the slices uploaded in one frame, kept mapped
+    VkDeviceSize stagingSize = m_vectorField.GetSliceSize() * FIELD_STREAM_SLICES_PER_FRAME;
+    VK_CHECK_RESULT(m_vulkanDevice->CreateBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        &m_fieldStream.stagingBuffer.buffer,
+        &m_fieldStream.stagingBuffer.memory,
+        stagingSize));
+    VK_CHECK_RESULT(vkMapMemory(m_logicalDevice, m_fieldStream.stagingBuffer.memory, 0, stagingSize, 0, &m_fieldStream.stagingBuffer.mapped));
+
+    m_fieldStream.commandBuffer = m_vulkanDevice->CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_compute.commandPool);
+
+    // Signaled so that the first upload does not wait
+    VkFenceCreateInfo fenceCreateInfo{};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    VK_CHECK_RESULT(vkCreateFence(m_logicalDevice, &fenceCreateInfo, nullptr, &m_fieldStream.fence));
+}
+
+void ParticleSimulation::StreamFieldSlices()
+{
+    uint32_t depth = m_vectorField.GetDepth();
+    if (m_fieldStream.streamedSlices >= depth)
+    {
+        return;
     }
 
-    vkEndCommandBuffer(m_compute.commandBuffer);
+    // The previous upload has to be done before its staging memory and command buffer are reused
+    VK_CHECK_RESULT(vkWaitForFences(m_logicalDevice, 1, &m_fieldStream.fence, VK_TRUE, UINT64_MAX));
+    VK_CHECK_RESULT(vkResetFences(m_logicalDevice, 1, &m_fieldStream.fence));
+
+    uint32_t keyframe = (m_fieldStream.keyframe + 2) % m_vectorField.GetFrameCount();
+    uint32_t slot = (m_fieldStream.keyframe + 2) % FIELD_SLOT_COUNT;
+    uint32_t firstSlice = m_fieldStream.streamedSlices;
+    uint32_t sliceCount = std::min<uint32_t>(FIELD_STREAM_SLICES_PER_FRAME, depth - firstSlice);
+    memcpy(m_fieldStream.stagingBuffer.mapped, m_vectorField.GetSlice(keyframe, firstSlice), m_vectorField.GetSliceSize() * sliceCount);
+
+    VkCommandBufferBeginInfo cmdBufInfo{};
+    cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK_RESULT(vkBeginCommandBuffer(m_fieldStream.commandBuffer, &cmdBufInfo));
+
+    VkImageMemoryBarrier imageMemoryBarrier{};
+    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageMemoryBarrier.image = m_textures.field[slot].m_image;
+    imageMemoryBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+    // The slot was blended from by the previous simulation steps, let them finish reading it
+    imageMemoryBarrier.srcAccessMask = 0;
+    imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+        m_fieldStream.commandBuffer,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &imageMemoryBarrier);
+
+    VkBufferImageCopy bufferCopyRegion{};
+    bufferCopyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    bufferCopyRegion.imageOffset = { 0, 0, static_cast<int32_t>(firstSlice) };
+    bufferCopyRegion.imageExtent = { m_vectorField.GetWidth(), m_vectorField.GetHeight(), sliceCount };
+    bufferCopyRegion.bufferOffset = 0;
+    vkCmdCopyBufferToImage(m_fieldStream.commandBuffer, m_fieldStream.stagingBuffer.buffer, m_textures.field[slot].m_image, VK_IMAGE_LAYOUT_GENERAL, 1, &bufferCopyRegion);
+
+    // Make the slices visible to the simulation once the slot gets blended
+    imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(
+        m_fieldStream.commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        0, nullptr,
+        0, nullptr,
+        1, &imageMemoryBarrier);
+
+    VK_CHECK_RESULT(vkEndCommandBuffer(m_fieldStream.commandBuffer));
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_fieldStream.commandBuffer;
+    VK_CHECK_RESULT(vkQueueSubmit(m_compute.queue, 1, &submitInfo, m_fieldStream.fence));
+
+    m_fieldStream.streamedSlices += sliceCount;
+}
+
+void ParticleSimulation::UpdateFieldKeyframes()
+{
+    uint32_t frameCount = m_vectorField.GetFrameCount();
+    float frameDuration = m_vectorField.GetFrameDuration();
+
+    // Keyframes advance with the simulated time, a keyframe that is not fully streamed yet holds the blend
+    m_fieldStream.time += SimulationFrameTime() * SIMULATION_TIME_SCALE;
+    if (frameCount > 1 && m_fieldStream.time >= frameDuration)
+    {
+        if (m_fieldStream.streamedSlices >= m_vectorField.GetDepth())
+        {
+            m_fieldStream.time = std::min(m_fieldStream.time - frameDuration, frameDuration);
+            m_fieldStream.keyframe++;
+            m_fieldStream.streamedSlices = 0;
+        }
+        else
+        {
+            m_fieldStream.time = frameDuration;
+        }
+    }
+
+    m_compute.ubo.fieldSlotA = m_fieldStream.keyframe % FIELD_SLOT_COUNT;
+    m_compute.ubo.fieldSlotB = (m_fieldStream.keyframe + 1) % FIELD_SLOT_COUNT;
+    m_compute.ubo.fieldBlend = frameCount > 1 ? std::min(m_fieldStream.time / frameDuration, 1.0f) : 0.0f;
 }
 
 void ParticleSimulation::OnUpdateUIOverlay(VulkanIamGuiWrapper *uiWrapper)
 {
     //uiWrapper->CheckBox("Attach attractor to cursor", &m_attractorMouse);
+
+    // The compute command buffer is recorded every frame and picks up these settings
+    uiWrapper->ComboBox("Integrator", &m_compute.integrator, { "Symplectic Euler", "Leapfrog (KDK)", "Velocity Verlet", "RK4" });
+    // The host backends only mirror the integration step of simulation.comp, so does the reference of the validation
+    bool integrationOnly = m_cpuBackend || m_validation.reference;
+    if (!integrationOnly)
+    {
+        uiWrapper->CheckBox("Block timesteps", &m_compute.blockTimesteps);
+    }
+    if (m_hybrid.enabled)
+    {
+        if (m_hybrid.queryPool)
+        {
+            uiWrapper->CheckBox("Adaptive split", &m_hybrid.adaptive);
+        }
+        uiWrapper->SliderFloat("GPU share", &m_hybrid.gpuShare, HYBRID_MIN_SHARE, 1.0f - HYBRID_MIN_SHARE);
+    }
+    if (m_compute.blockTimesteps)
+    {
+        uiWrapper->SliderInt("Block levels", &m_compute.blockLevelCount, 1, BLOCK_MAX_LEVELS);
+        uiWrapper->SliderFloat("Block accuracy", &m_compute.ubo.blockAccuracy, 0.001f, 0.1f);
+    }
+    else
+    {
+        uiWrapper->SliderInt("Substeps", &m_compute.substeps, 1, MAX_SUBSTEPS);
+    }
+    // The first step follows at once, it also takes the previous positions that the frames interpolate from
+    if (uiWrapper->CheckBox("Fixed simulation rate", &m_fixedRate.enabled) && m_fixedRate.enabled)
+    {
+        m_fixedRate.accumulator = 1.0f / m_fixedRate.rate;
+    }
+    if (m_fixedRate.enabled)
+    {
+        uiWrapper->SliderInt("Simulation rate (Hz)", &m_fixedRate.rate, 10, 240);
+    }
+    uiWrapper->SliderFloat("Restitution", &m_compute.ubo.restitution, 0.0f, 1.0f);
+    uiWrapper->SliderFloat("Field coupling", &m_compute.ubo.fieldCoupling, 0.0f, 100.0f);
+    uiWrapper->SliderFloat("Field scale", &m_compute.ubo.fieldScale, 0.0f, 10.0f);
+    // Contacts are resolved per substep for all the particles, they are not available with block timesteps
+    if (!m_compute.blockTimesteps && !integrationOnly)
+    {
+        uiWrapper->CheckBox("Particle contacts", &m_compute.contacts);
+    }
+    if (m_compute.contacts && !m_compute.blockTimesteps)
+    {
+        uiWrapper->SliderInt("Grid rebuild interval", &m_compute.gridRebuildInterval, 1, MAX_SUBSTEPS);
+        uiWrapper->SliderFloat("Contact stiffness", &m_compute.ubo.demStiffness, 1.0e3f, 1.0e5f);
+        uiWrapper->SliderFloat("Contact damping", &m_compute.ubo.demDamping, 0.0f, 100.0f);
+    }
+    m_compute.ubo.demEnabled = m_compute.contacts && !m_compute.blockTimesteps ? 1 : 0;
+
+    // Only these toggles change what BuildCommandBuffers() records, the other settings are read every frame
+    bool renderStateChanged = false;
+    if (m_splatting.supported)
+    {
+        renderStateChanged |= uiWrapper->CheckBox("Compute rasterizer", &m_splatting.enabled);
+    }
+    if (m_depthSort.supported && !m_splatting.enabled)
+    {
+        renderStateChanged |= uiWrapper->CheckBox("Sorted alpha blending", &m_depthSort.enabled);
+    }
+    // Every particle is drawn in depth order, the culling pass is skipped
+    if (m_culling.supported && !m_splatting.enabled && !m_depthSort.enabled)
+    {
+        renderStateChanged |= uiWrapper->CheckBox("Frustum culling", &m_culling.enabled);
+    }
+    if (m_culling.enabled && !m_splatting.enabled && !m_depthSort.enabled)
+    {
+        // Count of the last drawn frame, the graphics queue is idle between frames
+        uint32_t visibleCount = static_cast<const VkDrawIndirectCommand*>(m_culling.drawCommand.mapped)->vertexCount;
+        uiWrapper->Text("Drawn particles %u / %u", visibleCount, static_cast<uint32_t>(PARTICLE_COUNT));
+
+        uiWrapper->CheckBox("Stochastic LOD", &m_lod.enabled);
+        if (m_lod.enabled)
+        {
+            uiWrapper->SliderFloat("LOD frame budget (ms)", &m_lod.frameBudget, 2.0f, 50.0f);
+            uiWrapper->Text("LOD threshold %.2f px", m_lod.thresholdPixels);
+        }
+    }
+
+    // The compute rasterizer draws single pixels, only the intensity applies to it
+    uiWrapper->SliderFloat("Sprite intensity", &m_sprites.intensity, 0.0f, 2.0f);
+    if (!m_splatting.enabled)
+    {
+        uiWrapper->SliderFloat("Sprite size", &m_sprites.size, 0.001f, 0.1f);
+    }
+    if (m_enabledFeatures.largePoints && !m_splatting.enabled)
+    {
+        uiWrapper->SliderFloat("Sprite max pixels", &m_sprites.maxPixels, SPRITE_MIN_PIXELS, std::min(SPRITE_MAX_PIXELS, m_deviceProperties.limits.pointSizeRange[1]));
+    }
+    if (m_sprites.statisticsPool && !m_splatting.enabled)
+    {
+        uiWrapper->SliderFloat("Overdraw budget", &m_sprites.overdrawBudget, 1.0f, 64.0f);
+        uiWrapper->Text("Overdraw %.2f, sprite cap %.1f px", m_sprites.overdraw, m_sprites.pixelCap);
+    }
+
+    // The history restarts empty every time the trails are enabled
+    renderStateChanged |= uiWrapper->CheckBox("Velocity trails", &m_trails.enabled);
+    if (m_trails.enabled)
+    {
+        uiWrapper->SliderFloat("Trail intensity", &m_trails.intensity, 0.0f, 1.0f);
+    }
+    if (renderStateChanged)
+    {
+        uiWrapper->updated = true;
+    }
+
+    // Taken after the next simulation step, written to disk in the background
+    if (uiWrapper->Button("Save snapshot"))
+    {
+        m_snapshot.requested = true;
+    }
+    uiWrapper->Text("Step %llu, simulated time %.2f", static_cast<unsigned long long>(m_checksum.step), m_simulationTime);
+    if (m_recording.recorder.IsOpen())
+    {
+        uiWrapper->Text("Recorded %llu frames, dropped %llu, %.1f MiB",
+            static_cast<unsigned long long>(m_recording.recorder.GetWrittenFrames()),
+            static_cast<unsigned long long>(m_recording.recorder.GetDroppedFrames()),
+            m_recording.recorder.GetWrittenBytes() / (1024.0 * 1024.0));
+    }
+
+    uiWrapper->ComboBox("Species", &m_species.selected, m_species.names);
+    Species& species = m_species.table[m_species.selected];
+    bool speciesChanged = false;
+    speciesChanged |= uiWrapper->SliderFloat("Mass", &species.mass, 0.1f, 10.0f);
+    speciesChanged |= uiWrapper->SliderFloat("Drag", &species.drag, 0.0f, 5.0f);
+    speciesChanged |= uiWrapper->SliderFloat("Charge", &species.charge, 0.0f, 5.0f);
+    speciesChanged |= uiWrapper->SliderFloat("Attractor response", &species.attractorResponse, -2.0f, 2.0f);
+    if (speciesChanged)
+    {
+        memcpy(m_species.uniformBuffer.mapped, m_species.table.data(), sizeof(m_species.table));
+    }
 }
 
 void ParticleSimulation::OnViewChanged()
 {
     UpdateViewUniformBuffers();
 }
+
+void ParticleSimulation::GetEnabledFeatures()
+{
+    // Sprites larger than a pixel and the overdraw statistics are optional, both degrade gracefully without them
+    m_enabledFeatures.largePoints = m_deviceFeatures.largePoints;
+    m_enabledFeatures.pipelineStatisticsQuery = m_deviceFeatures.pipelineStatisticsQuery;
+}
@@ -2,18 +2,105 @@
 
 #include <VulkanCore.h>
 #include <VulkanTexture.h>
+#include <GpuRadixSort.h>
+#include <ParticleReadback.h>
+#include <SdfCollider.h>
+#include <SimulationBackend.h>
+#include <SimulationSnapshot.h>
+#include <ThreadPool.h>
+#include <TrajectoryRecorder.h>
+#include <VectorField.h>
 #include <glm/glm.hpp>
 
+#include <array>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
 #define VERTEX_BUFFER_BIND_ID 0
+// Particle positions before the last simulation step, interpolated with the current ones by particle.vert
+#define PREVIOUS_VERTEX_BUFFER_BIND_ID 1
 
 #define ENABLE_VALIDATION true
 
 #define PARTICLE_COUNT 25600 * 4
 
-// SSBO particle declaration
-struct Particle {
-    glm::vec4 pos; // Particle position
-    glm::vec4 vel; // Particle velocity
+// Must match local_size_x of simulation.comp
+#define SIMULATION_WORKGROUP_SIZE 1024
+
+#define MAX_SUBSTEPS 8
+
+// Simulated time per second of frame time
+#define SIMULATION_TIME_SCALE (1.0f / 80.0f)
+
+// Block timesteps: particles are binned into power of two subdivisions of the frame step
+// Must match local_size_x of block_dispatch.comp
+#define BLOCK_MAX_LEVELS 8
+
+// Collider signed distance field, baked over a slightly larger domain than the [-1, 1] cube
+#define SDF_RESOLUTION 64
+#define SDF_DOMAIN_EXTENT 1.25f
+
+// Vector field keyframes: two slots are blended while the next keyframe is streamed into the third one
+#define FIELD_SLOT_COUNT 3
+#define FIELD_STREAM_SLICES_PER_FRAME 4
+
+// Particle - particle contacts: radii are stored in Particle.pos.w
+// The grid covers the collider domain, its cells hold the largest contact distance plus a skin
+// so that the grid can be reused over several substeps
+#define PARTICLE_RADIUS_MIN 0.004f
+#define PARTICLE_RADIUS_MAX 0.008f
+#define GRID_DIM 128
+#define GRID_CELL_COUNT (GRID_DIM * GRID_DIM * GRID_DIM)
+// Must match BLOCK_SIZE of grid_scan.comp
+#define GRID_SCAN_BLOCK_SIZE 2048
+#define GRID_SCAN_PASS_COUNT 3
+
+// Frame time used instead of the measured one in deterministic mode
+#define DETERMINISTIC_FRAME_TIME (1.0f / 60.0f)
+
+// Hybrid backend: smallest share of the particles left to either side, so that both throughputs stay measured,
+// and weight of the last frame timings in the adaptive split
+#define HYBRID_MIN_SHARE 0.02f
+#define HYBRID_SPLIT_SMOOTHING 0.2f
+
+// Point sprites: the pixel size cap follows the overdraw measured on the particle draw, it shrinks at once when the
+// budget is exceeded and grows back by at most SPRITE_CAP_GROWTH per frame
+#define SPRITE_MIN_PIXELS 1.0f
+#define SPRITE_MAX_PIXELS 64.0f
+#define SPRITE_CAP_GROWTH 1.05f
+
+// Must match local_size_x of particle_cull.comp
+#define CULL_WORKGROUP_SIZE 256
+
+// Stochastic LOD of the culled draw: the projected size under which particles are thinned out follows the frame time,
+// it moves by LOD_GAIN pixels per frame and per 100% of frame budget overrun, and at least LOD_MIN_KEEP of them are kept
+#define LOD_MAX_PIXELS 8.0f
+#define LOD_GAIN 0.25f
+#define LOD_MIN_KEEP 0.0625f
+
+// Must match local_size_x of particle_splat.comp
+#define SPLAT_WORKGROUP_SIZE 256
+
+// Must match local_size_x of particle_depth_keys.comp
+#define DEPTH_KEYS_WORKGROUP_SIZE 256
+
+// Velocity trails: positions of the last TRAIL_LENGTH simulation steps, stored by a pass of simulation.comp
+#define TRAIL_LENGTH 16
+
+// Trajectory recording: particle copies in flight at once, the steps to record beyond them are dropped
+#define RECORD_MAX_PENDING_COPIES 2
+
+// Radix sort benchmark: key counts from the min to the max one by powers of two, each sorted several times
+#define SORT_BENCHMARK_MIN_KEYS (1u << 20)
+#define SORT_BENCHMARK_MAX_KEYS (1u << 24)
+#define SORT_BENCHMARK_ITERATIONS 8
+
+// Indirect dispatch of a block timestep level, followed by the number of particles binned into it
+struct BlockLevelDispatch {
+    VkDispatchIndirectCommand command;
+    uint32_t particleCount;
 };
 
 struct CubeVertex {
@@ -28,6 +115,31 @@ struct BufferWrapper {
     void *mapped = nullptr;
 };
 
+// Command line options
+struct SimulationOptions {
+    bool deterministic = false;                     // Fixed seed and time step, checksums of the particle state
+    uint32_t seed = 1;                              // Seed of the initial state in deterministic mode
+    uint32_t checksumInterval = 60;                 // Steps between two checksums in deterministic mode, 0 disables them
+    SimulationBackendType backend = SIMULATION_BACKEND_GPU;
+    uint32_t threadCount = 0;                       // Threads of the host backends, 0 uses every logical processor
+    bool pinThreads = false;                        // Binds each host backend worker thread to its own logical processor
+    uint32_t validateSteps = 0;                     // Steps compared against the host reference before exiting, 0 disables the check
+    uint32_t validateUlps = 1024;                   // A component passes within this distance in units in the last place
+    float validateRelative = 1.0e-3f;               // or within this relative error, below 1 in magnitude the error is absolute
+    float validateOutliers = 1.0e-4f;               // Fraction of the compared components allowed out of tolerance
+    bool benchmarkSort = false;                     // Times the GPU radix sort over random keys before exiting
+    uint32_t simulationRate = 0;                    // Simulation steps per second, interpolated in between, 0 steps once per frame
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;    // Mailbox, else immediate, else FIFO by default
+    uint32_t swapchainImageCount = 0;               // 0 uses one more than the surface minimum
+    uint32_t frameLimit = 0;                        // Frames per second, 0 leaves the pacing to the present mode
+    std::string restorePath;                        // Snapshot the simulation starts from, empty starts from a new state
+    std::string snapshotPath = "simulation.psnp";   // Written by the UI and every snapshotInterval steps
+    uint32_t snapshotInterval = 0;                  // Steps between two snapshots, 0 only saves them from the UI
+    std::string recordPath;                         // Trajectory file, empty disables the recording
+    uint32_t recordInterval = 1;                    // Steps between two recorded frames
+    uint32_t recordThreads = 4;                     // Threads compressing the trajectory, 0 uses every logical processor
+};
+
 class ParticleSimulation : public VulkanCore
 {
 public:
@@ -53,20 +165,123 @@ public:
 
         // Particle pipeline
         pipelineWrapper particle;
+        VkPipeline sortedParticlePipeline;          // Same layout, the sprites are blended over the frame and drawn back to front
 
         // Simple Cube pipeline
         BufferWrapper cubeVertexBuffer;
         pipelineWrapper cube;
 
+        // Per frame buffer secondary command buffers, recorded again only when a setting changes
+        // The primary draw command buffers are recorded every frame and execute them next to the overlay
+        std::vector<VkCommandBuffer> prePassCmdBuffers;    // Compute passes ahead of the render pass
+        std::vector<VkCommandBuffer> sceneCmdBuffers;      // Draws of the render pass, the overlay excepted
+
         VkSemaphore semaphore;                      // Execution dependency between compute & graphic submission
         BufferWrapper uniformBuffer;
         struct graphicsUbo {
             glm::mat4 model;
             glm::mat4 view;
             glm::mat4 projection;
+            glm::vec4 sprite;                       // x: world size, y: pixel size cap, z: viewport height, w: intensity
+            glm::vec4 lod;                          // x: LOD threshold in pixels, y: 1 when drawn from the culled copies, z: LOD_MIN_KEEP
+            glm::vec4 interpolation;                // x: blend factor from the previous particle positions to the current ones
+            glm::vec4 trail;                        // x: history slot of the newest positions, y: steps held, z: TRAIL_LENGTH, w: intensity
         } ubo;
     } m_graphics;
 
+    // Textured point sprites blended additively, their size is attenuated by distance and capped so that the
+    // fragments shaded by the particle draw stay within overdrawBudget per screen pixel
+    struct {
+        float size = 0.02f;                         // World space diameter
+        float intensity = 0.5f;
+        float maxPixels = 16.0f;                    // Cap chosen in the UI, lowered when the budget is exceeded
+        float pixelCap = 16.0f;                     // Cap in use
+        float overdrawBudget = 8.0f;
+        float overdraw = 0.0f;                      // Fragments per screen pixel on the last measured frame
+        VkQueryPool statisticsPool = VK_NULL_HANDLE;    // One query per draw command buffer, null when not supported
+        std::vector<bool> statisticsPending;        // The draw command buffer has been submitted since its last read
+    } m_sprites;
+
+    // Frustum culling at the start of the draw command buffers, on the graphics queue so that it sees the matrices
+    // and the host written particles of the frame being drawn
+    struct {
+        bool supported = false;                     // The graphics queue family can dispatch compute work
+        bool enabled = true;
+        BufferWrapper visibleParticles;             // Compacted copies of the visible particles, drawn in place of the storage buffer
+        BufferWrapper drawCommand;                  // VkDrawIndirectCommand, host visible for the UI count
+        VkDescriptorSetLayout descriptorSetLayout;
+        VkDescriptorSet descriptorSet;
+        VkPipelineLayout pipelineLayout;
+        VkPipeline pipeline;
+    } m_culling;
+
+    // Distance based stochastic LOD, applied by the culling pass
+    struct {
+        bool enabled = false;
+        float frameBudget = 20.0f;                  // Milliseconds, above a 60 Hz refresh so that waiting on vsync is not an overrun
+        float thresholdPixels = 0.0f;               // Particles projected smaller than this are thinned out, 0 keeps all of them
+    } m_lod;
+
+    // Software point rasterizer replacing the particle draw: a compute pass projects every particle and adds its
+    // color to the pixel it covers with 32 bit atomics, a fullscreen pass then adds the sums to the frame
+    struct {
+        bool supported = false;                     // The graphics queue family can dispatch compute work
+        bool enabled = false;
+        VkImage image;                              // R32_UINT, one layer per color channel, in the general layout
+        VkDeviceMemory memory;
+        VkImageView view;
+        VkDescriptorImageInfo descriptor;
+        VkDescriptorSetLayout descriptorSetLayout;  // Shared by the splat and resolve pipelines
+        VkDescriptorSet descriptorSet;
+        VkPipelineLayout pipelineLayout;
+        VkPipeline splatPipeline;
+        VkPipeline resolvePipeline;
+    } m_splatting;
+
+    // Back to front order of the particles for the sorted alpha blending: the view depth keys are sorted with the
+    // particle indices at the start of the draw command buffers, the sorted indices feed an indexed draw
+    struct {
+        bool supported = false;                     // The graphics queue family can dispatch compute work with subgroup operations
+        bool enabled = false;
+        BufferWrapper keys;
+        BufferWrapper indices;                      // Index buffer of the particle draw once sorted
+        GpuRadixSort sort;
+        VkDescriptorSetLayout descriptorSetLayout;
+        VkDescriptorSet descriptorSet;
+        VkPipelineLayout pipelineLayout;
+        VkPipeline keyPipeline;
+    } m_depthSort;
+
+    // Simulation stepped at a fixed rate independent of the frame rate: frames between two steps only draw, with the
+    // particles interpolated between their previous and current positions
+    // The previous positions are copied by each side before it integrates its particles, the compute command buffer of
+    // the frames without a step only holds the queue ownership transfers
+    struct {
+        bool enabled = false;
+        int32_t rate = 30;                          // Steps per second
+        float accumulator = 0.0f;                   // Frame time not simulated yet, at most one step
+        bool step = true;                           // The current frame steps the simulation
+        float alpha = 1.0f;                         // Interpolation factor of the current frame
+        BufferWrapper previousParticles;            // Same layout as the storage buffer, mapped for the host backends
+    } m_fixedRate;
+
+    // Positions of the last TRAIL_LENGTH simulation steps in a ring, history major: the pass of simulation.comp that
+    // stores a step writes one contiguous slice of PARTICLE_COUNT positions, the draw reads them back as one line strip
+    // per particle fading with the age of its vertices
+    struct {
+        bool enabled = false;
+        float intensity = 0.25f;
+        uint32_t slot = 0;                          // Slot of the newest positions
+        uint32_t steps = 0;                         // Steps held by the history, reset when the trails are disabled
+        bool store = false;                         // The current frame stores the positions its step starts from
+        BufferWrapper history;                      // TRAIL_LENGTH * PARTICLE_COUNT positions
+        VkPipeline storePipeline;                   // simulation.comp specialized for the trail pass
+        VkDescriptorSetLayout descriptorSetLayout;
+        VkDescriptorSet descriptorSet;
+        VkPipelineLayout pipelineLayout;
+        VkPipeline pipeline;
+    } m_trails;
+
     struct {
         uint32_t queueFamilyIndex;
         VkQueue queue;
@@ -74,29 +289,203 @@ public:
         VkCommandBuffer commandBuffer;
         VkDescriptorSetLayout descriptorSetLayout;
         VkDescriptorSet descriptorSet;
-        VkPipeline pipeline;
+        std::array<VkPipeline, INTEGRATOR_COUNT> pipelines;   // One pipeline per integration scheme
         VkPipelineLayout pipelineLayout;
+        int32_t integrator = INTEGRATOR_SYMPLECTIC_EULER;
+        int32_t substeps = 1;                       // Simulation steps dispatched per frame
+        bool contacts = false;                      // Particle - particle collisions
+        int32_t gridRebuildInterval = 1;            // Substeps between two contact grid builds
+        bool blockTimesteps = false;                // Per particle power of two timesteps, replaces the substeps
+        int32_t blockLevelCount = 4;
         BufferWrapper storageBuffer;
         BufferWrapper uniformBuffer;
         VkSemaphore semaphore;                      // Execution dependency between compute & graphic submission
+        VkFence fence;                              // The command buffer is recorded again every frame once the previous submission is done
+        uint64_t submissions = 0;                   // Compute submissions so far, all done once the fence has been waited on
         struct computeUbo {
             float elapsedTime;
             float destX;
             float destY;
             float destZ;
             uint32_t particleCount = PARTICLE_COUNT;
+            float restitution = 0.5f;               // Normal velocity kept after a collision
+            float pad[2];
+            glm::vec4 sdfBoundsMin;                 // Domain covered by the collider field
+            glm::vec4 sdfBoundsMax;
+            glm::vec4 fieldBoundsMin;               // Domain covered by the vector field
+            glm::vec4 fieldBoundsMax;
+            uint32_t fieldSlotA;                    // Field slots holding the current and next keyframes
+            uint32_t fieldSlotB;
+            float fieldBlend;                       // Interpolation factor between the two keyframes
+            float fieldCoupling = 20.0f;            // How fast particles match the field velocity
+            float fieldScale = 1.0f;                // Field vectors to velocity
+            float pad2[3];
+            glm::vec4 gridOrigin;                   // w: cell size
+            uint32_t gridDim = GRID_DIM;
+            uint32_t demEnabled = 0;
+            float demStiffness = 2.0e4f;            // Contact spring
+            float demDamping = 20.0f;               // Contact dashpot
+            uint32_t blockTimesteps = 0;
+            uint32_t blockLevelCount;
+            float blockAccuracy = 0.01f;            // Fraction of the local dynamical time used as timestep
+            uint32_t trailSlot;                     // History slot written by the trail pass
         } ubo;
     } m_compute;
 
+    // Uniform grid of the particle - particle contacts, built by a counting sort of the particles over the cells
+    struct {
+        BufferWrapper cellCounts;
+        BufferWrapper cellStarts;
+        BufferWrapper blockSums;                    // Per scan block totals
+        BufferWrapper particleCells;                // Cell and rank in the cell of every particle
+        BufferWrapper sortedIndices;                // Particle indices ordered by cell
+        BufferWrapper contactAccelerations;
+        VkPipeline countPipeline;
+        std::array<VkPipeline, GRID_SCAN_PASS_COUNT> scanPipelines;
+        VkPipeline scatterPipeline;
+        VkPipeline contactsPipeline;
+    } m_grid;
+
+    // Upload of the vector field keyframes, a few slices per frame on the compute queue
+    struct {
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        BufferWrapper stagingBuffer;
+        uint32_t keyframe = 0;                      // Keyframe blended from, the next two ones follow in the slots
+        uint32_t streamedSlices = 0;                // Slices of keyframe + 2 already uploaded
+        float time = 0.0f;                          // Simulation time elapsed since the current keyframe
+    } m_fieldStream;
+
     struct {
         Texture2D particle;
+        Texture3D sdf;
+        std::array<Texture3D, FIELD_SLOT_COUNT> field;
     } m_textures;
 
-    ParticleSimulation();
+    // Per level particle lists of the block timesteps
+    struct {
+        BufferWrapper levelDispatches;              // One BlockLevelDispatch per level
+        BufferWrapper levelIndices;                 // BLOCK_MAX_LEVELS lists of PARTICLE_COUNT indices
+        VkPipeline binPipeline;
+        VkPipeline dispatchPipeline;
+    } m_blockTimesteps;
+
+    // Species table, read by the simulation and by the particle vertex shader for the colors
+    struct {
+        BufferWrapper uniformBuffer;
+        std::array<Species, MAX_SPECIES> table;
+        std::vector<std::string> names;
+        int32_t selected = 0;                       // Species edited in the UI
+    } m_species;
+
+    // Checksums of the particle state, reduced on the GPU in deterministic mode
+    struct {
+        BufferWrapper buffer;                       // Two 32 bit sums, read back by the host
+        VkPipeline pipeline;
+        uint64_t step = 0;                          // Simulation steps submitted so far
+        bool pending = false;                       // The last submission computes a checksum
+    } m_checksum;
+
+    SdfCollider m_collider;
+    VectorField m_vectorField;
+
+    // Host backend integrating the particles in place of simulation.comp, null when the GPU one is used
+    std::unique_ptr<ThreadPool> m_threadPool;
+    std::unique_ptr<SimulationBackend> m_cpuBackend;
+
+    // Hybrid backend: particles [0, gpuCount) are integrated by the compute shader and the rest by m_cpuBackend,
+    // both write the mapped storage buffer that the particle pipeline reads as vertex buffer
+    struct {
+        bool enabled = false;
+        bool adaptive = true;                       // The split follows the measured throughput of both sides
+        float gpuShare = 0.5f;
+        uint32_t gpuCount = PARTICLE_COUNT;         // Multiple of SIMULATION_WORKGROUP_SIZE
+        VkQueryPool queryPool = VK_NULL_HANDLE;     // Timestamps around the GPU dispatches, null when not supported
+        uint64_t timestampMask = 0;
+        bool timestampsPending = false;
+        double gpuTime = 0.0;                       // Milliseconds spent by each side on the last frame
+        double cpuTime = 0.0;
+    } m_hybrid;
+
+    // Ring of host copies of the storage buffer, see RequestParticles()
+    ParticleReadback m_readback;
+
+    // Host side of the simulation saved next to the particles, the state block of SimulationSnapshot
+    struct SnapshotState {
+        uint64_t step;                              // Simulation steps taken
+        uint32_t seed;                              // Seed of the initial particles, the host draws no other random numbers
+        uint32_t fieldKeyframe;
+        float fieldTime;
+        float attractorTimer;
+        float simulationTime;
+        int32_t integrator;
+        int32_t substeps;
+        int32_t gridRebuildInterval;
+        int32_t blockLevelCount;
+        uint32_t contacts;
+        uint32_t blockTimesteps;
+        decltype(m_compute.ubo) computeUbo;
+        std::array<Species, MAX_SPECIES> species;
+    };
+
+    // Restored from the mapped file while the resources are prepared, saved from a copy of the particles taken
+    // after a simulation step so that the simulation does not wait for it
+    struct {
+        SimulationSnapshot restore;                 // Open until Prepare() is done with it
+        SimulationSnapshot writer;
+        bool requested = false;                     // Saves the next simulation step
+        uint32_t seed = 0;                          // Seed of the initial particles
+    } m_snapshot;
+
+    // Positions of every recordInterval-th step, copied back without waiting on the GPU and written by the recorder
+    struct {
+        TrajectoryRecorder recorder;
+        uint32_t pendingCopies = 0;                 // Requested copies not delivered yet
+        uint64_t lastStep = 0;                      // Step of the last submitted frame, steps start at 1
+    } m_recording;
+
+    // Errors of one kind of component over every compared step
+    struct ValidationStats {
+        double maxError = 0.0;
+        double sumError = 0.0;
+        int64_t maxUlps = 0;
+        uint64_t components = 0;
+        uint64_t outliers = 0;                      // Out of tolerance
+        uint64_t nonFinite = 0;                     // NaN or infinite on either side, never tolerated
+    };
+
+    // Compute shader results checked step by step against the scalar host backend: the reference takes each step
+    // from the GPU state of the step before, so that the errors do not build up and a collision that goes the other
+    // way on one side stays a single outlier instead of sending the particle on another path
+    struct {
+        std::unique_ptr<SimulationBackend> reference;
+        std::vector<Particle> particles;            // GPU state of the last delivered step
+        uint64_t step = 0;                          // Step the particles are after
+        struct PendingStep {
+            uint64_t step;
+            SimulationStepParams params;
+            int32_t substeps;
+        };
+        std::deque<PendingStep> pending;            // Submitted steps waiting for the copy of their result
+        uint32_t steps = 0;                         // Steps submitted so far
+        uint32_t deliveredSteps = 0;
+        uint32_t comparedSteps = 0;                 // A copy delayed past a step only resynchronizes the reference
+        ValidationStats positions;
+        ValidationStats velocities;
+    } m_validation;
+
+    ParticleSimulation(const SimulationOptions& options = SimulationOptions());
     virtual ~ParticleSimulation();
 
     virtual void Render();
     virtual void Prepare();
+
+    // Copy of particles [first, first + count) after the next simulation step, without waiting on the GPU
+    // The callback runs on the render thread one frame later, the particles are only valid during the call
+    void RequestParticles(uint32_t first, uint32_t count, ParticleReadback::Callback callback);
+
+    // Non zero when the validation failed
+    int GetExitCode() const { return m_exitCode; }
 private:
 
     void PrepareGraphics();
@@ -107,8 +496,15 @@ private:
     void PrepareCubePipeline();
 
     void PrepareStorageBuffers();
+    void PrepareGridBuffers();
+    void PrepareBlockTimestepBuffers();
     void PrepareCubeVextexBuffers();
     void PrepareUniformBuffers();
+    void PrepareSpecies();
+    void PrepareCulling();
+    void PrepareSplatting();
+    void PrepareDepthSort();
+    void PrepareTrails();
 
     void Draw();
     void LoadAssets();
@@ -118,16 +514,56 @@ private:
     void SetupParticleDescriptorSet();
 
     virtual void BuildCommandBuffers();
+    void RecordDrawCommandBuffer();
     void BuildComputeCommandBuffer();
+    void RecordSimulationStep(VkCommandBuffer commandBuffer);
+    void RecordOwnershipTransfer(VkCommandBuffer commandBuffer, uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex,
+        VkPipelineStageFlags srcStageMask, VkAccessFlags srcAccessMask, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask);
+    void RecordGridBuild(VkCommandBuffer commandBuffer);
+    void RecordBlockTimesteps(VkCommandBuffer commandBuffer);
+    void RecordCulling(VkCommandBuffer commandBuffer);
+    void RecordSplatting(VkCommandBuffer commandBuffer);
+    void RecordDepthSort(VkCommandBuffer commandBuffer);
+    void RecordTrailStore(VkCommandBuffer commandBuffer);
+    void RunSortBenchmark();
+    SimulationStepParams BuildStepParams() const;
+    void StepCpuBackend(uint32_t firstParticle);
+    void StepValidation();
+    void CompareValidationStep(const Particle* particles, uint64_t copiedStep);
+    void ReportValidation();
+    void UpdateHybridSplit();
+    void UpdateSpriteCap();
+    void UpdateLodThreshold();
+    void UpdateFixedRate();
+    void UpdateTrails();
+    void RequestStepReadbacks();
+    void RequestSnapshot(uint64_t step);
+    void RequestTrajectoryFrame(uint64_t step);
+    void RestoreSnapshotState();
+    const SnapshotState* GetRestoredState() const;
+    void PrepareFieldStreaming();
+    void StreamFieldSlices();
+    void UpdateFieldKeyframes();
     void UpdateUniformBuffers();
     void UpdateViewUniformBuffers();
+    void PrepareChecksum();
+    void RecordChecksum(VkCommandBuffer commandBuffer);
+    void ReadChecksum();
+    float SimulationFrameTime() const;
 
     virtual void OnUpdateUIOverlay(VulkanIamGuiWrapper* ui);
     virtual void OnViewChanged();
+    virtual void GetEnabledFeatures();
 
     std::vector<VkFence> m_queueCompleteFences;
 
+    SimulationOptions m_options;
+
     bool m_attractorMouse;
+    float m_attractorTimer = 0.0f;                  // Fraction of the attractor cycle
+    float m_simulationTime = 0.0f;                  // Simulated time since the initial state
+
+    int m_exitCode = 0;
 
     uint32_t m_indexCount;
 };
@@ -0,0 +1,352 @@
+#include <SdfCollider.h>
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+    const char kCacheMagic[4] = { 'S', 'D', 'F', '1' };
+
+    float BoxDistance(const glm::vec3& position, const glm::vec3& center, const glm::vec3& halfExtents)
+    {
+        glm::vec3 q = glm::abs(position - center) - halfExtents;
+        return glm::length(glm::max(q, glm::vec3(0.0f))) + std::min(std::max(q.x, std::max(q.y, q.z)), 0.0f);
+    }
+
+    // Closest point on a triangle, from Real-Time Collision Detection (C. Ericson)
+    glm::vec3 ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        glm::vec3 ab = b - a;
+        glm::vec3 ac = c - a;
+        glm::vec3 ap = p - a;
+        float d1 = glm::dot(ab, ap);
+        float d2 = glm::dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f) {
+            return a;
+        }
+
+        glm::vec3 bp = p - b;
+        float d3 = glm::dot(ab, bp);
+        float d4 = glm::dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3) {
+            return b;
+        }
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+            return a + ab * (d1 / (d1 - d3));
+        }
+
+        glm::vec3 cp = p - c;
+        float d5 = glm::dot(ab, cp);
+        float d6 = glm::dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6) {
+            return c;
+        }
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+            return a + ac * (d2 / (d2 - d6));
+        }
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+            return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        }
+
+        float denom = 1.0f / (va + vb + vc);
+        return a + ab * (vb * denom) + ac * (vc * denom);
+    }
+
+    // Does the ray from p towards +x cross the triangle
+    bool RayCrossesTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        // Project on the yz plane and check if p lies inside the triangle
+        glm::vec2 pa = glm::vec2(a.y, a.z) - glm::vec2(p.y, p.z);
+        glm::vec2 pb = glm::vec2(b.y, b.z) - glm::vec2(p.y, p.z);
+        glm::vec2 pc = glm::vec2(c.y, c.z) - glm::vec2(p.y, p.z);
+        float w0 = pb.x * pc.y - pb.y * pc.x;
+        float w1 = pc.x * pa.y - pc.y * pa.x;
+        float w2 = pa.x * pb.y - pa.y * pb.x;
+        if (!((w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f) || (w0 <= 0.0f && w1 <= 0.0f && w2 <= 0.0f))) {
+            return false;
+        }
+
+        float sum = w0 + w1 + w2;
+        if (sum == 0.0f) {
+            return false;
+        }
+
+        // Intersection abscissa from the barycentric coordinates
+        float x = (w0 * a.x + w1 * b.x + w2 * c.x) / sum;
+        return x > p.x;
+    }
+
+    void HashBytes(uint64_t& hash, const void* data, size_t size)
+    {
+        // FNV-1a
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    }
+
+} // anonymous
+
+SdfCollider::SdfCollider()
+{
+}
+
+SdfCollider::~SdfCollider()
+{
+}
+
+void SdfCollider::AddBox(const glm::vec3& center, const glm::vec3& halfExtents, bool container)
+{
+    m_primitives.push_back({ PRIMITIVE_BOX, container ? 1u : 0u, center, halfExtents });
+}
+
+void SdfCollider::AddSphere(const glm::vec3& center, float radius)
+{
+    m_primitives.push_back({ PRIMITIVE_SPHERE, 0u, center, glm::vec3(radius, 0.0f, 0.0f) });
+}
+
+bool SdfCollider::AddMesh(const std::string& filename, const glm::vec3& translation, float scale)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Could not open collider mesh " << filename << "\n";
+        return false;
+    }
+
+    // Minimal .obj reader: positions and (possibly polygonal) faces
+    // A malformed face fails the whole load, the collider keeps none of the mesh triangles
+    std::vector<glm::vec3> vertices;
+    std::vector<Triangle> triangles;
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+        if (keyword == "v")
+        {
+            glm::vec3 vertex;
+            stream >> vertex.x >> vertex.y >> vertex.z;
+            vertices.push_back(vertex * scale + translation);
+        }
+        else if (keyword == "f")
+        {
+            std::vector<uint32_t> face;
+            std::string token;
+            while (stream >> token)
+            {
+                // "v", "v/vt", "v//vn" or "v/vt/vn", negative indices are relative to the end
+                const char* begin = token.c_str();
+                char* end = nullptr;
+                errno = 0;
+                long index = std::strtol(begin, &end, 10);
+                bool valid = end != begin && (*end == '\0' || *end == '/') && errno != ERANGE;
+                long vertexCount = static_cast<long>(vertices.size());
+                if (valid && index > 0 && index <= vertexCount)
+                {
+                    face.push_back(static_cast<uint32_t>(index - 1));
+                }
+                else if (valid && index < 0 && -index <= vertexCount)
+                {
+                    face.push_back(static_cast<uint32_t>(vertexCount + index));
+                }
+                else
+                {
+                    std::cerr << "Invalid face vertex \"" << token << "\" in collider mesh " << filename << " line " << lineNumber << "\n";
+                    return false;
+                }
+            }
+            // Fan triangulation
+            for (size_t i = 2; i < face.size(); ++i)
+            {
+                triangles.push_back({ vertices[face[0]], vertices[face[i - 1]], vertices[face[i]] });
+            }
+        }
+    }
+
+    m_triangles.insert(m_triangles.end(), triangles.begin(), triangles.end());
+    return true;
+}
+
+float SdfCollider::MeshDistance(const glm::vec3& position) const
+{
+    // Voxel centers are on a regular grid and can fall exactly on the shared edges of the triangles,
+    // the ray origin is slightly jittered so that an edge is never counted twice
+    glm::vec3 rayOrigin = position + glm::vec3(0.0f, 1.31e-5f, 2.17e-5f);
+
+    float closest = std::numeric_limits<float>::max();
+    uint32_t crossings = 0;
+    for (const auto& triangle : m_triangles)
+    {
+        glm::vec3 delta = position - ClosestPointOnTriangle(position, triangle.a, triangle.b, triangle.c);
+        closest = std::min(closest, glm::dot(delta, delta));
+        crossings += RayCrossesTriangle(rayOrigin, triangle.a, triangle.b, triangle.c) ? 1 : 0;
+    }
+
+    // An odd number of crossings means the position is inside the closed mesh
+    float distance = std::sqrt(closest);
+    return (crossings & 1) ? -distance : distance;
+}
+
+float SdfCollider::Distance(const glm::vec3& position) const
+{
+    // Union of every primitive: the free space is the intersection of their outsides
+    float distance = std::numeric_limits<float>::max();
+    for (const auto& primitive : m_primitives)
+    {
+        float primitiveDistance = 0.0f;
+        switch (primitive.type)
+        {
+        case PRIMITIVE_BOX:
+            primitiveDistance = BoxDistance(position, primitive.center, primitive.size);
+            break;
+        case PRIMITIVE_SPHERE:
+            primitiveDistance = glm::length(position - primitive.center) - primitive.size.x;
+            break;
+        }
+        distance = std::min(distance, primitive.container ? -primitiveDistance : primitiveDistance);
+    }
+
+    if (!m_triangles.empty()) {
+        distance = std::min(distance, MeshDistance(position));
+    }
+
+    return distance;
+}
+
+uint64_t SdfCollider::Hash() const
+{
+    uint64_t hash = 14695981039346656037ull;
+    HashBytes(hash, &m_resolution, sizeof(m_resolution));
+    HashBytes(hash, &m_boundsMin, sizeof(m_boundsMin));
+    HashBytes(hash, &m_boundsMax, sizeof(m_boundsMax));
+    for (const auto& primitive : m_primitives) {
+        HashBytes(hash, &primitive, sizeof(Primitive));
+    }
+    if (!m_triangles.empty()) {
+        HashBytes(hash, m_triangles.data(), m_triangles.size() * sizeof(Triangle));
+    }
+    return hash;
+}
+
+void SdfCollider::Bake(uint32_t resolution, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::string& cacheDirectory)
+{
+    m_resolution = resolution;
+    m_boundsMin = boundsMin;
+    m_boundsMax = boundsMax;
+
+    std::ostringstream cacheFilename;
+    cacheFilename << cacheDirectory << "/sdf_" << std::hex << Hash() << ".bin";
+    if (!LoadCache(cacheFilename.str())) {
+        // Distances are evaluated at the voxel centers, as expected by the texture sampler
+        m_distances.resize(static_cast<size_t>(resolution) * resolution * resolution);
+        glm::vec3 voxelSize = (m_boundsMax - m_boundsMin) / static_cast<float>(resolution);
+        for (uint32_t z = 0; z < resolution; ++z)
+        {
+            for (uint32_t y = 0; y < resolution; ++y)
+            {
+                for (uint32_t x = 0; x < resolution; ++x)
+                {
+                    glm::vec3 position = m_boundsMin + (glm::vec3(x, y, z) + 0.5f) * voxelSize;
+                    m_distances[(static_cast<size_t>(z) * resolution + y) * resolution + x] = Distance(position);
+                }
+            }
+        }
+
+        SaveCache(cacheFilename.str());
+    }
+
+    // The texture holds the distances rounded to 16 bit floats, the host samples the same values
+    m_sampledDistances.resize(m_distances.size());
+    std::transform(m_distances.begin(), m_distances.end(), m_sampledDistances.begin(), [](float distance) {
+        return glm::unpackHalf1x16(glm::packHalf1x16(distance));
+    });
+}
+
+float SdfCollider::Sample(const glm::vec3& position) const
+{
+    glm::vec3 texel = (position - m_boundsMin) / (m_boundsMax - m_boundsMin) * static_cast<float>(m_resolution) - 0.5f;
+    texel = glm::clamp(texel, glm::vec3(0.0f), glm::vec3(static_cast<float>(m_resolution - 1)));
+
+    glm::uvec3 i0 = glm::uvec3(texel);
+    glm::uvec3 i1 = glm::min(i0 + 1u, glm::uvec3(m_resolution - 1));
+    glm::vec3 t = texel - glm::vec3(i0);
+
+    auto at = [this](uint32_t x, uint32_t y, uint32_t z) {
+        return m_sampledDistances[(static_cast<size_t>(z) * m_resolution + y) * m_resolution + x];
+    };
+
+    float c00 = glm::mix(at(i0.x, i0.y, i0.z), at(i1.x, i0.y, i0.z), t.x);
+    float c10 = glm::mix(at(i0.x, i1.y, i0.z), at(i1.x, i1.y, i0.z), t.x);
+    float c01 = glm::mix(at(i0.x, i0.y, i1.z), at(i1.x, i0.y, i1.z), t.x);
+    float c11 = glm::mix(at(i0.x, i1.y, i1.z), at(i1.x, i1.y, i1.z), t.x);
+    return glm::mix(glm::mix(c00, c10, t.y), glm::mix(c01, c11, t.y), t.z);
+}
+
+std::vector<uint16_t> SdfCollider::GetHalfData() const
+{
+    std::vector<uint16_t> halfData(m_distances.size());
+    std::transform(m_distances.begin(), m_distances.end(), halfData.begin(), [](float distance) {
+        return glm::packHalf1x16(distance);
+    });
+    return halfData;
+}
+
+bool SdfCollider::LoadCache(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t resolution = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&resolution), sizeof(resolution));
+    if (!file || std::memcmp(magic, kCacheMagic, sizeof(kCacheMagic)) != 0 || resolution != m_resolution) {
+        return false;
+    }
+
+    m_distances.resize(static_cast<size_t>(resolution) * resolution * resolution);
+    file.read(reinterpret_cast<char*>(m_distances.data()), m_distances.size() * sizeof(float));
+    if (!file) {
+        m_distances.clear();
+        return false;
+    }
+    return true;
+}
+
+void SdfCollider::SaveCache(const std::string& filename) const
+{
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(filename).parent_path(), error);
+
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Could not write the collider cache " << filename << "\n";
+        return;
+    }
+
+    file.write(kCacheMagic, sizeof(kCacheMagic));
+    file.write(reinterpret_cast<const char*>(&m_resolution), sizeof(m_resolution));
+    file.write(reinterpret_cast<const char*>(m_distances.data()), m_distances.size() * sizeof(float));
+}
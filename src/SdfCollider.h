@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Static collision geometry baked into a signed distance field sampled by the simulation
+// Distances are positive in the free space and negative inside the geometry
+class SdfCollider
+{
+public:
+    SdfCollider();
+    ~SdfCollider();
+
+    // Scene description, to be filled before Bake()
+    // A container keeps the particles inside the primitive instead of outside
+    void AddBox(const glm::vec3& center, const glm::vec3& halfExtents, bool container = false);
+    void AddSphere(const glm::vec3& center, float radius);
+    // Load a closed triangle mesh (.obj) that is voxelized during the bake
+    bool AddMesh(const std::string& filename, const glm::vec3& translation = glm::vec3(0.0f), float scale = 1.0f);
+
+    // Bake the field over [boundsMin, boundsMax] with resolution^3 voxels
+    // The result is cached in cacheDirectory, keyed on the scene description
+    void Bake(uint32_t resolution, const glm::vec3& boundsMin, const glm::vec3& boundsMax, const std::string& cacheDirectory);
+
+    // Trilinear lookup of the sampled distances matching the hardware sampler with clamp to edge addressing
+    float Sample(const glm::vec3& position) const;
+
+    // Field converted to 16 bit floats for the R16_SFLOAT texture
+    std::vector<uint16_t> GetHalfData() const;
+
+    uint32_t GetResolution() const { return m_resolution; }
+    const glm::vec3& GetBoundsMin() const { return m_boundsMin; }
+    const glm::vec3& GetBoundsMax() const { return m_boundsMax; }
+    const std::vector<float>& GetDistances() const { return m_distances; }
+    // Distances as the texture holds them, rounded to 16 bit floats
+    const std::vector<float>& GetSampledDistances() const { return m_sampledDistances; }
+
+private:
+    enum PrimitiveType : uint32_t {
+        PRIMITIVE_BOX = 0,
+        PRIMITIVE_SPHERE,
+    };
+
+    struct Primitive {
+        uint32_t type;
+        uint32_t container;
+        glm::vec3 center;
+        glm::vec3 size;     // Half extents for boxes, radius in x for spheres
+    };
+
+    struct Triangle {
+        glm::vec3 a;
+        glm::vec3 b;
+        glm::vec3 c;
+    };
+
+    float Distance(const glm::vec3& position) const;
+    float MeshDistance(const glm::vec3& position) const;
+    uint64_t Hash() const;
+
+    bool LoadCache(const std::string& filename);
+    void SaveCache(const std::string& filename) const;
+
+    std::vector<Primitive> m_primitives;
+    std::vector<Triangle> m_triangles;
+
+    uint32_t m_resolution = 0;
+    glm::vec3 m_boundsMin = glm::vec3(-1.0f);
+    glm::vec3 m_boundsMax = glm::vec3(1.0f);
+    std::vector<float> m_distances;
+    std::vector<float> m_sampledDistances;
+};
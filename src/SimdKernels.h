@@ -0,0 +1,50 @@
+#pragma once
+
+#include <CpuSimulationBackend.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_KERNELS_X86 1
+#else
+#define SIMD_KERNELS_X86 0
+#endif
+
+// Plain data view of the collider field, see SdfCollider::Sample
+struct SdfView {
+    const float* distances;
+    uint32_t resolution;
+    float boundsMin[3];
+    float texelsPerUnit[3];
+    float texelSize[3];             // Offsets of the normal central differences
+};
+
+// Plain data view of the two blended field keyframes, see VectorField::Sample
+struct FieldView {
+    const uint16_t* frameA;         // 4 half floats per voxel
+    const uint16_t* frameB;
+    uint32_t size[3];
+    float boundsMin[3];
+    float texelsPerUnit[3];
+    float blend;
+    float scale;
+};
+
+// Hand vectorized per lane lookups and arithmetic of CpuSimulationBackend, one table per instruction set
+// Each table lives in its own translation unit compiled for that instruction set (see src/CMakeLists.txt),
+// nothing in it may be called before SimdSimulationBackend checked the CPU support
+// Those files only touch plain data: inline glm functions emitted there would be compiled for their instruction set
+struct SimdKernels {
+    const char* name;
+    uint32_t width;                 // Floats per register
+
+    void (*sampleField)(const CpuSimulationBackend::Lanes3& pos, const FieldView& field, CpuSimulationBackend::Lanes3& fieldVel);
+    void (*sampleCollider)(const CpuSimulationBackend::Batch& batch, const SdfView& sdf, float* distance, CpuSimulationBackend::Lanes3& normal);
+    void (*acceleration)(const CpuSimulationBackend::Batch& batch, const CpuSimulationBackend::Lanes3& pos, const CpuSimulationBackend::Lanes3& vel,
+        const CpuSimulationBackend::Lanes3& fieldVel, const glm::vec3& attractor, float fieldCoupling, CpuSimulationBackend::Lanes3& acceleration);
+    void (*multiplyAdd)(CpuSimulationBackend::Lanes3& out, const CpuSimulationBackend::Lanes3& a, const CpuSimulationBackend::Lanes3& b, float scale);
+    void (*collisionResponse)(CpuSimulationBackend::Batch& batch, const float* distance, const CpuSimulationBackend::Lanes3& normal, float restitution);
+};
+
+// Null when the kernels are not built for the target architecture
+const SimdKernels* GetSse4Kernels();
+const SimdKernels* GetAvx2Kernels();
+const SimdKernels* GetAvx512Kernels();
@@ -0,0 +1,240 @@
+// Per lane kernels of SimdKernels, written once against the register wrapper ISA of the including file
+// ISA provides Width, the Float / Int / Mask register types and their load, arithmetic, compare, select and gather functions
+// Included inside an anonymous namespace so that every instruction set keeps its own instantiations
+
+using Batch = CpuSimulationBackend::Batch;
+using Lanes3 = CpuSimulationBackend::Lanes3;
+
+static_assert(CpuSimulationBackend::BatchSize % ISA::Width == 0, "Batches must be a multiple of the register width");
+
+// 1 / sqrt(x) from the hardware estimate refined by one Newton step: y * (1.5 - 0.5 * x * y * y)
+inline ISA::Float RsqrtNewton(ISA::Float x)
+{
+    ISA::Float y = ISA::RsqrtEstimate(x);
+    return ISA::Mul(y, ISA::NegMulAdd(ISA::Mul(ISA::Set(0.5f), x), ISA::Mul(y, y), ISA::Set(1.5f)));
+}
+
+inline ISA::Float Lerp(ISA::Float a, ISA::Float b, ISA::Float t)
+{
+    return ISA::MulAdd(ISA::Sub(b, a), t, a);
+}
+
+// Corner indices and weight of a trilinear lookup along one axis, clamped to the border voxels
+inline void TexelCoordinates(ISA::Float position, float boundsMin, float texelsPerUnit, uint32_t size, ISA::Int& i0, ISA::Int& i1, ISA::Float& t)
+{
+    ISA::Float texel = ISA::MulAdd(ISA::Sub(position, ISA::Set(boundsMin)), ISA::Set(texelsPerUnit), ISA::Set(-0.5f));
+    texel = ISA::Min(ISA::Max(texel, ISA::Set(0.0f)), ISA::Set(static_cast<float>(size - 1)));
+    i0 = ISA::ToInt(texel);
+    i1 = ISA::IntMin(ISA::IntAdd(i0, ISA::IntSet(1)), ISA::IntSet(static_cast<int32_t>(size - 1)));
+    t = ISA::Sub(texel, ISA::ToFloat(i0));
+}
+
+// Half floats held in the low 16 bits of each lane, finite values only
+// The magnitude bits are moved to the float exponent / mantissa position and rebiased by 2^112, denormals included
+inline ISA::Float HalfToFloat(ISA::Int half)
+{
+    ISA::Int magnitude = ISA::ShiftLeft(ISA::IntAnd(half, ISA::IntSet(0x7fff)), 13);
+    ISA::Int sign = ISA::ShiftLeft(ISA::IntAnd(half, ISA::IntSet(0x8000)), 16);
+    ISA::Float value = ISA::Mul(ISA::AsFloat(magnitude), ISA::Set(5.192296858534828e33f));
+    return ISA::AsFloat(ISA::IntOr(ISA::AsInt(value), sign));
+}
+
+inline ISA::Float SampleSdf(const SdfView& sdf, ISA::Float x, ISA::Float y, ISA::Float z)
+{
+    ISA::Int x0, x1, y0, y1, z0, z1;
+    ISA::Float tx, ty, tz;
+    TexelCoordinates(x, sdf.boundsMin[0], sdf.texelsPerUnit[0], sdf.resolution, x0, x1, tx);
+    TexelCoordinates(y, sdf.boundsMin[1], sdf.texelsPerUnit[1], sdf.resolution, y0, y1, ty);
+    TexelCoordinates(z, sdf.boundsMin[2], sdf.texelsPerUnit[2], sdf.resolution, z0, z1, tz);
+
+    // Row starts (z * resolution + y) * resolution of the four corner rows
+    ISA::Int resolution = ISA::IntSet(static_cast<int32_t>(sdf.resolution));
+    ISA::Int row00 = ISA::IntMul(ISA::IntAdd(ISA::IntMul(z0, resolution), y0), resolution);
+    ISA::Int row10 = ISA::IntMul(ISA::IntAdd(ISA::IntMul(z0, resolution), y1), resolution);
+    ISA::Int row01 = ISA::IntMul(ISA::IntAdd(ISA::IntMul(z1, resolution), y0), resolution);
+    ISA::Int row11 = ISA::IntMul(ISA::IntAdd(ISA::IntMul(z1, resolution), y1), resolution);
+
+    ISA::Float c00 = Lerp(ISA::Gather(sdf.distances, ISA::IntAdd(row00, x0)), ISA::Gather(sdf.distances, ISA::IntAdd(row00, x1)), tx);
+    ISA::Float c10 = Lerp(ISA::Gather(sdf.distances, ISA::IntAdd(row10, x0)), ISA::Gather(sdf.distances, ISA::IntAdd(row10, x1)), tx);
+    ISA::Float c01 = Lerp(ISA::Gather(sdf.distances, ISA::IntAdd(row01, x0)), ISA::Gather(sdf.distances, ISA::IntAdd(row01, x1)), tx);
+    ISA::Float c11 = Lerp(ISA::Gather(sdf.distances, ISA::IntAdd(row11, x0)), ISA::Gather(sdf.distances, ISA::IntAdd(row11, x1)), tx);
+    return Lerp(Lerp(c00, c10, ty), Lerp(c01, c11, ty), tz);
+}
+
+// xyz of a voxel: the first 32 bit word holds x and y, the second one z and the unused w
+inline void GatherVoxel(const int32_t* words, ISA::Int voxel, ISA::Float& x, ISA::Float& y, ISA::Float& z)
+{
+    ISA::Int first = ISA::IntAdd(voxel, voxel);
+    ISA::Int xy = ISA::GatherInt(words, first);
+    ISA::Int zw = ISA::GatherInt(words, ISA::IntAdd(first, ISA::IntSet(1)));
+    x = HalfToFloat(ISA::IntAnd(xy, ISA::IntSet(0xffff)));
+    y = HalfToFloat(ISA::ShiftRight(xy, 16));
+    z = HalfToFloat(ISA::IntAnd(zw, ISA::IntSet(0xffff)));
+}
+
+inline void SampleKeyframe(const uint16_t* frame, const ISA::Int corners[8], const ISA::Float& tx, const ISA::Float& ty, const ISA::Float& tz,
+    ISA::Float& x, ISA::Float& y, ISA::Float& z)
+{
+    const int32_t* words = reinterpret_cast<const int32_t*>(frame);
+    ISA::Float cx[8], cy[8], cz[8];
+    for (uint32_t corner = 0; corner < 8; ++corner)
+    {
+        GatherVoxel(words, corners[corner], cx[corner], cy[corner], cz[corner]);
+    }
+
+    // Corners are ordered x fastest, then y, then z
+    x = Lerp(Lerp(Lerp(cx[0], cx[1], tx), Lerp(cx[2], cx[3], tx), ty), Lerp(Lerp(cx[4], cx[5], tx), Lerp(cx[6], cx[7], tx), ty), tz);
+    y = Lerp(Lerp(Lerp(cy[0], cy[1], tx), Lerp(cy[2], cy[3], tx), ty), Lerp(Lerp(cy[4], cy[5], tx), Lerp(cy[6], cy[7], tx), ty), tz);
+    z = Lerp(Lerp(Lerp(cz[0], cz[1], tx), Lerp(cz[2], cz[3], tx), ty), Lerp(Lerp(cz[4], cz[5], tx), Lerp(cz[6], cz[7], tx), ty), tz);
+}
+
+// Blend of the two keyframes, see CpuSimulationBackend::SampleField
+void SampleFieldKernel(const Lanes3& pos, const FieldView& field, Lanes3& fieldVel)
+{
+    const ISA::Int width = ISA::IntSet(static_cast<int32_t>(field.size[0]));
+    const ISA::Int height = ISA::IntSet(static_cast<int32_t>(field.size[1]));
+    const ISA::Float blend = ISA::Set(field.blend);
+    const ISA::Float scale = ISA::Set(field.scale);
+
+    for (uint32_t i = 0; i < CpuSimulationBackend::BatchSize; i += ISA::Width)
+    {
+        ISA::Int x0, x1, y0, y1, z0, z1;
+        ISA::Float tx, ty, tz;
+        TexelCoordinates(ISA::Load(pos.x + i), field.boundsMin[0], field.texelsPerUnit[0], field.size[0], x0, x1, tx);
+        TexelCoordinates(ISA::Load(pos.y + i), field.boundsMin[1], field.texelsPerUnit[1], field.size[1], y0, y1, ty);
+        TexelCoordinates(ISA::Load(pos.z + i), field.boundsMin[2], field.texelsPerUnit[2], field.size[2], z0, z1, tz);
+
+        ISA::Int row00 = ISA::IntMul(ISA::IntAdd(ISA::IntMul(z0, height), y0), width);
+        ISA::Int row10 = ISA::IntMul(ISA::IntAdd(ISA::IntMul(z0, height), y1), width);
+        ISA::Int row01 = ISA::IntMul(ISA::IntAdd(ISA::IntMul(z1, height), y0), width);
+        ISA::Int row11 = ISA::IntMul(ISA::IntAdd(ISA::IntMul(z1, height), y1), width);
+        const ISA::Int corners[8] = {
+            ISA::IntAdd(row00, x0), ISA::IntAdd(row00, x1), ISA::IntAdd(row10, x0), ISA::IntAdd(row10, x1),
+            ISA::IntAdd(row01, x0), ISA::IntAdd(row01, x1), ISA::IntAdd(row11, x0), ISA::IntAdd(row11, x1)
+        };
+
+        ISA::Float ax, ay, az, bx, by, bz;
+        SampleKeyframe(field.frameA, corners, tx, ty, tz, ax, ay, az);
+        SampleKeyframe(field.frameB, corners, tx, ty, tz, bx, by, bz);
+        ISA::Store(fieldVel.x + i, ISA::Mul(Lerp(ax, bx, blend), scale));
+        ISA::Store(fieldVel.y + i, ISA::Mul(Lerp(ay, by, blend), scale));
+        ISA::Store(fieldVel.z + i, ISA::Mul(Lerp(az, bz, blend), scale));
+    }
+}
+
+// Distance and central difference normal, see CpuSimulationBackend::SampleCollider
+void SampleColliderKernel(const Batch& batch, const SdfView& sdf, float* distance, Lanes3& normal)
+{
+    const ISA::Float offsetX = ISA::Set(sdf.texelSize[0]);
+    const ISA::Float offsetY = ISA::Set(sdf.texelSize[1]);
+    const ISA::Float offsetZ = ISA::Set(sdf.texelSize[2]);
+
+    for (uint32_t i = 0; i < CpuSimulationBackend::BatchSize; i += ISA::Width)
+    {
+        ISA::Float x = ISA::Load(batch.pos.x + i);
+        ISA::Float y = ISA::Load(batch.pos.y + i);
+        ISA::Float z = ISA::Load(batch.pos.z + i);
+        ISA::Store(distance + i, ISA::Sub(SampleSdf(sdf, x, y, z), ISA::Load(batch.radius + i)));
+
+        ISA::Float gx = ISA::Sub(SampleSdf(sdf, ISA::Add(x, offsetX), y, z), SampleSdf(sdf, ISA::Sub(x, offsetX), y, z));
+        ISA::Float gy = ISA::Sub(SampleSdf(sdf, x, ISA::Add(y, offsetY), z), SampleSdf(sdf, x, ISA::Sub(y, offsetY), z));
+        ISA::Float gz = ISA::Sub(SampleSdf(sdf, x, y, ISA::Add(z, offsetZ)), SampleSdf(sdf, x, y, ISA::Sub(z, offsetZ)));
+
+        // Exact division here: the normal direction feeds the reflection of every colliding particle
+        ISA::Float length = ISA::Max(ISA::Sqrt(ISA::MulAdd(gx, gx, ISA::MulAdd(gy, gy, ISA::Mul(gz, gz)))), ISA::Set(1e-6f));
+        ISA::Store(normal.x + i, ISA::Div(gx, length));
+        ISA::Store(normal.y + i, ISA::Div(gy, length));
+        ISA::Store(normal.z + i, ISA::Div(gz, length));
+    }
+}
+
+// Attractor pull, field drag and linear damping, see CpuSimulationBackend::AccelerationLanes
+void AccelerationKernel(const Batch& batch, const Lanes3& pos, const Lanes3& vel, const Lanes3& fieldVel,
+    const glm::vec3& attractor, float fieldCoupling, Lanes3& acceleration)
+{
+    const ISA::Float attractorX = ISA::Set(attractor.x);
+    const ISA::Float attractorY = ISA::Set(attractor.y);
+    const ISA::Float attractorZ = ISA::Set(attractor.z);
+    const ISA::Float strength = ISA::Set(15.45f * 85.0f);
+    const ISA::Float minDistance = ISA::Set(0.5f);
+    const ISA::Float maxDistance = ISA::Set(10.0f);
+    const ISA::Float minDistanceSquared = ISA::Set(1e-24f);
+    const ISA::Float coupling = ISA::Set(fieldCoupling);
+
+    for (uint32_t i = 0; i < CpuSimulationBackend::BatchSize; i += ISA::Width)
+    {
+        ISA::Float dx = ISA::Sub(attractorX, ISA::Load(pos.x + i));
+        ISA::Float dy = ISA::Sub(attractorY, ISA::Load(pos.y + i));
+        ISA::Float dz = ISA::Sub(attractorZ, ISA::Load(pos.z + i));
+
+        // The reciprocal distance normalizes the delta, the clamped distance scales the pull
+        ISA::Float distanceSquared = ISA::MulAdd(dx, dx, ISA::MulAdd(dy, dy, ISA::Mul(dz, dz)));
+        ISA::Float invDistance = RsqrtNewton(ISA::Max(distanceSquared, minDistanceSquared));
+        ISA::Float r = ISA::Min(ISA::Max(ISA::Mul(distanceSquared, invDistance), minDistance), maxDistance);
+        ISA::Float pull = ISA::Mul(ISA::Div(strength, ISA::Mul(r, r)), ISA::Mul(invDistance, ISA::Load(batch.attractorResponse + i)));
+
+        ISA::Float fieldGain = ISA::Mul(coupling, ISA::Load(batch.chargeOverMass + i));
+        ISA::Float drag = ISA::Load(batch.drag + i);
+
+        // delta * pull + (fieldVel - vel) * fieldGain - vel * drag
+        ISA::Float vx = ISA::Load(vel.x + i);
+        ISA::Float vy = ISA::Load(vel.y + i);
+        ISA::Float vz = ISA::Load(vel.z + i);
+        ISA::Store(acceleration.x + i, ISA::MulAdd(dx, pull, ISA::NegMulAdd(vx, drag, ISA::Mul(ISA::Sub(ISA::Load(fieldVel.x + i), vx), fieldGain))));
+        ISA::Store(acceleration.y + i, ISA::MulAdd(dy, pull, ISA::NegMulAdd(vy, drag, ISA::Mul(ISA::Sub(ISA::Load(fieldVel.y + i), vy), fieldGain))));
+        ISA::Store(acceleration.z + i, ISA::MulAdd(dz, pull, ISA::NegMulAdd(vz, drag, ISA::Mul(ISA::Sub(ISA::Load(fieldVel.z + i), vz), fieldGain))));
+    }
+}
+
+// out = a + b * scale, out may alias a
+void MultiplyAddKernel(Lanes3& out, const Lanes3& a, const Lanes3& b, float scale)
+{
+    const ISA::Float s = ISA::Set(scale);
+    for (uint32_t i = 0; i < CpuSimulationBackend::BatchSize; i += ISA::Width)
+    {
+        ISA::Store(out.x + i, ISA::MulAdd(ISA::Load(b.x + i), s, ISA::Load(a.x + i)));
+        ISA::Store(out.y + i, ISA::MulAdd(ISA::Load(b.y + i), s, ISA::Load(a.y + i)));
+        ISA::Store(out.z + i, ISA::MulAdd(ISA::Load(b.z + i), s, ISA::Load(a.z + i)));
+    }
+}
+
+// Push back and reflection of the lanes inside the collider, masked instead of branched
+void CollisionResponseKernel(Batch& batch, const float* distance, const Lanes3& normal, float restitution)
+{
+    const ISA::Float zero = ISA::Set(0.0f);
+    const ISA::Float bounceScale = ISA::Set(1.0f + restitution);
+
+    for (uint32_t i = 0; i < CpuSimulationBackend::BatchSize; i += ISA::Width)
+    {
+        ISA::Float d = ISA::Load(distance + i);
+        ISA::Mask hit = ISA::LessEqual(d, zero);
+
+        ISA::Float nx = ISA::Load(normal.x + i);
+        ISA::Float ny = ISA::Load(normal.y + i);
+        ISA::Float nz = ISA::Load(normal.z + i);
+        ISA::Float vx = ISA::Load(batch.vel.x + i);
+        ISA::Float vy = ISA::Load(batch.vel.y + i);
+        ISA::Float vz = ISA::Load(batch.vel.z + i);
+
+        ISA::Float approachingSpeed = ISA::Min(ISA::MulAdd(vx, nx, ISA::MulAdd(vy, ny, ISA::Mul(vz, nz))), zero);
+        ISA::Float push = ISA::Select(hit, d);
+        ISA::Float bounce = ISA::Select(hit, ISA::Mul(bounceScale, approachingSpeed));
+
+        ISA::Store(batch.pos.x + i, ISA::NegMulAdd(push, nx, ISA::Load(batch.pos.x + i)));
+        ISA::Store(batch.pos.y + i, ISA::NegMulAdd(push, ny, ISA::Load(batch.pos.y + i)));
+        ISA::Store(batch.pos.z + i, ISA::NegMulAdd(push, nz, ISA::Load(batch.pos.z + i)));
+        ISA::Store(batch.vel.x + i, ISA::NegMulAdd(bounce, nx, vx));
+        ISA::Store(batch.vel.y + i, ISA::NegMulAdd(bounce, ny, vy));
+        ISA::Store(batch.vel.z + i, ISA::NegMulAdd(bounce, nz, vz));
+    }
+}
+
+const SimdKernels kernels = {
+    ISA::Name,
+    ISA::Width,
+    SampleFieldKernel,
+    SampleColliderKernel,
+    AccelerationKernel,
+    MultiplyAddKernel,
+    CollisionResponseKernel
+};
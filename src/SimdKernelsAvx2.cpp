@@ -0,0 +1,66 @@
+#include <SimdKernels.h>
+
+#if SIMD_KERNELS_X86
+
+#include <immintrin.h>
+
+namespace {
+
+    // 8 lanes with FMA
+    struct Avx2Registers {
+        static constexpr const char* Name = "CPU AVX2";
+        static constexpr uint32_t Width = 8;
+        using Float = __m256;
+        using Int = __m256i;
+        using Mask = __m256;
+
+        static Float Load(const float* p) { return _mm256_load_ps(p); }
+        static void Store(float* p, Float a) { _mm256_store_ps(p, a); }
+        static Float Set(float a) { return _mm256_set1_ps(a); }
+        static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+        static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+        static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+        static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+        static Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+        static Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+        static Float MulAdd(Float a, Float b, Float c) { return _mm256_fmadd_ps(a, b, c); }               // a * b + c
+        static Float NegMulAdd(Float a, Float b, Float c) { return _mm256_fnmadd_ps(a, b, c); }           // c - a * b
+        static Float RsqrtEstimate(Float a) { return _mm256_rsqrt_ps(a); }
+        static Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+        static Mask LessEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+        static Float Select(Mask m, Float a) { return _mm256_and_ps(m, a); }                              // a where m, 0 elsewhere
+
+        static Int IntSet(int32_t a) { return _mm256_set1_epi32(a); }
+        static Int IntAdd(Int a, Int b) { return _mm256_add_epi32(a, b); }
+        static Int IntMul(Int a, Int b) { return _mm256_mullo_epi32(a, b); }
+        static Int IntMin(Int a, Int b) { return _mm256_min_epi32(a, b); }
+        static Int IntAnd(Int a, Int b) { return _mm256_and_si256(a, b); }
+        static Int IntOr(Int a, Int b) { return _mm256_or_si256(a, b); }
+        static Int ShiftLeft(Int a, int bits) { return _mm256_slli_epi32(a, bits); }
+        static Int ShiftRight(Int a, int bits) { return _mm256_srli_epi32(a, bits); }
+        static Int ToInt(Float a) { return _mm256_cvttps_epi32(a); }
+        static Float ToFloat(Int a) { return _mm256_cvtepi32_ps(a); }
+        static Float AsFloat(Int a) { return _mm256_castsi256_ps(a); }
+        static Int AsInt(Float a) { return _mm256_castps_si256(a); }
+        static Float Gather(const float* base, Int index) { return _mm256_i32gather_ps(base, index, 4); }
+        static Int GatherInt(const int32_t* base, Int index) { return _mm256_i32gather_epi32(reinterpret_cast<const int*>(base), index, 4); }
+    };
+
+    using ISA = Avx2Registers;
+#include <SimdKernels.inl>
+
+} // anonymous
+
+const SimdKernels* GetAvx2Kernels()
+{
+    return &kernels;
+}
+
+#else
+
+const SimdKernels* GetAvx2Kernels()
+{
+    return nullptr;
+}
+
+#endif
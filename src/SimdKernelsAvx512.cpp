@@ -0,0 +1,66 @@
+#include <SimdKernels.h>
+
+#if SIMD_KERNELS_X86
+
+#include <immintrin.h>
+
+namespace {
+
+    // 16 lanes, a whole batch per register, with mask registers for the selects
+    struct Avx512Registers {
+        static constexpr const char* Name = "CPU AVX-512";
+        static constexpr uint32_t Width = 16;
+        using Float = __m512;
+        using Int = __m512i;
+        using Mask = __mmask16;
+
+        static Float Load(const float* p) { return _mm512_load_ps(p); }
+        static void Store(float* p, Float a) { _mm512_store_ps(p, a); }
+        static Float Set(float a) { return _mm512_set1_ps(a); }
+        static Float Add(Float a, Float b) { return _mm512_add_ps(a, b); }
+        static Float Sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+        static Float Mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+        static Float Div(Float a, Float b) { return _mm512_div_ps(a, b); }
+        static Float Min(Float a, Float b) { return _mm512_min_ps(a, b); }
+        static Float Max(Float a, Float b) { return _mm512_max_ps(a, b); }
+        static Float MulAdd(Float a, Float b, Float c) { return _mm512_fmadd_ps(a, b, c); }               // a * b + c
+        static Float NegMulAdd(Float a, Float b, Float c) { return _mm512_fnmadd_ps(a, b, c); }           // c - a * b
+        static Float RsqrtEstimate(Float a) { return _mm512_rsqrt14_ps(a); }
+        static Float Sqrt(Float a) { return _mm512_sqrt_ps(a); }
+        static Mask LessEqual(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+        static Float Select(Mask m, Float a) { return _mm512_maskz_mov_ps(m, a); }                       // a where m, 0 elsewhere
+
+        static Int IntSet(int32_t a) { return _mm512_set1_epi32(a); }
+        static Int IntAdd(Int a, Int b) { return _mm512_add_epi32(a, b); }
+        static Int IntMul(Int a, Int b) { return _mm512_mullo_epi32(a, b); }
+        static Int IntMin(Int a, Int b) { return _mm512_min_epi32(a, b); }
+        static Int IntAnd(Int a, Int b) { return _mm512_and_si512(a, b); }
+        static Int IntOr(Int a, Int b) { return _mm512_or_si512(a, b); }
+        static Int ShiftLeft(Int a, int bits) { return _mm512_slli_epi32(a, bits); }
+        static Int ShiftRight(Int a, int bits) { return _mm512_srli_epi32(a, bits); }
+        static Int ToInt(Float a) { return _mm512_cvttps_epi32(a); }
+        static Float ToFloat(Int a) { return _mm512_cvtepi32_ps(a); }
+        static Float AsFloat(Int a) { return _mm512_castsi512_ps(a); }
+        static Int AsInt(Float a) { return _mm512_castps_si512(a); }
+        static Float Gather(const float* base, Int index) { return _mm512_i32gather_ps(index, base, 4); }
+        static Int GatherInt(const int32_t* base, Int index) { return _mm512_i32gather_epi32(index, base, 4); }
+    };
+
+    using ISA = Avx512Registers;
+#include <SimdKernels.inl>
+
+} // anonymous
+
+const SimdKernels* GetAvx512Kernels()
+{
+    return &kernels;
+}
+
+#else
+
+const SimdKernels* GetAvx512Kernels()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include <SimdKernels.h>
+
+#if SIMD_KERNELS_X86
+
+#include <smmintrin.h>
+
+namespace {
+
+    // 4 lanes, no FMA before AVX2: the multiply adds are split
+    struct Sse4Registers {
+        static constexpr const char* Name = "CPU SSE4.1";
+        static constexpr uint32_t Width = 4;
+        using Float = __m128;
+        using Int = __m128i;
+        using Mask = __m128;
+
+        static Float Load(const float* p) { return _mm_load_ps(p); }
+        static void Store(float* p, Float a) { _mm_store_ps(p, a); }
+        static Float Set(float a) { return _mm_set1_ps(a); }
+        static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+        static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+        static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+        static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+        static Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+        static Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+        static Float MulAdd(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }        // a * b + c
+        static Float NegMulAdd(Float a, Float b, Float c) { return _mm_sub_ps(c, _mm_mul_ps(a, b)); }     // c - a * b
+        static Float RsqrtEstimate(Float a) { return _mm_rsqrt_ps(a); }
+        static Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+        static Mask LessEqual(Float a, Float b) { return _mm_cmple_ps(a, b); }
+        static Float Select(Mask m, Float a) { return _mm_blendv_ps(_mm_setzero_ps(), a, m); }          // a where m, 0 elsewhere
+
+        static Int IntSet(int32_t a) { return _mm_set1_epi32(a); }
+        static Int IntAdd(Int a, Int b) { return _mm_add_epi32(a, b); }
+        static Int IntMul(Int a, Int b) { return _mm_mullo_epi32(a, b); }
+        static Int IntMin(Int a, Int b) { return _mm_min_epi32(a, b); }
+        static Int IntAnd(Int a, Int b) { return _mm_and_si128(a, b); }
+        static Int IntOr(Int a, Int b) { return _mm_or_si128(a, b); }
+        static Int ShiftLeft(Int a, int bits) { return _mm_slli_epi32(a, bits); }
+        static Int ShiftRight(Int a, int bits) { return _mm_srli_epi32(a, bits); }
+        static Int ToInt(Float a) { return _mm_cvttps_epi32(a); }
+        static Float ToFloat(Int a) { return _mm_cvtepi32_ps(a); }
+        static Float AsFloat(Int a) { return _mm_castsi128_ps(a); }
+        static Int AsInt(Float a) { return _mm_castps_si128(a); }
+
+        // No gather instruction before AVX2, the lanes are loaded one by one
+        static Float Gather(const float* base, Int index)
+        {
+            alignas(16) int32_t lanes[Width];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), index);
+            return _mm_setr_ps(base[lanes[0]], base[lanes[1]], base[lanes[2]], base[lanes[3]]);
+        }
+        static Int GatherInt(const int32_t* base, Int index)
+        {
+            alignas(16) int32_t lanes[Width];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), index);
+            return _mm_setr_epi32(base[lanes[0]], base[lanes[1]], base[lanes[2]], base[lanes[3]]);
+        }
+    };
+
+    using ISA = Sse4Registers;
+#include <SimdKernels.inl>
+
+} // anonymous
+
+const SimdKernels* GetSse4Kernels()
+{
+    return &kernels;
+}
+
+#else
+
+const SimdKernels* GetSse4Kernels()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,171 @@
+#include <SimdSimulationBackend.h>
+
+#if SIMD_KERNELS_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+    struct CpuFeatures {
+        bool sse41 = false;
+        bool avx2 = false;          // With FMA and the AVX state saved by the OS
+        bool avx512 = false;        // AVX-512 F with the ZMM state saved by the OS
+    };
+
+#if SIMD_KERNELS_X86
+    void Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t registers[4])
+    {
+#if defined(_MSC_VER)
+        int values[4];
+        __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+        for (int i = 0; i < 4; ++i) {
+            registers[i] = static_cast<uint32_t>(values[i]);
+        }
+#else
+        __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    }
+
+    uint64_t ReadXcr0()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+    }
+#endif
+
+    CpuFeatures DetectCpuFeatures()
+    {
+        CpuFeatures features;
+#if SIMD_KERNELS_X86
+        uint32_t registers[4];
+        Cpuid(0, 0, registers);
+        uint32_t maxLeaf = registers[0];
+        if (maxLeaf < 1) {
+            return features;
+        }
+
+        Cpuid(1, 0, registers);
+        features.sse41 = (registers[2] & (1u << 19)) != 0;
+        bool fma = (registers[2] & (1u << 12)) != 0;
+        bool osxsave = (registers[2] & (1u << 27)) != 0;
+        bool avx = (registers[2] & (1u << 28)) != 0;
+        if (!osxsave || !avx || maxLeaf < 7) {
+            return features;
+        }
+
+        // The OS must save the YMM (bits 1-2) and the opmask / ZMM (bits 5-7) registers on context switches
+        uint64_t xcr0 = ReadXcr0();
+        bool ymmState = (xcr0 & 0x6) == 0x6;
+        bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+        Cpuid(7, 0, registers);
+        features.avx2 = ymmState && fma && (registers[1] & (1u << 5)) != 0;
+        features.avx512 = zmmState && fma && (registers[1] & (1u << 16)) != 0;
+#endif
+        return features;
+    }
+
+} // anonymous
+
+SimdSimulationBackend::SimdSimulationBackend(ThreadPool* threadPool)
+    : CpuSimulationBackend(threadPool)
+{
+    CpuFeatures features = DetectCpuFeatures();
+    if (features.avx512) {
+        m_kernels = GetAvx512Kernels();
+    }
+    else if (features.avx2) {
+        m_kernels = GetAvx2Kernels();
+    }
+    else if (features.sse41) {
+        m_kernels = GetSse4Kernels();
+    }
+}
+
+const char* SimdSimulationBackend::GetName() const
+{
+    return m_kernels ? m_kernels->name : CpuSimulationBackend::GetName();
+}
+
+void SimdSimulationBackend::Step(Particle* particles, uint32_t count, const SimulationStepParams& params)
+{
+    const SdfCollider& collider = *params.collider;
+    glm::vec3 sdfExtent = collider.GetBoundsMax() - collider.GetBoundsMin();
+    float resolution = static_cast<float>(collider.GetResolution());
+    m_sdfView.distances = collider.GetSampledDistances().data();
+    m_sdfView.resolution = collider.GetResolution();
+    for (int axis = 0; axis < 3; ++axis) {
+        m_sdfView.boundsMin[axis] = collider.GetBoundsMin()[axis];
+        m_sdfView.texelsPerUnit[axis] = resolution / sdfExtent[axis];
+        m_sdfView.texelSize[axis] = sdfExtent[axis] / resolution;
+    }
+
+    const VectorField& field = *params.field;
+    glm::vec3 fieldExtent = field.GetBoundsMax() - field.GetBoundsMin();
+    glm::uvec3 fieldSize(field.GetWidth(), field.GetHeight(), field.GetDepth());
+    m_fieldView.frameA = field.GetFrame(params.fieldFrameA);
+    m_fieldView.frameB = field.GetFrame(params.fieldFrameB);
+    for (int axis = 0; axis < 3; ++axis) {
+        m_fieldView.size[axis] = fieldSize[axis];
+        m_fieldView.boundsMin[axis] = field.GetBoundsMin()[axis];
+        m_fieldView.texelsPerUnit[axis] = static_cast<float>(fieldSize[axis]) / fieldExtent[axis];
+    }
+    m_fieldView.blend = params.fieldBlend;
+    m_fieldView.scale = params.fieldScale;
+
+    CpuSimulationBackend::Step(particles, count, params);
+}
+
+void SimdSimulationBackend::SampleField(const Lanes3& pos, const SimulationStepParams& params, Lanes3& fieldVel)
+{
+    if (!m_kernels) {
+        CpuSimulationBackend::SampleField(pos, params, fieldVel);
+        return;
+    }
+    m_kernels->sampleField(pos, m_fieldView, fieldVel);
+}
+
+void SimdSimulationBackend::SampleCollider(const Batch& batch, const SimulationStepParams& params, float* distance, Lanes3& normal)
+{
+    if (!m_kernels) {
+        CpuSimulationBackend::SampleCollider(batch, params, distance, normal);
+        return;
+    }
+    m_kernels->sampleCollider(batch, m_sdfView, distance, normal);
+}
+
+void SimdSimulationBackend::AccelerationLanes(const Batch& batch, const Lanes3& pos, const Lanes3& vel, const Lanes3& fieldVel, const SimulationStepParams& params, Lanes3& acceleration)
+{
+    if (!m_kernels) {
+        CpuSimulationBackend::AccelerationLanes(batch, pos, vel, fieldVel, params, acceleration);
+        return;
+    }
+    m_kernels->acceleration(batch, pos, vel, fieldVel, params.attractor, params.fieldCoupling, acceleration);
+}
+
+void SimdSimulationBackend::MultiplyAdd(Lanes3& out, const Lanes3& a, const Lanes3& b, float scale)
+{
+    if (!m_kernels) {
+        CpuSimulationBackend::MultiplyAdd(out, a, b, scale);
+        return;
+    }
+    m_kernels->multiplyAdd(out, a, b, scale);
+}
+
+void SimdSimulationBackend::CollisionResponse(Batch& batch, const float* distance, const Lanes3& normal, float restitution)
+{
+    if (!m_kernels) {
+        CpuSimulationBackend::CollisionResponse(batch, distance, normal, restitution);
+        return;
+    }
+    m_kernels->collisionResponse(batch, distance, normal, restitution);
+}
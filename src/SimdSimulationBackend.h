@@ -0,0 +1,30 @@
+#pragma once
+
+#include <SimdKernels.h>
+
+// CpuSimulationBackend with the per lane lookups and arithmetic replaced by hand vectorized kernels
+// The widest instruction set supported by the CPU (SSE4.1, AVX2 + FMA, AVX-512) is picked at construction,
+// without any the scalar loops of the base class are kept
+class SimdSimulationBackend : public CpuSimulationBackend
+{
+public:
+    explicit SimdSimulationBackend(ThreadPool* threadPool = nullptr);
+
+    const char* GetName() const override;
+
+    void Step(Particle* particles, uint32_t count, const SimulationStepParams& params) override;
+
+protected:
+    void SampleField(const Lanes3& pos, const SimulationStepParams& params, Lanes3& fieldVel) override;
+    void SampleCollider(const Batch& batch, const SimulationStepParams& params, float* distance, Lanes3& normal) override;
+    void AccelerationLanes(const Batch& batch, const Lanes3& pos, const Lanes3& vel, const Lanes3& fieldVel, const SimulationStepParams& params, Lanes3& acceleration) override;
+    void MultiplyAdd(Lanes3& out, const Lanes3& a, const Lanes3& b, float scale) override;
+    void CollisionResponse(Batch& batch, const float* distance, const Lanes3& normal, float restitution) override;
+
+private:
+    const SimdKernels* m_kernels = nullptr;
+
+    // Rebuilt from the step parameters at every Step, read only while the batches run
+    SdfView m_sdfView = {};
+    FieldView m_fieldView = {};
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Particle.h>
+#include <SdfCollider.h>
+#include <VectorField.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// Integration schemes, each one is compiled into its own compute pipeline through a specialization constant
+enum Integrator : uint32_t {
+    INTEGRATOR_SYMPLECTIC_EULER = 0,
+    INTEGRATOR_LEAPFROG,
+    INTEGRATOR_VELOCITY_VERLET,
+    INTEGRATOR_RK4,
+    INTEGRATOR_COUNT
+};
+
+// Where the particle step runs, the GPU one is recorded by ParticleSimulation itself
+enum SimulationBackendType : uint32_t {
+    SIMULATION_BACKEND_GPU = 0,
+    SIMULATION_BACKEND_CPU,
+    SIMULATION_BACKEND_CPU_SIMD,        // CPU backend with hand vectorized kernels for the host instruction set
+    SIMULATION_BACKEND_HYBRID,          // Particle range split between the compute shader and the SIMD CPU backend
+};
+
+// Inputs of one simulation step, the host side counterpart of the compute UBO
+struct SimulationStepParams {
+    float dt;
+    uint32_t integrator;
+    glm::vec3 attractor;
+    float restitution;
+    const Species* species;             // MAX_SPECIES entries
+    const SdfCollider* collider;
+    const VectorField* field;
+    uint32_t fieldFrameA;               // Keyframes blended by fieldBlend
+    uint32_t fieldFrameB;
+    float fieldBlend;
+    float fieldCoupling;
+    float fieldScale;
+};
+
+// Host implementation of the particle step of simulation.comp
+class SimulationBackend
+{
+public:
+    virtual ~SimulationBackend() = default;
+
+    virtual const char* GetName() const = 0;
+
+    // Advance particles [0, count) by one step of params.dt
+    virtual void Step(Particle* particles, uint32_t count, const SimulationStepParams& params) = 0;
+};
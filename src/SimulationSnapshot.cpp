@@ -0,0 +1,300 @@
+#include <SimulationSnapshot.h>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Snapshot layout (little endian)
+//   char[4]     magic "PSNP"
+//   uint32      version, stateSize, particleCount, particleSize, reserved
+//   uint64      payloadOffset, a multiple of SimulationSnapshot::PayloadAlignment
+//   uint8[]     stateSize bytes of host state, right after the header
+//   Particle[]  particleCount particles at payloadOffset, the gap before them is zeroed
+
+namespace {
+
+    const char kSnapshotMagic[4] = { 'P', 'S', 'N', 'P' };
+
+    struct SnapshotHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t stateSize;
+        uint32_t particleCount;
+        uint32_t particleSize;
+        uint32_t reserved;
+        uint64_t payloadOffset;
+    };
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+} // anonymous
+
+SimulationSnapshot::~SimulationSnapshot()
+{
+    Wait();
+    Close();
+}
+
+bool SimulationSnapshot::Open(const std::string& path, uint32_t stateSize, uint32_t particleCount)
+{
+    Close();
+    if (!Map(path, 0, false, m_mapping))
+    {
+        std::cerr << "Cannot open snapshot " << path << "\n";
+        return false;
+    }
+
+    // Only the header is read, the state and the particles are used in place
+    const SnapshotHeader* header = static_cast<const SnapshotHeader*>(m_mapping.data);
+    uint64_t payloadSize = static_cast<uint64_t>(particleCount) * sizeof(Particle);
+    const char* error = nullptr;
+    if (m_mapping.size < sizeof(SnapshotHeader) || memcmp(header->magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0)
+    {
+        error = "not a snapshot";
+    }
+    else if (header->version != Version)
+    {
+        error = "unsupported version";
+    }
+    else if (header->stateSize != stateSize || header->particleSize != sizeof(Particle))
+    {
+        error = "saved by a build with another state layout";
+    }
+    else if (header->particleCount != particleCount)
+    {
+        error = "particle count mismatch";
+    }
+    else if (header->payloadOffset % PayloadAlignment != 0 || header->payloadOffset < sizeof(SnapshotHeader) + stateSize ||
+        header->payloadOffset + payloadSize > m_mapping.size)
+    {
+        error = "truncated";
+    }
+
+    if (error)
+    {
+        std::cerr << "Cannot restore snapshot " << path << ": " << error << "\n";
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void SimulationSnapshot::Close()
+{
+    if (m_mapping.data)
+    {
+        Unmap(m_mapping, false);
+    }
+    m_mapping = Mapping();
+}
+
+const void* SimulationSnapshot::GetState() const
+{
+    return static_cast<const uint8_t*>(m_mapping.data) + sizeof(SnapshotHeader);
+}
+
+const Particle* SimulationSnapshot::GetParticles() const
+{
+    const SnapshotHeader* header = static_cast<const SnapshotHeader*>(m_mapping.data);
+    return reinterpret_cast<const Particle*>(static_cast<const uint8_t*>(m_mapping.data) + header->payloadOffset);
+}
+
+bool SimulationSnapshot::Save(const std::string& path, const void* state, uint32_t stateSize, const Particle* particles, uint32_t particleCount)
+{
+    // Both saves would write the same temporary file, the caller tries again later rather than waiting for the disk
+    if (m_saving)
+    {
+        return false;
+    }
+
+    // The previous writer is done, its thread only has to be joined
+    Wait();
+
+    uint64_t payloadSize = static_cast<uint64_t>(particleCount) * sizeof(Particle);
+    m_buffer.resize(stateSize + payloadSize);
+    memcpy(m_buffer.data(), state, stateSize);
+    memcpy(m_buffer.data() + stateSize, particles, payloadSize);
+
+    m_saving = true;
+    m_writer = std::thread([this, path, stateSize, particleCount]() {
+        Write(path, stateSize, particleCount);
+        m_saving = false;
+    });
+    return true;
+}
+
+void SimulationSnapshot::Write(const std::string& path, uint32_t stateSize, uint32_t particleCount)
+{
+    SnapshotHeader header{};
+    memcpy(header.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+    header.version = Version;
+    header.stateSize = stateSize;
+    header.particleCount = particleCount;
+    header.particleSize = sizeof(Particle);
+    header.payloadOffset = AlignUp(sizeof(SnapshotHeader) + stateSize, PayloadAlignment);
+    uint64_t payloadSize = static_cast<uint64_t>(particleCount) * sizeof(Particle);
+
+    std::string temporaryPath = path + ".tmp";
+    Mapping mapping;
+    if (!Map(temporaryPath, header.payloadOffset + payloadSize, true, mapping))
+    {
+        std::cerr << "Cannot create snapshot " << temporaryPath << "\n";
+        return;
+    }
+
+    // The file is sized up front so that its pages are never read from disk
+    uint8_t* data = static_cast<uint8_t*>(mapping.data);
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), m_buffer.data(), stateSize);
+    memcpy(data + header.payloadOffset, m_buffer.data() + stateSize, payloadSize);
+
+    Unmap(mapping, true);
+    if (!Replace(temporaryPath, path))
+    {
+        std::cerr << "Cannot move snapshot " << temporaryPath << " to " << path << "\n";
+        return;
+    }
+    std::cout << "Snapshot saved to " << path << "\n";
+}
+
+void SimulationSnapshot::Wait()
+{
+    if (m_writer.joinable())
+    {
+        m_writer.join();
+    }
+}
+
+bool SimulationSnapshot::Map(const std::string& path, uint64_t size, bool write, Mapping& mapping)
+{
+    // Read mappings take the size of the file
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, write ? 0 : FILE_SHARE_READ, nullptr,
+        write ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!write && GetFileSizeEx(file, &fileSize))
+    {
+        size = static_cast<uint64_t>(fileSize.QuadPart);
+    }
+
+    // Mapping a larger size than the file grows it with zeros
+    HANDLE mappingObject = size > 0 ? CreateFileMappingA(file, nullptr, write ? PAGE_READWRITE : PAGE_READONLY,
+        static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xffffffffu), nullptr) : nullptr;
+    void* data = mappingObject ? MapViewOfFile(mappingObject, write ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data)
+    {
+        if (mappingObject)
+        {
+            CloseHandle(mappingObject);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    mapping.file = file;
+    mapping.mappingObject = mappingObject;
+#else
+    int file = write ? open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    if (!write && fstat(file, &status) == 0)
+    {
+        size = static_cast<uint64_t>(status.st_size);
+    }
+
+    // Growing the file with ftruncate zero fills it without writing anything
+    void* data = MAP_FAILED;
+    if (size > 0 && (!write || ftruncate(file, static_cast<off_t>(size)) == 0))
+    {
+        data = mmap(nullptr, size, write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+    }
+    if (data == MAP_FAILED)
+    {
+        close(file);
+        return false;
+    }
+
+    // Restores read the particles front to back once
+    if (!write)
+    {
+        madvise(data, size, MADV_SEQUENTIAL);
+    }
+    mapping.file = file;
+#endif
+    mapping.data = data;
+    mapping.size = size;
+    return true;
+}
+
+void SimulationSnapshot::Unmap(Mapping& mapping, bool flush)
+{
+    // Flushing writes the dirty pages and then the file metadata, both are on disk when it returns
+#if defined(_WIN32)
+    if (flush)
+    {
+        FlushViewOfFile(mapping.data, 0);
+    }
+    UnmapViewOfFile(mapping.data);
+    CloseHandle(mapping.mappingObject);
+    if (flush)
+    {
+        FlushFileBuffers(mapping.file);
+    }
+    CloseHandle(mapping.file);
+#else
+    if (flush)
+    {
+        msync(mapping.data, mapping.size, MS_SYNC);
+    }
+    munmap(mapping.data, mapping.size);
+    if (flush)
+    {
+        fsync(mapping.file);
+    }
+    close(mapping.file);
+#endif
+    mapping = Mapping();
+}
+
+bool SimulationSnapshot::Replace(const std::string& source, const std::string& destination)
+{
+    // Atomic on the same volume, the destination holds either snapshot whenever the process stops
+#if defined(_WIN32)
+    return MoveFileExA(source.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (std::rename(source.c_str(), destination.c_str()) != 0)
+    {
+        return false;
+    }
+
+    // The new directory entry is only durable once the directory itself is synced
+    std::filesystem::path directory = std::filesystem::path(destination).parent_path();
+    int directoryFile = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+    if (directoryFile >= 0)
+    {
+        fsync(directoryFile);
+        close(directoryFile);
+    }
+    return true;
+#endif
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Particle.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Binary checkpoint of a simulation: a small versioned header, the host side state as an opaque block of a fixed
+// size, then the particles as a page aligned payload
+// Restores map the file and hand out pointers into the mapping, the particles can be copied from it as they are
+// Saves copy the state and the particles into a buffer of the writer thread, which maps a new file next to the
+// destination, fills it, flushes it to disk and moves it over the destination, so that a crash leaves either the
+// previous snapshot or the new one behind
+class SimulationSnapshot
+{
+public:
+    static constexpr uint32_t Version = 1;
+
+    // Multiple of the page size and of the Windows allocation granularity
+    static constexpr uint64_t PayloadAlignment = 64 * 1024;
+
+    SimulationSnapshot() = default;
+    ~SimulationSnapshot();
+
+    SimulationSnapshot(const SimulationSnapshot&) = delete;
+    SimulationSnapshot& operator=(const SimulationSnapshot&) = delete;
+
+    // Maps path read only, fails unless it holds a snapshot of this version with a state block of stateSize bytes and
+    // particleCount particles
+    bool Open(const std::string& path, uint32_t stateSize, uint32_t particleCount);
+    void Close();
+    bool IsOpen() const { return m_mapping.data != nullptr; }
+
+    // Valid until Close()
+    const void* GetState() const;
+    const Particle* GetParticles() const;
+
+    // Returns once state and particles are copied, false without copying anything while the previous save is written
+    bool Save(const std::string& path, const void* state, uint32_t stateSize, const Particle* particles, uint32_t particleCount);
+    bool IsSaving() const { return m_saving; }
+
+    // Waits until the last save is on disk
+    void Wait();
+
+private:
+    struct Mapping {
+        void* data = nullptr;
+        uint64_t size = 0;
+#if defined(_WIN32)
+        void* file = nullptr;                       // HANDLE
+        void* mappingObject = nullptr;              // HANDLE
+#else
+        int file = -1;
+#endif
+    };
+
+    static bool Map(const std::string& path, uint64_t size, bool write, Mapping& mapping);
+    static void Unmap(Mapping& mapping, bool flush);
+    static bool Replace(const std::string& source, const std::string& destination);
+
+    // Writer thread, writes the buffer to path
+    void Write(const std::string& path, uint32_t stateSize, uint32_t particleCount);
+
+    Mapping m_mapping;                              // Snapshot opened for a restore
+    std::thread m_writer;                           // Writes the last saved snapshot
+    std::atomic<bool> m_saving{ false };            // The writer owns m_buffer until it clears it
+    std::vector<uint8_t> m_buffer;                  // State then particles of the snapshot being written
+};
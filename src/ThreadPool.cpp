@@ -0,0 +1,185 @@
+#include <ThreadPool.h>
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+ThreadPool::ThreadPool(uint32_t threadCount, bool pinThreads)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+
+    // The calling thread keeps its affinity, it is the render thread and outlives the pool
+    for (uint32_t i = 1; i < threadCount; ++i) {
+        m_threads.emplace_back([this, i, pinThreads]() {
+            if (pinThreads) {
+                PinCurrentThread(i);
+            }
+            WorkerLoop(i);
+        });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::ParallelFor(uint32_t count, uint32_t chunkSize, const std::function<void(uint32_t, uint32_t)>& function)
+{
+    chunkSize = std::max(chunkSize, 1u);
+    uint32_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    if (chunkCount == 0) {
+        return;
+    }
+    if (chunkCount == 1 || m_workers.size() == 1) {
+        function(0, count);
+        return;
+    }
+
+    // Contiguous blocks of chunks per worker, neighbouring chunks stay on the same core unless stolen
+    uint32_t workerCount = GetThreadCount();
+    for (uint32_t worker = 0; worker < workerCount; ++worker) {
+        uint32_t firstChunk = static_cast<uint32_t>(static_cast<uint64_t>(chunkCount) * worker / workerCount);
+        uint32_t lastChunk = static_cast<uint32_t>(static_cast<uint64_t>(chunkCount) * (worker + 1) / workerCount);
+        std::lock_guard<std::mutex> lock(m_workers[worker]->mutex);
+        for (uint32_t chunk = firstChunk; chunk < lastChunk; ++chunk) {
+            uint32_t begin = chunk * chunkSize;
+            m_workers[worker]->ranges.push_back({ begin, std::min(begin + chunkSize, count) });
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_function = &function;
+        m_busy = workerCount;
+        ++m_generation;
+    }
+    m_wake.notify_all();
+
+    RunChunks(0);
+
+    // Chunks stolen by the other workers may still be running
+    std::unique_lock<std::mutex> lock(m_mutex);
+    --m_busy;
+    m_done.wait(lock, [this]() { return m_busy == 0; });
+    m_function = nullptr;
+}
+
+void ThreadPool::WorkerLoop(uint32_t index)
+{
+    uint64_t generation = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]() { return m_stop || m_generation != generation; });
+            if (m_stop) {
+                return;
+            }
+            generation = m_generation;
+        }
+
+        RunChunks(index);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_busy == 0) {
+            m_done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::RunChunks(uint32_t index)
+{
+    // No chunk is added during a ParallelFor, once every deque is empty the thread is done
+    Range range;
+    while (Pop(index, range) || Steal(index, range)) {
+        (*m_function)(range.begin, range.end);
+    }
+}
+
+bool ThreadPool::Pop(uint32_t index, Range& range)
+{
+    Worker& worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.ranges.empty()) {
+        return false;
+    }
+    range = worker.ranges.front();
+    worker.ranges.pop_front();
+    return true;
+}
+
+bool ThreadPool::Steal(uint32_t index, Range& range)
+{
+    // The victim keeps the chunks next to the one it is running, the thief takes the far end
+    uint32_t workerCount = GetThreadCount();
+    for (uint32_t offset = 1; offset < workerCount; ++offset) {
+        Worker& victim = *m_workers[(index + offset) % workerCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.ranges.empty()) {
+            range = victim.ranges.back();
+            victim.ranges.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t ThreadPool::GetL2CacheSize()
+{
+    const size_t fallback = 256 * 1024;
+#if defined(_WIN32)
+    DWORD length = 0;
+    GetLogicalProcessorInformation(nullptr, &length);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> entries(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (entries.empty() || !GetLogicalProcessorInformation(entries.data(), &length)) {
+        return fallback;
+    }
+    for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& entry : entries) {
+        if (entry.Relationship == RelationCache && entry.Cache.Level == 2) {
+            return entry.Cache.Size;
+        }
+    }
+    return fallback;
+#elif defined(_SC_LEVEL2_CACHE_SIZE)
+    long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return size > 0 ? static_cast<size_t>(size) : fallback;
+#else
+    return fallback;
+#endif
+}
+
+void ThreadPool::PinCurrentThread(uint32_t processor)
+{
+#if defined(_WIN32)
+    if (processor < 64) {
+        SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << processor);
+    }
+#elif defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(processor % CPU_SETSIZE, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+    (void)processor;
+#endif
+}
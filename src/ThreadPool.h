@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork / join pool for data parallel loops
+// Every ParallelFor is cut into chunks dealt out in contiguous blocks to per worker deques, a worker runs its own
+// chunks front to back and steals from the back of the other deques once it runs dry
+// The calling thread takes part as worker 0, ParallelFor is not reentrant
+class ThreadPool
+{
+public:
+    // 0 threads means one per logical processor, the calling thread included
+    // With pinning, the thread of worker i > 0 is bound to logical processor i, the calling thread (worker 0) is not pinned
+    ThreadPool(uint32_t threadCount = 0, bool pinThreads = false);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_workers.size()); }
+
+    // Runs function(begin, end) over [0, count) in chunks of chunkSize items, returns when every chunk is done
+    void ParallelFor(uint32_t count, uint32_t chunkSize, const std::function<void(uint32_t, uint32_t)>& function);
+
+    // Per core L2 size in bytes, 256 KiB when it cannot be queried
+    static size_t GetL2CacheSize();
+
+private:
+    struct Range {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Range> ranges;
+    };
+
+    void WorkerLoop(uint32_t index);
+    void RunChunks(uint32_t index);
+    bool Pop(uint32_t index, Range& range);
+    bool Steal(uint32_t index, Range& range);
+
+    static void PinCurrentThread(uint32_t processor);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;                 // Workers 1 to N - 1
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    uint64_t m_generation = 0;                          // Bumped by every ParallelFor
+    uint32_t m_busy = 0;                                // Threads still inside the current ParallelFor
+    bool m_stop = false;
+    const std::function<void(uint32_t, uint32_t)>* m_function = nullptr;
+};
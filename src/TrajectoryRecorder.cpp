@@ -0,0 +1,406 @@
+#include <TrajectoryRecorder.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Trajectory layout (little endian)
+//   char[4]     magic "PTRJ"
+//   uint32      version, particleCount, chunkSize, keyframeInterval
+//   float[3]    boxMin
+//   float[3]    boxMax
+//   frames, each one:
+//     uint64    step
+//     uint32    flags (1: keyframe), chunkCount
+//     chunks:   uint32 size, bit 31 set when the chunk is stored uncompressed, then size bytes in the LZ4 block format
+//   index:      one { uint64 step, uint64 frame offset, uint32 flags, uint32 reserved } per frame
+//   uint64      index offset
+//   uint32      frame count
+//   char[4]     magic "PIDX"
+//
+// The chunks of a frame, once decompressed and concatenated, hold six planes of particleCount bytes: the low then the
+// high bytes of x, then of y, then of z
+// Each value is the zigzag encoded 16 bit difference between the quantized component and the one of the previous
+// frame in the file, or 0 on keyframes: q = round((p - boxMin) / (boxMax - boxMin) * 65535)
+
+namespace {
+
+    const char kTrajectoryMagic[4] = { 'P', 'T', 'R', 'J' };
+    const char kIndexMagic[4] = { 'P', 'I', 'D', 'X' };
+
+    const uint32_t kKeyframeFlag = 1;
+    const uint32_t kStoredChunkBit = 0x80000000u;
+
+    // Particles quantized per parallel chunk
+    const uint32_t kQuantizeChunkSize = 16 * 1024;
+
+    struct TrajectoryHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t particleCount;
+        uint32_t chunkSize;
+        uint32_t keyframeInterval;
+        float boxMin[3];
+        float boxMax[3];
+    };
+
+    struct FrameHeader {
+        uint64_t step;
+        uint32_t flags;
+        uint32_t chunkCount;
+    };
+
+    struct TrajectoryTrailer {
+        uint64_t indexOffset;
+        uint32_t frameCount;
+        char magic[4];
+    };
+
+    // LZ4 block format: a match is at least 4 bytes long and at most 64 KiB back, the last 5 bytes are literals and
+    // the last match starts at least 12 bytes before the end
+    const uint32_t kMinMatch = 4;
+    const uint32_t kLastLiterals = 5;
+    const uint32_t kMatchStartLimit = 12;
+    const uint32_t kMaxOffset = 65535;
+    const uint32_t kHashLog = 14;
+
+    uint32_t Read32(const uint8_t* data)
+    {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    uint32_t Hash(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - kHashLog);
+    }
+
+    uint8_t* WriteLength(uint8_t* dst, size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            *dst++ = 255;
+        }
+        *dst++ = static_cast<uint8_t>(length);
+        return dst;
+    }
+
+    uint8_t* WriteSequence(uint8_t* dst, const uint8_t* literals, size_t literalCount, uint32_t offset, size_t matchLength)
+    {
+        uint8_t* token = dst++;
+        *token = static_cast<uint8_t>(std::min<size_t>(literalCount, 15) << 4);
+        if (literalCount >= 15)
+        {
+            dst = WriteLength(dst, literalCount - 15);
+        }
+        memcpy(dst, literals, literalCount);
+        dst += literalCount;
+
+        // The last sequence only holds literals
+        if (matchLength == 0)
+        {
+            return dst;
+        }
+        *dst++ = static_cast<uint8_t>(offset & 0xff);
+        *dst++ = static_cast<uint8_t>(offset >> 8);
+        size_t extraLength = matchLength - kMinMatch;
+        *token |= static_cast<uint8_t>(std::min<size_t>(extraLength, 15));
+        if (extraLength >= 15)
+        {
+            dst = WriteLength(dst, extraLength - 15);
+        }
+        return dst;
+    }
+
+} // anonymous
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+    Close();
+}
+
+bool TrajectoryRecorder::Open(const std::string& path, uint32_t particleCount, const glm::vec3& boxMin, const glm::vec3& boxMax, uint32_t threadCount)
+{
+    Close();
+    m_file = fopen(path.c_str(), "wb");
+    if (!m_file)
+    {
+        std::cerr << "Cannot create trajectory " << path << "\n";
+        return false;
+    }
+
+    m_particleCount = particleCount;
+    m_boxMin = boxMin;
+    m_boxScale = 65535.0f / glm::max(boxMax - boxMin, glm::vec3(1.0e-6f));
+    m_offset = 0;
+    m_index.clear();
+    m_stop = false;
+    m_failed = false;
+    m_writtenFrames = 0;
+    m_droppedFrames = 0;
+    m_writtenBytes = 0;
+
+    TrajectoryHeader header{};
+    memcpy(header.magic, kTrajectoryMagic, sizeof(kTrajectoryMagic));
+    header.version = Version;
+    header.particleCount = particleCount;
+    header.chunkSize = ChunkSize;
+    header.keyframeInterval = KeyframeInterval;
+    memcpy(header.boxMin, &boxMin[0], sizeof(header.boxMin));
+    memcpy(header.boxMax, &boxMax[0], sizeof(header.boxMax));
+    if (!Write(&header, sizeof(header)))
+    {
+        std::cerr << "Cannot write trajectory " << path << "\n";
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+
+    // Every buffer is allocated up front, the frames never allocate
+    m_freeFrames.clear();
+    m_queuedFrames.clear();
+    for (uint32_t i = 0; i < FrameBufferCount; ++i)
+    {
+        m_freeFrames.push_back(std::make_unique<Frame>());
+        m_freeFrames.back()->positions.resize(particleCount);
+    }
+    m_previous.assign(3 * static_cast<size_t>(particleCount), 0);
+    m_raw.resize(6 * static_cast<size_t>(particleCount));
+    size_t chunkCount = (m_raw.size() + ChunkSize - 1) / ChunkSize;
+    m_chunks.resize(chunkCount);
+    for (std::vector<uint8_t>& chunk : m_chunks)
+    {
+        chunk.resize(sizeof(uint32_t) + GetCompressBound(ChunkSize));
+    }
+
+    m_threadPool = std::make_unique<ThreadPool>(threadCount);
+    m_writer = std::thread(&TrajectoryRecorder::WriterLoop, this);
+    std::cout << "Recording trajectory to " << path << ", " << m_threadPool->GetThreadCount() << " threads\n";
+    return true;
+}
+
+void TrajectoryRecorder::Close()
+{
+    if (!m_file)
+    {
+        return;
+    }
+
+    // The writer drains the queue before it returns
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_writer.join();
+    m_threadPool.reset();
+
+    TrajectoryTrailer trailer{};
+    trailer.indexOffset = m_offset;
+    trailer.frameCount = static_cast<uint32_t>(m_index.size());
+    memcpy(trailer.magic, kIndexMagic, sizeof(kIndexMagic));
+    bool written = !m_failed;
+    if (written && !m_index.empty())
+    {
+        written = Write(m_index.data(), m_index.size() * sizeof(IndexEntry));
+    }
+    written = written && Write(&trailer, sizeof(trailer));
+    written = fclose(m_file) == 0 && written;
+    m_file = nullptr;
+
+    if (written)
+    {
+        std::cout << "Trajectory: " << m_writtenFrames << " frames written, " << m_droppedFrames << " dropped, "
+            << m_writtenBytes / (1024 * 1024) << " MiB\n";
+    }
+    else
+    {
+        std::cerr << "Trajectory: write failed after " << m_writtenFrames << " frames, the file has no index\n";
+    }
+
+    m_freeFrames.clear();
+    m_queuedFrames.clear();
+    m_previous.clear();
+    m_raw.clear();
+    m_chunks.clear();
+    m_index.clear();
+}
+
+bool TrajectoryRecorder::Submit(const Particle* particles, uint64_t step)
+{
+    std::unique_ptr<Frame> frame;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_failed || m_freeFrames.empty())
+        {
+            m_droppedFrames++;
+            return false;
+        }
+        frame = std::move(m_freeFrames.back());
+        m_freeFrames.pop_back();
+    }
+
+    // Only the positions are recorded, the copy is all the render thread pays for
+    frame->step = step;
+    for (uint32_t i = 0; i < m_particleCount; ++i)
+    {
+        frame->positions[i] = particles[i].pos;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queuedFrames.push_back(std::move(frame));
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+void TrajectoryRecorder::WriterLoop()
+{
+    for (;;)
+    {
+        std::unique_ptr<Frame> frame;
+        bool failed;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_stop || !m_queuedFrames.empty(); });
+            if (m_queuedFrames.empty())
+            {
+                return;
+            }
+            frame = std::move(m_queuedFrames.front());
+            m_queuedFrames.pop_front();
+            failed = m_failed;
+        }
+
+        // Frames queued before a failure are dropped with the following ones
+        bool written = !failed && WriteFrame(*frame);
+        if (!written)
+        {
+            m_droppedFrames++;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_failed = !written;
+        m_freeFrames.push_back(std::move(frame));
+    }
+}
+
+bool TrajectoryRecorder::WriteFrame(const Frame& frame)
+{
+    // Keyframes are positioned so that a reader seeking to any frame decodes at most KeyframeInterval of them
+    bool keyframe = m_index.size() % KeyframeInterval == 0;
+    uint32_t particleCount = m_particleCount;
+
+    // Quantized differences, zigzag encoded so that small negative ones also have a zero high byte
+    m_threadPool->ParallelFor(particleCount, kQuantizeChunkSize, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            glm::vec3 quantized = glm::clamp((glm::vec3(frame.positions[i]) - m_boxMin) * m_boxScale + 0.5f, glm::vec3(0.0f), glm::vec3(65535.0f));
+            for (uint32_t component = 0; component < 3; ++component)
+            {
+                size_t index = static_cast<size_t>(component) * particleCount + i;
+                uint16_t value = static_cast<uint16_t>(quantized[component]);
+                int32_t delta = static_cast<int16_t>(static_cast<uint16_t>(value - (keyframe ? 0 : m_previous[index])));
+                uint16_t zigzag = static_cast<uint16_t>((static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31));
+                m_previous[index] = value;
+                m_raw[2 * static_cast<size_t>(component) * particleCount + i] = static_cast<uint8_t>(zigzag & 0xff);
+                m_raw[(2 * static_cast<size_t>(component) + 1) * particleCount + i] = static_cast<uint8_t>(zigzag >> 8);
+            }
+        }
+    });
+
+    // Each chunk starts with its size, chunks that do not shrink are stored as they are
+    uint32_t chunkCount = static_cast<uint32_t>(m_chunks.size());
+    m_threadPool->ParallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t chunkIndex = begin; chunkIndex < end; ++chunkIndex)
+        {
+            const uint8_t* src = m_raw.data() + static_cast<size_t>(chunkIndex) * ChunkSize;
+            size_t size = std::min<size_t>(ChunkSize, m_raw.size() - static_cast<size_t>(chunkIndex) * ChunkSize);
+            uint8_t* dst = m_chunks[chunkIndex].data();
+            uint32_t chunkHeader = static_cast<uint32_t>(Compress(src, size, dst + sizeof(uint32_t)));
+            if (chunkHeader >= size)
+            {
+                memcpy(dst + sizeof(uint32_t), src, size);
+                chunkHeader = static_cast<uint32_t>(size) | kStoredChunkBit;
+            }
+            memcpy(dst, &chunkHeader, sizeof(chunkHeader));
+        }
+    });
+
+    IndexEntry entry{};
+    entry.step = frame.step;
+    entry.offset = m_offset;
+    entry.flags = keyframe ? kKeyframeFlag : 0;
+
+    FrameHeader header{};
+    header.step = frame.step;
+    header.flags = entry.flags;
+    header.chunkCount = chunkCount;
+    if (!Write(&header, sizeof(header)))
+    {
+        return false;
+    }
+    for (const std::vector<uint8_t>& chunk : m_chunks)
+    {
+        uint32_t chunkHeader;
+        memcpy(&chunkHeader, chunk.data(), sizeof(chunkHeader));
+        if (!Write(chunk.data(), sizeof(uint32_t) + (chunkHeader & ~kStoredChunkBit)))
+        {
+            return false;
+        }
+    }
+
+    m_index.push_back(entry);
+    m_writtenFrames++;
+    return true;
+}
+
+bool TrajectoryRecorder::Write(const void* data, size_t size)
+{
+    if (fwrite(data, 1, size, m_file) != size)
+    {
+        return false;
+    }
+    m_offset += size;
+    m_writtenBytes += size;
+    return true;
+}
+
+size_t TrajectoryRecorder::Compress(const uint8_t* src, size_t size, uint8_t* dst)
+{
+    // Greedy parse over a hash table of the last position of every 4 byte sequence, one table per pool thread
+    // Without a match nearby the search steps further and further ahead so that incompressible data is skipped fast
+    thread_local std::vector<uint32_t> table;
+    table.assign(size_t(1) << kHashLog, 0);
+
+    uint8_t* out = dst;
+    size_t anchor = 0;
+    size_t position = 0;
+    size_t matchLimit = size >= kLastLiterals ? size - kLastLiterals : 0;
+    while (position + kMatchStartLimit <= size)
+    {
+        uint32_t sequence = Read32(src + position);
+        uint32_t& slot = table[Hash(sequence)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(position);
+        if (candidate >= position || position - candidate > kMaxOffset || Read32(src + candidate) != sequence)
+        {
+            position += 1 + ((position - anchor) >> 6);
+            continue;
+        }
+
+        size_t matchLength = kMinMatch;
+        while (position + matchLength < matchLimit && src[candidate + matchLength] == src[position + matchLength])
+        {
+            matchLength++;
+        }
+        out = WriteSequence(out, src + anchor, position - anchor, static_cast<uint32_t>(position - candidate), matchLength);
+        position += matchLength;
+        anchor = position;
+    }
+
+    out = WriteSequence(out, src + anchor, size - anchor, 0, 0);
+    return static_cast<size_t>(out - dst);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <Particle.h>
+#include <ThreadPool.h>
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Trajectory file of the particle positions, written by a thread of its own
+// Submitted frames are copied into one of FrameBufferCount buffers and queued for the writer, a frame that finds every
+// buffer busy is dropped and counted so that the render thread never waits on the disk
+// The writer quantizes the positions to 16 bits per component over a box, takes their differences with the previous
+// written frame and compresses them in fixed size chunks on its thread pool, an index of the frames closes the file
+class TrajectoryRecorder
+{
+public:
+    static constexpr uint32_t Version = 1;
+
+    // Uncompressed bytes per chunk, compressed independently of each other
+    static constexpr uint32_t ChunkSize = 256 * 1024;
+
+    // Frames between two keyframes, which are not relative to the previous frame and start the decoding after a seek
+    static constexpr uint32_t KeyframeInterval = 64;
+
+    static constexpr uint32_t FrameBufferCount = 2;
+
+    TrajectoryRecorder() = default;
+    ~TrajectoryRecorder();
+
+    TrajectoryRecorder(const TrajectoryRecorder&) = delete;
+    TrajectoryRecorder& operator=(const TrajectoryRecorder&) = delete;
+
+    // Positions outside [boxMin, boxMax] are clamped to it, threadCount includes the writer thread
+    bool Open(const std::string& path, uint32_t particleCount, const glm::vec3& boxMin, const glm::vec3& boxMax, uint32_t threadCount);
+
+    // Writes the queued frames then the index
+    void Close();
+    bool IsOpen() const { return m_file != nullptr; }
+
+    // Copies the positions of particleCount particles, returns false when the frame is dropped
+    bool Submit(const Particle* particles, uint64_t step);
+
+    // Counts a frame that could not be submitted
+    void Drop() { m_droppedFrames++; }
+
+    uint64_t GetWrittenFrames() const { return m_writtenFrames; }
+    uint64_t GetDroppedFrames() const { return m_droppedFrames; }
+    uint64_t GetWrittenBytes() const { return m_writtenBytes; }
+
+private:
+    struct Frame {
+        uint64_t step;
+        std::vector<glm::vec4> positions;
+    };
+
+    struct IndexEntry {
+        uint64_t step;
+        uint64_t offset;                            // File offset of the frame header
+        uint32_t flags;
+        uint32_t reserved;
+    };
+
+    void WriterLoop();
+    bool WriteFrame(const Frame& frame);
+    bool Write(const void* data, size_t size);
+
+    // LZ4 block format, dst holds at least GetCompressBound(size) bytes
+    static size_t Compress(const uint8_t* src, size_t size, uint8_t* dst);
+    static size_t GetCompressBound(size_t size) { return size + size / 255 + 16; }
+
+    FILE* m_file = nullptr;
+    uint32_t m_particleCount = 0;
+    glm::vec3 m_boxMin;
+    glm::vec3 m_boxScale;                           // Box to [0, 65535]
+
+    std::thread m_writer;
+    std::unique_ptr<ThreadPool> m_threadPool;       // Worker 0 is the writer thread
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<std::unique_ptr<Frame>> m_freeFrames;
+    std::deque<std::unique_ptr<Frame>> m_queuedFrames;
+    bool m_stop = false;
+    bool m_failed = false;                          // A write failed, later frames are dropped
+
+    // Writer thread only
+    std::vector<uint16_t> m_previous;               // Quantized positions of the last written frame, component major
+    std::vector<uint8_t> m_raw;                     // Byte planes of the frame being written
+    std::vector<std::vector<uint8_t>> m_chunks;     // Compressed chunks of the frame being written
+    std::vector<IndexEntry> m_index;
+    uint64_t m_offset = 0;
+
+    std::atomic<uint64_t> m_writtenFrames{ 0 };
+    std::atomic<uint64_t> m_droppedFrames{ 0 };
+    std::atomic<uint64_t> m_writtenBytes{ 0 };
+};
@@ -0,0 +1,207 @@
+#include <VectorField.h>
+
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+// .vfld layout (little endian)
+//   char[4]   magic "VFLD"
+//   uint32    width, height, depth, frameCount
+//   float     frameDuration
+//   float[3]  boundsMin
+//   float[3]  boundsMax
+//   uint16[]  frameCount * depth * height * width * 4 half floats (x fastest)
+
+namespace {
+
+    const char kFieldMagic[4] = { 'V', 'F', 'L', 'D' };
+
+    // Classic 3D gradient noise
+    class GradientNoise
+    {
+    public:
+        explicit GradientNoise(uint32_t seed)
+        {
+            std::iota(m_permutation.begin(), m_permutation.begin() + 256, 0);
+            std::shuffle(m_permutation.begin(), m_permutation.begin() + 256, std::mt19937(seed));
+            std::copy(m_permutation.begin(), m_permutation.begin() + 256, m_permutation.begin() + 256);
+        }
+
+        float operator()(const glm::vec3& p) const
+        {
+            glm::vec3 cell = glm::floor(p);
+            glm::vec3 f = p - cell;
+            glm::ivec3 i = glm::ivec3(cell) & 255;
+            glm::vec3 u = f * f * f * (f * (f * 6.0f - 15.0f) + 10.0f);
+
+            auto corner = [&](int dx, int dy, int dz) {
+                int hash = m_permutation[m_permutation[m_permutation[i.x + dx] + i.y + dy] + i.z + dz];
+                return Gradient(hash, f - glm::vec3(dx, dy, dz));
+            };
+
+            return glm::mix(
+                glm::mix(glm::mix(corner(0, 0, 0), corner(1, 0, 0), u.x), glm::mix(corner(0, 1, 0), corner(1, 1, 0), u.x), u.y),
+                glm::mix(glm::mix(corner(0, 0, 1), corner(1, 0, 1), u.x), glm::mix(corner(0, 1, 1), corner(1, 1, 1), u.x), u.y),
+                u.z);
+        }
+
+    private:
+        static float Gradient(int hash, const glm::vec3& d)
+        {
+            int h = hash & 15;
+            float u = h < 8 ? d.x : d.y;
+            float v = h < 4 ? d.y : (h == 12 || h == 14 ? d.x : d.z);
+            return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+        }
+
+        std::array<int, 512> m_permutation;
+    };
+
+} // anonymous
+
+VectorField::VectorField()
+{
+}
+
+VectorField::~VectorField()
+{
+}
+
+bool VectorField::LoadFromFile(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t dimensions[4];
+    float frameDuration;
+    float bounds[6];
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(dimensions), sizeof(dimensions));
+    file.read(reinterpret_cast<char*>(&frameDuration), sizeof(frameDuration));
+    file.read(reinterpret_cast<char*>(bounds), sizeof(bounds));
+    if (!file || std::memcmp(magic, kFieldMagic, sizeof(kFieldMagic)) != 0 || dimensions[3] == 0) {
+        std::cerr << "Invalid vector field file " << filename << "\n";
+        return false;
+    }
+
+    m_width = dimensions[0];
+    m_height = dimensions[1];
+    m_depth = dimensions[2];
+    m_frameCount = dimensions[3];
+    m_frameDuration = frameDuration;
+    m_boundsMin = glm::vec3(bounds[0], bounds[1], bounds[2]);
+    m_boundsMax = glm::vec3(bounds[3], bounds[4], bounds[5]);
+
+    m_voxels.resize(GetFrameSize() / sizeof(uint16_t) * m_frameCount);
+    file.read(reinterpret_cast<char*>(m_voxels.data()), m_voxels.size() * sizeof(uint16_t));
+    if (!file) {
+        std::cerr << "Truncated vector field file " << filename << "\n";
+        m_voxels.clear();
+        m_frameCount = 0;
+        return false;
+    }
+    return true;
+}
+
+void VectorField::GenerateCurlNoise(uint32_t resolution, uint32_t frameCount, float frequency, float frameDuration, uint32_t seed)
+{
+    m_width = m_height = m_depth = resolution;
+    m_frameCount = frameCount;
+    m_frameDuration = frameDuration;
+    m_boundsMin = glm::vec3(-1.0f);
+    m_boundsMax = glm::vec3(1.0f);
+    m_voxels.resize(GetFrameSize() / sizeof(uint16_t) * m_frameCount);
+
+    // Three decorrelated noises form the vector potential, its curl is divergence free
+    GradientNoise noises[3] = { GradientNoise(seed), GradientNoise(seed + 1), GradientNoise(seed + 2) };
+
+    size_t voxelCount = static_cast<size_t>(resolution) * resolution * resolution;
+    std::vector<glm::vec3> potential(voxelCount);
+    glm::vec3 voxelSize = (m_boundsMax - m_boundsMin) / static_cast<float>(resolution);
+
+    auto index = [resolution](uint32_t x, uint32_t y, uint32_t z) {
+        return (static_cast<size_t>(z) * resolution + y) * resolution + x;
+    };
+
+    for (uint32_t frame = 0; frame < frameCount; ++frame)
+    {
+        // Scroll the potential along a circle so that the last keyframe blends back into the first one
+        float angle = glm::two_pi<float>() * frame / frameCount;
+        glm::vec3 scroll = glm::vec3(glm::cos(angle), glm::sin(angle), 0.0f) * 2.0f;
+
+        for (uint32_t z = 0; z < resolution; ++z)
+        {
+            for (uint32_t y = 0; y < resolution; ++y)
+            {
+                for (uint32_t x = 0; x < resolution; ++x)
+                {
+                    glm::vec3 p = (m_boundsMin + (glm::vec3(x, y, z) + 0.5f) * voxelSize) * frequency + scroll;
+                    potential[index(x, y, z)] = glm::vec3(noises[0](p), noises[1](p), noises[2](p));
+                }
+            }
+        }
+
+        // Curl by central differences, one sided on the borders
+        uint16_t* voxels = m_voxels.data() + GetFrameSize() / sizeof(uint16_t) * frame;
+        for (uint32_t z = 0; z < resolution; ++z)
+        {
+            for (uint32_t y = 0; y < resolution; ++y)
+            {
+                for (uint32_t x = 0; x < resolution; ++x)
+                {
+                    uint32_t x0 = x > 0 ? x - 1 : x, x1 = std::min(x + 1, resolution - 1);
+                    uint32_t y0 = y > 0 ? y - 1 : y, y1 = std::min(y + 1, resolution - 1);
+                    uint32_t z0 = z > 0 ? z - 1 : z, z1 = std::min(z + 1, resolution - 1);
+                    glm::vec3 dx = (potential[index(x1, y, z)] - potential[index(x0, y, z)]) / (voxelSize.x * (x1 - x0));
+                    glm::vec3 dy = (potential[index(x, y1, z)] - potential[index(x, y0, z)]) / (voxelSize.y * (y1 - y0));
+                    glm::vec3 dz = (potential[index(x, y, z1)] - potential[index(x, y, z0)]) / (voxelSize.z * (z1 - z0));
+                    glm::vec3 curl(dy.z - dz.y, dz.x - dx.z, dx.y - dy.x);
+
+                    uint16_t* voxel = voxels + index(x, y, z) * 4;
+                    voxel[0] = glm::packHalf1x16(curl.x);
+                    voxel[1] = glm::packHalf1x16(curl.y);
+                    voxel[2] = glm::packHalf1x16(curl.z);
+                    voxel[3] = glm::packHalf1x16(0.0f);
+                }
+            }
+        }
+    }
+}
+
+const uint16_t* VectorField::GetSlice(uint32_t frame, uint32_t z) const
+{
+    return m_voxels.data() + (GetFrameSize() * frame + GetSliceSize() * z) / sizeof(uint16_t);
+}
+
+glm::vec3 VectorField::Sample(uint32_t frame, const glm::vec3& position) const
+{
+    glm::vec3 extent(m_width, m_height, m_depth);
+    glm::vec3 texel = (position - m_boundsMin) / (m_boundsMax - m_boundsMin) * extent - 0.5f;
+    texel = glm::clamp(texel, glm::vec3(0.0f), extent - 1.0f);
+
+    glm::uvec3 i0 = glm::uvec3(texel);
+    glm::uvec3 i1 = glm::min(i0 + 1u, glm::uvec3(m_width, m_height, m_depth) - 1u);
+    glm::vec3 t = texel - glm::vec3(i0);
+
+    const uint16_t* voxels = GetFrame(frame);
+    auto at = [&](uint32_t x, uint32_t y, uint32_t z) {
+        const uint16_t* voxel = voxels + ((static_cast<size_t>(z) * m_height + y) * m_width + x) * 4;
+        return glm::vec3(glm::unpackHalf1x16(voxel[0]), glm::unpackHalf1x16(voxel[1]), glm::unpackHalf1x16(voxel[2]));
+    };
+
+    glm::vec3 c00 = glm::mix(at(i0.x, i0.y, i0.z), at(i1.x, i0.y, i0.z), t.x);
+    glm::vec3 c10 = glm::mix(at(i0.x, i1.y, i0.z), at(i1.x, i1.y, i0.z), t.x);
+    glm::vec3 c01 = glm::mix(at(i0.x, i0.y, i1.z), at(i1.x, i0.y, i1.z), t.x);
+    glm::vec3 c11 = glm::mix(at(i0.x, i1.y, i1.z), at(i1.x, i1.y, i1.z), t.x);
+    return glm::mix(glm::mix(c00, c10, t.y), glm::mix(c01, c11, t.y), t.z);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Time varying 3D vector field made of keyframes of RGBA16F voxels (xyz: vector, w: unused)
+// Keyframes are streamed slice by slice to the GPU and linearly blended by the simulation
+class VectorField
+{
+public:
+    VectorField();
+    ~VectorField();
+
+    // Load a field from disk, see the .vfld layout in VectorField.cpp
+    bool LoadFromFile(const std::string& filename);
+
+    // Divergence free curl noise, animated by scrolling the noise potential along a loop
+    void GenerateCurlNoise(uint32_t resolution, uint32_t frameCount, float frequency, float frameDuration, uint32_t seed);
+
+    // Voxels of one z slice of a keyframe, 4 half floats per voxel
+    const uint16_t* GetSlice(uint32_t frame, uint32_t z) const;
+    const uint16_t* GetFrame(uint32_t frame) const { return GetSlice(frame, 0); }
+
+    // Trilinear lookup of a keyframe, clamped to the border voxels
+    glm::vec3 Sample(uint32_t frame, const glm::vec3& position) const;
+
+    uint32_t GetWidth() const { return m_width; }
+    uint32_t GetHeight() const { return m_height; }
+    uint32_t GetDepth() const { return m_depth; }
+    uint32_t GetFrameCount() const { return m_frameCount; }
+    float GetFrameDuration() const { return m_frameDuration; }
+    const glm::vec3& GetBoundsMin() const { return m_boundsMin; }
+    const glm::vec3& GetBoundsMax() const { return m_boundsMax; }
+
+    size_t GetSliceSize() const { return static_cast<size_t>(m_width) * m_height * 4 * sizeof(uint16_t); }
+    size_t GetFrameSize() const { return GetSliceSize() * m_depth; }
+
+private:
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_depth = 0;
+    uint32_t m_frameCount = 0;
+    float m_frameDuration = 1.0f;          // Simulation time between two keyframes
+    glm::vec3 m_boundsMin = glm::vec3(-1.0f);
+    glm::vec3 m_boundsMax = glm::vec3(1.0f);
+
+    std::vector<uint16_t> m_voxels;
+};
@@ -5,8 +5,10 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <functional>
 #include <iostream>
+#include <thread>
 
 namespace {
 
@@ -34,6 +36,32 @@ namespace {
         app->CursorPositionCallback(window, xpos, ypos);
     }
 
+    const char* PresentModeName(VkPresentModeKHR presentMode)
+    {
+        switch (presentMode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+        default: return "other";
+        }
+    }
+
+    // Mean, standard deviation and max of the first count values of a statistics ring
+    void RingStats(const float* values, uint32_t count, float& mean, float& deviation, float& maximum)
+    {
+        double sum = 0.0;
+        double squares = 0.0;
+        maximum = 0.0f;
+        for (uint32_t i = 0; i < count; ++i) {
+            sum += values[i];
+            squares += static_cast<double>(values[i]) * values[i];
+            maximum = std::max(maximum, values[i]);
+        }
+        mean = static_cast<float>(sum / count);
+        deviation = static_cast<float>(std::sqrt(std::max(squares / count - (sum / count) * (sum / count), 0.0)));
+    }
+
 } // anomymous
 
 VulkanCore::VulkanCore(bool enableValidation)
@@ -55,7 +83,12 @@ VkResult VulkanCore::CreateInstance(bool enableValidation)
     appInfo.pEngineName = m_applicationName.c_str();
     appInfo.apiVersion = VK_API_VERSION_1_3;
 
-    std::vector<const char*> instanceExtensions = { VK_KHR_SURFACE_EXTENSION_NAME };
+    // A headless run has no window, hence no surface
+    std::vector<const char*> instanceExtensions;
+    if (!m_headless)
+    {
+        instanceExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+    }
 
     // Get extensions supported by the instance and store for later use
     uint32_t extCount = 0;
@@ -79,8 +112,11 @@ VkResult VulkanCore::CreateInstance(bool enableValidation)
 
     // Surface extensions
     uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    const char** glfwExtensions = nullptr;
+    if (!m_headless)
+    {
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    }
 
     for (auto i = 0u; i < glfwExtensionCount; ++i)
     {
@@ -176,14 +212,12 @@ void VulkanCore::InitVulkan()
     vkGetPhysicalDeviceFeatures(m_physicalDevice, &m_deviceFeatures);
     vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_deviceMemoryProperties);
 
-#if 0
     // Derived examples can override this to set actual features (based on above readings) to enable for logical device creation
-    getEnabledFeatures();
-#endif
+    GetEnabledFeatures();
 
     // Vulkan device creation that encapsulate functions related to a device
     m_vulkanDevice = new VulkanDevice(m_physicalDevice);
-    VkResult res = m_vulkanDevice->CreateLogicalDevice(m_enabledFeatures, m_enabledDeviceExtensions);
+    VkResult res = m_vulkanDevice->CreateLogicalDevice(m_enabledFeatures, m_enabledDeviceExtensions, !m_headless);
     if (res != VK_SUCCESS) {
         throw("Could not create Vulkan device: \n" + Utils::errorString(res), res);
     }
@@ -221,6 +255,8 @@ void VulkanCore::InitVulkan()
 
 void VulkanCore::MouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
+    RecordInputEvent();
+
     if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS)
     {
         m_mouseButtons.right = true;
@@ -295,6 +331,8 @@ void VulkanCore::KeyCallback(GLFWwindow* window, int key, int scancode, int acti
 
 void VulkanCore::CursorPositionCallback(GLFWwindow* window, double xpos, double ypos)
 {
+    RecordInputEvent();
+
     double dx = m_mousePosX - xpos;
     double dy = m_mousePosY - ypos;
 
@@ -306,6 +344,10 @@ void VulkanCore::CursorPositionCallback(GLFWwindow* window, double xpos, double
 
 void VulkanCore::SetupWindow()
 {
+    if (m_headless) {
+        return;
+    }
+
     glfwInit();
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
@@ -321,8 +363,13 @@ void VulkanCore::SetupWindow()
 
 void VulkanCore::Prepare()
 {
-    // Init swapchain surface
-    m_swapChain.InitSurface(m_pWindow);
+    // Init swapchain surface, a headless run renders into a single offscreen image in place of the swapchain
+    if (m_headless) {
+        m_swapChain.CreateOffscreen(m_vulkanDevice->queueFamilyIndices.graphics, m_width, m_height);
+    }
+    else {
+        m_swapChain.InitSurface(m_pWindow);
+    }
 
     // Create command buffer pool on Graphics Queue
     VkCommandPoolCreateInfo cmdPoolInfo = {};
@@ -332,7 +379,9 @@ void VulkanCore::Prepare()
     VK_CHECK_RESULT(vkCreateCommandPool(m_logicalDevice, &cmdPoolInfo, nullptr, &m_cmdPool));
 
     // Setup the swapchain
-    m_swapChain.Create(&m_width, &m_height);
+    if (!m_headless) {
+        m_swapChain.Create(&m_width, &m_height);
+    }
 
     // Create renderPass
     SetupRenderPass();
@@ -345,6 +394,7 @@ void VulkanCore::Prepare()
 
     m_ui.device = m_vulkanDevice;
     m_ui.queue = m_graphicsQueue;
+    m_ui.sliceCount = m_swapChain.GetImageCount();
     m_ui.shaders = {
         LoadShader(m_logicalDevice, "../../shaders/ui.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
         LoadShader(m_logicalDevice, "../../shaders/ui.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
@@ -379,11 +429,16 @@ VkPipelineShaderStageCreateInfo VulkanCore::LoadShader(VkDevice device, const st
 
 void VulkanCore::CleanUp()
 {
+    if (m_logicalDevice == VK_NULL_HANDLE) {
+        return;
+    }
+
     // Clean up Vulkan resources
     m_swapChain.CleanUp();
     vkDestroyDescriptorPool(m_logicalDevice, m_descriptorPool, nullptr);
 
     vkFreeCommandBuffers(m_logicalDevice, m_cmdPool, static_cast<uint32_t>(m_drawCmdBuffers.size()), m_drawCmdBuffers.data());
+    vkFreeCommandBuffers(m_logicalDevice, m_cmdPool, static_cast<uint32_t>(m_uiCmdBuffers.size()), m_uiCmdBuffers.data());
     vkDestroyRenderPass(m_logicalDevice, m_renderPass, nullptr);
     for (uint32_t i = 0; i < m_frameBuffers.size(); i++)
     {
@@ -414,10 +469,19 @@ void VulkanCore::RenderLoop()
     m_lastTimestamp = std::chrono::high_resolution_clock::now();
     m_tPrevEnd = m_lastTimestamp;
 
-    while (!glfwWindowShouldClose(m_pWindow)) {
-        glfwPollEvents();
+    // Without a window the frames follow each other until the application asks to close
+    if (m_headless) {
+        while (!m_closeRequested) {
+            Render();
+        }
+    }
+    else {
+        while (!glfwWindowShouldClose(m_pWindow)) {
+            WaitForFrameDeadline();
+            glfwPollEvents();
 
-        NextFrame();
+            NextFrame();
+        }
     }
 
     // Flush device to make sure all resources can be freed
@@ -430,6 +494,14 @@ void VulkanCore::OnViewChanged()
 {
 }
 
+void VulkanCore::RequestClose()
+{
+    m_closeRequested = true;
+    if (m_pWindow) {
+        glfwSetWindowShouldClose(m_pWindow, GLFW_TRUE);
+    }
+}
+
 void VulkanCore::NextFrame()
 {
     glfwGetCursorPos(m_pWindow, &m_mousePosX, &m_mousePosY);
@@ -448,7 +520,10 @@ void VulkanCore::NextFrame()
 
     auto tEnd = std::chrono::high_resolution_clock::now();
     auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-    m_frameTimer = (float)tDiff / 1000.0f;
+    m_renderTimer = (float)tDiff / 1000.0f;
+    auto tPeriod = std::chrono::duration<double, std::milli>(tEnd - m_tPrevEnd).count();
+    m_frameTimer = (float)tPeriod / 1000.0f;
+    m_framePacing.frameTimes[m_framePacing.frameCount++ % FrameStatsCount] = (float)tPeriod;
 
     m_camera.Update(m_frameTimer);
     if (m_camera.HasViewChanged()) {
@@ -478,7 +553,8 @@ void VulkanCore::SetupRenderPass()
     attachments.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     attachments.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     attachments.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // The offscreen image of a headless run is never presented, the swapchain extension is not even enabled
+    attachments.finalLayout = m_headless ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorReference = {};
     colorReference.attachment = 0;
@@ -549,6 +625,10 @@ void VulkanCore::CreateCommandBuffers()
     commandBufferAllocateInfo.commandBufferCount = static_cast<uint32_t>(m_drawCmdBuffers.size());
 
     VK_CHECK_RESULT(vkAllocateCommandBuffers(m_logicalDevice, &commandBufferAllocateInfo, m_drawCmdBuffers.data()));
+
+    m_uiCmdBuffers.resize(m_swapChain.GetImageCount());
+    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    VK_CHECK_RESULT(vkAllocateCommandBuffers(m_logicalDevice, &commandBufferAllocateInfo, m_uiCmdBuffers.data()));
 }
 
 void VulkanCore::CreateSynchronizationPrimitives()
@@ -596,6 +676,52 @@ void VulkanCore::SubmitFrame()
 
     // TODO: remove if the applications can use fences for a smaller waiting time
     VK_CHECK_RESULT(vkQueueWaitIdle(m_graphicsQueue));
+
+    // Input to present latency: the frame has been rendered and handed to the presentation engine, the queue of the
+    // present mode comes on top of it
+    if (m_framePacing.inputPending) {
+        auto latency = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_framePacing.inputTime).count();
+        m_framePacing.latencies[m_framePacing.latencyCount++ % FrameStatsCount] = (float)latency;
+        m_framePacing.inputPending = false;
+    }
+}
+
+void VulkanCore::WaitForFrameDeadline()
+{
+    using Clock = std::chrono::high_resolution_clock;
+    if (m_framePacing.targetFps <= 0) {
+        return;
+    }
+
+    // Sleeps cost no CPU but may overshoot by a scheduler quantum: they stop once the time left is within the worst
+    // recent overshoot, and a spin covers the rest
+    auto now = Clock::now();
+    while (std::chrono::duration<double, std::milli>(m_framePacing.deadline - now).count() > m_framePacing.sleepOvershoot + 1.0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        auto woken = Clock::now();
+        double overshoot = std::chrono::duration<double, std::milli>(woken - now).count() - 1.0;
+        m_framePacing.sleepOvershoot = std::max(overshoot, m_framePacing.sleepOvershoot * 0.99);
+        now = woken;
+    }
+    while (now < m_framePacing.deadline) {
+        std::this_thread::yield();
+        now = Clock::now();
+    }
+
+    // Fixed cadence, a frame late by more than a period starts a new one rather than being followed by short frames
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_framePacing.targetFps));
+    if (now - m_framePacing.deadline > period) {
+        m_framePacing.deadline = now;
+    }
+    m_framePacing.deadline += period;
+}
+
+void VulkanCore::RecordInputEvent()
+{
+    if (!m_framePacing.inputPending) {
+        m_framePacing.inputTime = std::chrono::high_resolution_clock::now();
+        m_framePacing.inputPending = true;
+    }
 }
 
 void VulkanCore::BuildCommandBuffers()
@@ -623,13 +749,33 @@ void VulkanCore::UpdateUI()
     ImGui::Text("%.2f ms/frame (%.1d fps)", (1000.0f / m_lastFPS), m_lastFPS);
     ImGui::Text("mouseposX %f - mousepoxY %f fps", m_mousePosX, m_mousePosY);
 
+    // Consistency of the frame times and of the input latency over the last frames
+    ImGui::Text("Present mode %s, %u images", PresentModeName(m_swapChain.GetPresentMode()), m_swapChain.GetImageCount());
+    ImGui::SliderInt("Frame limit (0: off)", &m_framePacing.targetFps, 0, 360);
+    float mean, deviation, maximum;
+    uint32_t frameSamples = m_framePacing.frameCount < FrameStatsCount ? m_framePacing.frameCount : FrameStatsCount;
+    if (frameSamples > 0) {
+        RingStats(m_framePacing.frameTimes.data(), frameSamples, mean, deviation, maximum);
+        ImGui::Text("Frame %.2f ms, std dev %.2f ms, max %.2f ms", mean, deviation, maximum);
+        ImGui::PlotLines("##FrameTimes", m_framePacing.frameTimes.data(), static_cast<int>(frameSamples),
+            static_cast<int>(m_framePacing.frameCount % frameSamples), nullptr, 0.0f, maximum, ImVec2(0, 40));
+    }
+    uint32_t latencySamples = m_framePacing.latencyCount < FrameStatsCount ? m_framePacing.latencyCount : FrameStatsCount;
+    if (latencySamples > 0) {
+        RingStats(m_framePacing.latencies.data(), latencySamples, mean, deviation, maximum);
+        ImGui::Text("Input latency %.2f ms, std dev %.2f ms, max %.2f ms", mean, deviation, maximum);
+    }
+
 
     OnUpdateUIOverlay(&m_ui);
 
     ImGui::End();
     ImGui::Render();
 
-    if (m_ui.UpdateBuffers() || m_ui.updated) {
+    // The overlay is recorded every frame into its own command buffer, see RecordUICommandBuffer()
+    // The command buffers of the scene are rebuilt only for the settings they record, the others go through the uniforms
+    m_ui.UpdateBuffers();
+    if (m_ui.updated) {
         BuildCommandBuffers();
         m_ui.updated = false;
     }
@@ -638,6 +784,9 @@ void VulkanCore::UpdateUI()
 void VulkanCore::OnUpdateUIOverlay(VulkanIamGuiWrapper *uiWrapper)
 {}
 
+void VulkanCore::GetEnabledFeatures()
+{}
+
 void VulkanCore::DrawUI(const VkCommandBuffer commandBuffer)
 {
     if (m_ui.visible) {
@@ -659,6 +808,27 @@ void VulkanCore::DrawUI(const VkCommandBuffer commandBuffer)
     }
 }
 
+VkCommandBuffer VulkanCore::RecordUICommandBuffer(uint32_t frameBufferIndex)
+{
+    VkCommandBuffer commandBuffer = m_uiCmdBuffers[frameBufferIndex];
+
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = m_renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = m_frameBuffers[frameBufferIndex];
+
+    VkCommandBufferBeginInfo cmdBufInfo{};
+    cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
+
+    VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+    DrawUI(commandBuffer);
+    VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+    return commandBuffer;
+}
+
 void VulkanCore::WindowResize()
 {
     // TODO
@@ -1,11 +1,16 @@
 #pragma once
 
+// std::min and std::max are used next to this header
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include <windows.h>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include <array>
 #include <cstdint>
 #include <chrono>
 #include <vector>
@@ -40,6 +45,8 @@ public:
 
     virtual void UpdateUI();
     virtual void DrawUI(const VkCommandBuffer commandBuffer);
+    // Records the overlay into the secondary command buffer of the frame buffer, to be executed in its render pass
+    VkCommandBuffer RecordUICommandBuffer(uint32_t frameBufferIndex);
 
     // Called when the window has been resized, can be used by the sample application to recreate resources
     virtual void WindowResize();
@@ -50,9 +57,21 @@ public:
 protected:
     virtual VkResult CreateInstance(bool enableValidation);
     virtual void OnUpdateUIOverlay(VulkanIamGuiWrapper* ui);
+    // Sets m_enabledFeatures from the supported m_deviceFeatures before the logical device is created
+    virtual void GetEnabledFeatures();
 
     VkPipelineShaderStageCreateInfo LoadShader(VkDevice device, const std::string& filepath, VkShaderStageFlagBits stage);
 
+    // Sleeps then spins until the frame limiter lets the next frame start
+    void WaitForFrameDeadline();
+    // Time of the earliest input event not presented yet, for the latency statistics
+    void RecordInputEvent();
+    // Leaves the render loop once the current frame is done
+    void RequestClose();
+
+    // Frames kept in the pacing statistics of the overlay
+    static constexpr uint32_t FrameStatsCount = 240;
+
 protected:
     uint32_t m_width = 1920;
     uint32_t m_height = 1200;
@@ -63,10 +82,27 @@ protected:
     std::chrono::time_point<std::chrono::high_resolution_clock> m_lastTimestamp;
     std::chrono::time_point<std::chrono::high_resolution_clock> m_tPrevEnd;
 
-    // Last frame time measured using a high performance timer (if available)
+    // Last frame time measured using a high performance timer (if available), from the end of the previous frame so
+    // that it covers the wait of the frame limiter
     float  m_frameTimer = 1.0f;
+    // Time spent in Render() by the last frame
+    float  m_renderTimer = 1.0f;
 
-    VkInstance m_instance;
+    // Frame pacing: optional cap of the frame rate, waited for before the events are polled so that the input of the
+    // frame is as recent as possible, and statistics of the last frames for the overlay
+    struct {
+        int32_t targetFps = 0;                      // 0 leaves the pacing to the present mode
+        std::chrono::time_point<std::chrono::high_resolution_clock> deadline;
+        double sleepOvershoot = 1.0;                // Milliseconds past the end of a 1 ms sleep, recent maximum
+        std::array<float, FrameStatsCount> frameTimes{};    // Milliseconds, rings of the last values
+        std::array<float, FrameStatsCount> latencies{};
+        uint32_t frameCount = 0;                    // Values written to the rings so far
+        uint32_t latencyCount = 0;
+        bool inputPending = false;
+        std::chrono::time_point<std::chrono::high_resolution_clock> inputTime;
+    } m_framePacing;
+
+    VkInstance m_instance = VK_NULL_HANDLE;
     std::vector<std::string> m_supportedInstanceExtensions;
 
     // Set of device extensions to be enabled for the application, to be set in the derived object
@@ -75,7 +111,7 @@ protected:
     std::vector<const char*> m_enabledInstanceExtensions;
 
     // Wrapper class around device related functionality
-    VulkanDevice* m_vulkanDevice;
+    VulkanDevice* m_vulkanDevice = nullptr;
 
     // Physical device
     VkPhysicalDevice m_physicalDevice;
@@ -87,7 +123,7 @@ protected:
     VulkanSwapChain m_swapChain;
 
     // Logical device
-    VkDevice m_logicalDevice;
+    VkDevice m_logicalDevice = VK_NULL_HANDLE;
 
     // Handle to the device graphics queue that command buffers are submitted to
     VkQueue m_graphicsQueue;
@@ -98,6 +134,9 @@ protected:
     // Command buffers used for rendering
     std::vector<VkCommandBuffer> m_drawCmdBuffers;
 
+    // Secondary command buffers of the overlay, one per frame buffer, recorded again every frame
+    std::vector<VkCommandBuffer> m_uiCmdBuffers;
+
     // Global render pass for frame buffer writes
     VkRenderPass m_renderPass = VK_NULL_HANDLE;
 
@@ -150,7 +189,9 @@ protected:
 
     // Settings
     bool m_validation;
+    bool m_headless = false;                        // No window nor swapchain, set before SetupWindow()
+    bool m_closeRequested = false;
     std::string m_applicationName;
 
-    GLFWwindow* m_pWindow;
+    GLFWwindow* m_pWindow = nullptr;
 };
\ No newline at end of file
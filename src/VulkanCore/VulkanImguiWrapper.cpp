@@ -4,6 +4,7 @@
 #include <imgui.h>
 
 #include <algorithm>
+#include <cstdarg>
 
 VulkanIamGuiWrapper::VulkanIamGuiWrapper()
 {
@@ -27,10 +28,8 @@ VulkanIamGuiWrapper::~VulkanIamGuiWrapper()
 void VulkanIamGuiWrapper::CleanUp()
 {
     // Delete buffers
-    vkFreeMemory(device->logicalDevice, vertexMemory, nullptr);
-    vkDestroyBuffer(device->logicalDevice, vertexBuffer, nullptr);
-    vkFreeMemory(device->logicalDevice, indexMemory, nullptr);
-    vkDestroyBuffer(device->logicalDevice, indexBuffer, nullptr);
+    Destroy(vertices);
+    Destroy(indices);
 
     // Delete images
     vkFreeMemory(device->logicalDevice, fontMemory, nullptr);
@@ -360,7 +359,7 @@ void VulkanIamGuiWrapper::Draw(VkCommandBuffer commandBuffer)
     int32_t vertexOffset = 0;
     int32_t indexOffset = 0;
 
-    if ((!imDrawData) || (imDrawData->CmdListsCount == 0)) {
+    if ((!imDrawData) || (imDrawData->CmdListsCount == 0) || (vertices.buffer == VK_NULL_HANDLE)) {
         return;
     }
 
@@ -373,9 +372,9 @@ void VulkanIamGuiWrapper::Draw(VkCommandBuffer commandBuffer)
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
 
-    VkDeviceSize offsets[1] = { 0 };
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+    VkDeviceSize offsets[1] = { slice * vertices.sliceSize };
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indices.buffer, slice * indices.sliceSize, VK_INDEX_TYPE_UINT16);
 
     for (int32_t i = 0; i < imDrawData->CmdListsCount; i++)
     {
@@ -399,58 +398,26 @@ void VulkanIamGuiWrapper::Draw(VkCommandBuffer commandBuffer)
 bool VulkanIamGuiWrapper::UpdateBuffers()
 {
     ImDrawData* imDrawData = ImGui::GetDrawData();
-    bool updateCmdBuffers = false;
 
     if (!imDrawData) { return false; };
 
-    // Note: Alignment is done inside buffer creation
     VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
     VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
 
-    // Update buffers only if vertex or index count has been changed compared to current buffer size
     if ((vertexBufferSize == 0) || (indexBufferSize == 0)) {
         return false;
     }
 
-    // Vertex buffer
-    if ((vertexBuffer == VK_NULL_HANDLE) || (vertexCount != imDrawData->TotalVtxCount)) {
-        if (vertexMapped) {
-            vkUnmapMemory(device->logicalDevice, vertexMemory);
-        }
-        if (vertexMemory) {
-            vkFreeMemory(device->logicalDevice, vertexMemory, nullptr);
-        }
-        if (vertexBuffer) {
-            vkDestroyBuffer(device->logicalDevice, vertexBuffer, nullptr);
-        }
-        VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &vertexBuffer, &vertexMemory, vertexBufferSize));
-        vertexCount = imDrawData->TotalVtxCount;
-        updateCmdBuffers = true;
-        vkMapMemory(device->logicalDevice, vertexMemory, 0, VK_WHOLE_SIZE, 0, &vertexMapped);
-    }
+    // Both rings are grown before either is written, a growth waits for the frames in flight
+    bool grown = Reserve(vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBufferSize);
+    grown |= Reserve(indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBufferSize);
 
-    // Index buffer
-    if ((indexBuffer == VK_NULL_HANDLE) || (indexCount < imDrawData->TotalIdxCount)) {
-        if (indexBuffer != VK_NULL_HANDLE && indexMemory != VK_NULL_HANDLE) {
-            if (indexMapped) {
-                vkUnmapMemory(device->logicalDevice, indexMemory);
-            }
-            if (indexMemory) {
-                vkFreeMemory(device->logicalDevice, indexMemory, nullptr);
-            }
-            if (indexBuffer) {
-                vkDestroyBuffer(device->logicalDevice, indexBuffer, nullptr);
-            }
-        }
-        VK_CHECK_RESULT(device->CreateBuffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &indexBuffer, &indexMemory, indexBufferSize));
-        indexCount = imDrawData->TotalIdxCount;
-        updateCmdBuffers = true;
-        vkMapMemory(device->logicalDevice, indexMemory, 0, VK_WHOLE_SIZE, 0, &indexMapped);
-    }
+    // The oldest slice, its frame is done with it once sliceCount frames have been submitted since
+    slice = (slice + 1) % sliceCount;
 
     // Upload data
-    ImDrawVert* vtxDst = (ImDrawVert*)vertexMapped;
-    ImDrawIdx* idxDst = (ImDrawIdx*)indexMapped;
+    ImDrawVert* vtxDst = reinterpret_cast<ImDrawVert*>(static_cast<char*>(vertices.mapped) + slice * vertices.sliceSize);
+    ImDrawIdx* idxDst = reinterpret_cast<ImDrawIdx*>(static_cast<char*>(indices.mapped) + slice * indices.sliceSize);
 
     for (int n = 0; n < imDrawData->CmdListsCount; n++) {
         const ImDrawList* cmd_list = imDrawData->CmdLists[n];
@@ -460,28 +427,110 @@ bool VulkanIamGuiWrapper::UpdateBuffers()
         idxDst += cmd_list->IdxBuffer.Size;
     }
 
-    // Flush to make writes visible to GPU
+    Flush(vertices, vertexBufferSize);
+    Flush(indices, indexBufferSize);
+
+    return grown;
+}
+
+bool VulkanIamGuiWrapper::Reserve(GeometryRing& ring, VkBufferUsageFlags usageFlags, VkDeviceSize size)
+{
+    if (size <= ring.sliceSize) {
+        return false;
+    }
+
+    // Doubling from a slice that fits a usual overlay, a power of two multiple of the atom size
+    VkDeviceSize atomSize = device->properties.limits.nonCoherentAtomSize;
+    VkDeviceSize sliceSize = std::max<VkDeviceSize>(ring.sliceSize, std::max<VkDeviceSize>(64 * 1024, atomSize));
+    while (sliceSize < size) {
+        sliceSize *= 2;
+    }
+    sliceSize = (sliceSize + atomSize - 1) / atomSize * atomSize;
+
+    // The frames in flight may still read the old slices, growing is rare enough to wait for them
+    if (ring.buffer != VK_NULL_HANDLE) {
+        VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+        Destroy(ring);
+    }
+
+    VK_CHECK_RESULT(device->CreateBuffer(usageFlags, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &ring.buffer, &ring.memory, sliceSize * sliceCount));
+    VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, ring.memory, 0, VK_WHOLE_SIZE, 0, &ring.mapped));
+    ring.sliceSize = sliceSize;
+
+    // Same memory type as picked by CreateBuffer()
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(device->logicalDevice, ring.buffer, &memoryRequirements);
+    uint32_t memoryType = device->GetMemoryType(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    ring.coherent = (device->memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    return true;
+}
+
+void VulkanIamGuiWrapper::Flush(const GeometryRing& ring, VkDeviceSize size)
+{
+    if (ring.coherent) {
+        return;
+    }
+
+    // Written bytes of the current slice, rounded up to the atom size within the slice
+    VkDeviceSize atomSize = device->properties.limits.nonCoherentAtomSize;
     VkMappedMemoryRange mappedRange = {};
     mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = vertexMemory;
-    mappedRange.offset = 0;
-    mappedRange.size = VK_WHOLE_SIZE;
-    vkFlushMappedMemoryRanges(device->logicalDevice, 1, &mappedRange);
-
-    mappedRange.memory = indexMemory;
-    mappedRange.offset = 0;
-    mappedRange.size = VK_WHOLE_SIZE;
-    vkFlushMappedMemoryRanges(device->logicalDevice, 1, &mappedRange);
+    mappedRange.memory = ring.memory;
+    mappedRange.offset = slice * ring.sliceSize;
+    mappedRange.size = std::min((size + atomSize - 1) / atomSize * atomSize, ring.sliceSize);
+    VK_CHECK_RESULT(vkFlushMappedMemoryRanges(device->logicalDevice, 1, &mappedRange));
+}
 
-    return updateCmdBuffers;
+void VulkanIamGuiWrapper::Destroy(GeometryRing& ring)
+{
+    if (ring.mapped) {
+        vkUnmapMemory(device->logicalDevice, ring.memory);
+    }
+    vkFreeMemory(device->logicalDevice, ring.memory, nullptr);
+    vkDestroyBuffer(device->logicalDevice, ring.buffer, nullptr);
+    ring = GeometryRing();
 }
 
 bool VulkanIamGuiWrapper::CheckBox(const std::string& caption, bool* value)
 {
-    bool res = ImGui::Checkbox(caption.c_str(), value);
-    if (res) {
-        updated = true;
+    // The widgets only report a change, the caller sets updated when it changes what the scene records
+    return ImGui::Checkbox(caption.c_str(), value);
+}
+
+bool VulkanIamGuiWrapper::ComboBox(const std::string& caption, int32_t* itemIndex, const std::vector<std::string>& items)
+{
+    if (items.empty()) {
+        return false;
+    }
+
+    std::vector<const char*> charItems;
+    charItems.reserve(items.size());
+    for (const auto& item : items) {
+        charItems.push_back(item.c_str());
     }
 
-    return res;
-}
\ No newline at end of file
+    return ImGui::Combo(caption.c_str(), itemIndex, charItems.data(), static_cast<int>(charItems.size()));
+}
+
+bool VulkanIamGuiWrapper::SliderInt(const std::string& caption, int32_t* value, int32_t min, int32_t max)
+{
+    return ImGui::SliderInt(caption.c_str(), value, min, max);
+}
+
+bool VulkanIamGuiWrapper::SliderFloat(const std::string& caption, float* value, float min, float max)
+{
+    return ImGui::SliderFloat(caption.c_str(), value, min, max);
+}
+
+bool VulkanIamGuiWrapper::Button(const std::string& caption)
+{
+    return ImGui::Button(caption.c_str());
+}
+
+void VulkanIamGuiWrapper::Text(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    ImGui::TextV(format, args);
+    va_end(args);
+}
@@ -4,6 +4,9 @@
 #include <VulkanDevice.h>
 #include <glm/glm.hpp>
 
+#include <string>
+#include <vector>
+
 struct VulkanIamGuiWrapper
 {
     VulkanDevice *device;
@@ -15,9 +18,6 @@ struct VulkanIamGuiWrapper
 
     std::vector<VkPipelineShaderStageCreateInfo> shaders;
 
-    int32_t vertexCount = 0;
-    int32_t indexCount = 0;
-
     struct PushConstBlock {
         glm::vec2 scale;
         glm::vec2 translate;
@@ -30,17 +30,24 @@ struct VulkanIamGuiWrapper
     VkPipelineLayout pipelineLayout;
     VkPipeline pipeline;
 
-    // Buffers
-    VkBuffer vertexBuffer = VK_NULL_HANDLE;
-    VkDeviceMemory vertexMemory = VK_NULL_HANDLE;
-    void *vertexMapped = nullptr;
-    VkBuffer indexBuffer = VK_NULL_HANDLE;
-    VkDeviceMemory indexMemory = VK_NULL_HANDLE;
-    void *indexMapped = nullptr;
+    // Vertex and index buffers: persistently mapped rings of sliceCount slices, one per frame in flight, so that the
+    // host fills the slice of the next frame while the GPU may still read the previous ones
+    // Slices only grow, by doubling, and are aligned to nonCoherentAtomSize so that only the written bytes are flushed
+    struct GeometryRing {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void *mapped = nullptr;
+        VkDeviceSize sliceSize = 0;
+        bool coherent = false;
+    };
+    GeometryRing vertices;
+    GeometryRing indices;
+    uint32_t sliceCount = 1;                // Set before the first UpdateBuffers()
+    uint32_t slice = 0;                     // Written by the last UpdateBuffers(), read by Draw()
 
     VkQueue queue;
 
-    bool updated;
+    bool updated;                           // Set by the application when a setting changes the recorded scene
     bool visible;
 
     VulkanIamGuiWrapper();
@@ -49,8 +56,19 @@ struct VulkanIamGuiWrapper
     void CleanUp();
     void PrepareResources();
     void PreparePipeline(const VkRenderPass renderPass);
+    // Fills the next slice with the ImGui draw data, returns true when the buffers had to grow
     bool UpdateBuffers();
     void Draw(VkCommandBuffer commandBuffer);
 
     bool CheckBox(const std::string& caption, bool* value);
+    bool ComboBox(const std::string& caption, int32_t* itemIndex, const std::vector<std::string>& items);
+    bool SliderInt(const std::string& caption, int32_t* value, int32_t min, int32_t max);
+    bool SliderFloat(const std::string& caption, float* value, float min, float max);
+    bool Button(const std::string& caption);
+    void Text(const char* format, ...);
+
+private:
+    bool Reserve(GeometryRing& ring, VkBufferUsageFlags usageFlags, VkDeviceSize size);
+    void Flush(const GeometryRing& ring, VkDeviceSize size);
+    void Destroy(GeometryRing& ring);
 };
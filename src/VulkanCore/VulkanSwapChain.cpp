@@ -2,7 +2,9 @@
 #include <VulkanUtils.h>
 
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <cassert>
+#include <iostream>
 
 VulkanSwapChain::VulkanSwapChain()
 {
@@ -18,8 +20,17 @@ void VulkanSwapChain::CleanUp()
         vkDestroyImageView(m_logicalDevice, buffer.view, nullptr);
     }
 
-    vkDestroySwapchainKHR(m_logicalDevice, m_swapChain, nullptr);
-    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+    if (m_offscreenMemory != VK_NULL_HANDLE) {
+        vkDestroyImage(m_logicalDevice, m_images[0], nullptr);
+        vkFreeMemory(m_logicalDevice, m_offscreenMemory, nullptr);
+    }
+
+    if (m_swapChain != VK_NULL_HANDLE) {
+        vkDestroySwapchainKHR(m_logicalDevice, m_swapChain, nullptr);
+    }
+    if (m_surface != VK_NULL_HANDLE) {
+        vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+    }
 }
 
 void VulkanSwapChain::Init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice logicalDevice)
@@ -141,6 +152,12 @@ void VulkanSwapChain::InitSurface(GLFWwindow* pWindow)
     }
 }
 
+void VulkanSwapChain::SetPresentPreferences(VkPresentModeKHR presentMode, uint32_t imageCount)
+{
+    m_requestedPresentMode = presentMode;
+    m_requestedImageCount = imageCount;
+}
+
 // Note: Width and height may need to be adjusted to fit the requirement of the swapchain thus the pointer type
 void VulkanSwapChain::Create(uint32_t* width, uint32_t* height)
 {
@@ -197,8 +214,23 @@ void VulkanSwapChain::Create(uint32_t* width, uint32_t* height)
         }
     }
 
-    // Determine the number of images
-    uint32_t desiredNumberOfSwapchainImages = surfaceCaps.minImageCount + 1;
+    // An explicitly requested mode replaces the automatic choice when the surface supports it
+    if (m_requestedPresentMode != VK_PRESENT_MODE_MAX_ENUM_KHR)
+    {
+        if (std::find(presentModes.begin(), presentModes.end(), m_requestedPresentMode) != presentModes.end())
+        {
+            swapchainPresentMode = m_requestedPresentMode;
+        }
+        else
+        {
+            std::cerr << "Present mode " << m_requestedPresentMode << " is not supported by the surface, using " << swapchainPresentMode << "\n";
+        }
+    }
+    m_presentMode = swapchainPresentMode;
+
+    // Determine the number of images, a requested count is clamped to the range of the surface
+    uint32_t desiredNumberOfSwapchainImages = m_requestedImageCount > 0 ? m_requestedImageCount : surfaceCaps.minImageCount + 1;
+    desiredNumberOfSwapchainImages = std::max(desiredNumberOfSwapchainImages, surfaceCaps.minImageCount);
     if ((surfaceCaps.maxImageCount > 0) && (desiredNumberOfSwapchainImages > surfaceCaps.maxImageCount))
     {
         desiredNumberOfSwapchainImages = surfaceCaps.maxImageCount;
@@ -310,6 +342,70 @@ void VulkanSwapChain::Create(uint32_t* width, uint32_t* height)
     }
 }
 
+void VulkanSwapChain::CreateOffscreen(uint32_t queueIndex, uint32_t width, uint32_t height)
+{
+    m_queueNodeIndex = queueIndex;
+    m_colorFormat = VK_FORMAT_B8G8R8A8_UNORM;
+    m_colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    m_imageCount = 1;
+
+    VkImageCreateInfo imageCreateInfo = {};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = m_colorFormat;
+    imageCreateInfo.extent = { width, height, 1 };
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    m_images.resize(m_imageCount);
+    VK_CHECK_RESULT(vkCreateImage(m_logicalDevice, &imageCreateInfo, nullptr, &m_images[0]));
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(m_logicalDevice, m_images[0], &memoryRequirements);
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memoryProperties);
+
+    // Any type the image accepts will do, device local ones first
+    uint32_t memoryTypeIndex = UINT32_MAX;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+    {
+        if ((memoryRequirements.memoryTypeBits & (1u << i)) == 0) {
+            continue;
+        }
+        if (memoryTypeIndex == UINT32_MAX) {
+            memoryTypeIndex = i;
+        }
+        if ((memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0) {
+            memoryTypeIndex = i;
+            break;
+        }
+    }
+
+    VkMemoryAllocateInfo memoryAllocateInfo = {};
+    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memoryAllocateInfo.allocationSize = memoryRequirements.size;
+    memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+    VK_CHECK_RESULT(vkAllocateMemory(m_logicalDevice, &memoryAllocateInfo, nullptr, &m_offscreenMemory));
+    VK_CHECK_RESULT(vkBindImageMemory(m_logicalDevice, m_images[0], m_offscreenMemory, 0));
+
+    VkImageViewCreateInfo colorAttachmentView = {};
+    colorAttachmentView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    colorAttachmentView.format = m_colorFormat;
+    colorAttachmentView.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    colorAttachmentView.subresourceRange.levelCount = 1;
+    colorAttachmentView.subresourceRange.layerCount = 1;
+    colorAttachmentView.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    colorAttachmentView.image = m_images[0];
+
+    m_buffers.resize(m_imageCount);
+    m_buffers[0].image = m_images[0];
+    VK_CHECK_RESULT(vkCreateImageView(m_logicalDevice, &colorAttachmentView, nullptr, &m_buffers[0].view));
+}
+
 VkResult VulkanSwapChain::AcquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t *imageIndex)
 {
     // By setting timeout to UINT64_MAX we will always wait until the next image has been acquired or an actual error is thrown
@@ -343,6 +439,11 @@ uint32_t VulkanSwapChain::GetImageCount()
     return m_imageCount;
 }
 
+VkPresentModeKHR VulkanSwapChain::GetPresentMode()
+{
+    return m_presentMode;
+}
+
 VkFormat VulkanSwapChain::GetColorFormat()
 {
     return m_colorFormat;
@@ -19,24 +19,33 @@ public:
     void CleanUp();
     void Init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice logicalDevice);
     void InitSurface(GLFWwindow* pWindow);
+    // Present mode and image count used by the next Create(), VK_PRESENT_MODE_MAX_ENUM_KHR and 0 pick them automatically
+    void SetPresentPreferences(VkPresentModeKHR presentMode, uint32_t imageCount);
     void Create(uint32_t* width, uint32_t* height);
+    // Single color image in place of the swap chain when nothing is presented, it is never acquired nor presented
+    void CreateOffscreen(uint32_t queueIndex, uint32_t width, uint32_t height);
     VkResult AcquireNextImage(VkSemaphore presentCompleteSemaphore, uint32_t *imageIndex);
     VkResult QueuePresent(VkQueue queue, uint32_t imageIndex, VkSemaphore waitSemaphore);
 
     uint32_t GetImageCount();
+    VkPresentModeKHR GetPresentMode();
     VkFormat GetColorFormat();
     uint32_t GetQueueIndex();
     VkImageView GetImageView(uint32_t index);
 
 private:
-    VkSurfaceKHR m_surface;
+    VkSurfaceKHR m_surface = VK_NULL_HANDLE;
     VkFormat m_colorFormat;
     VkColorSpaceKHR m_colorSpace;
     VkSwapchainKHR m_swapChain = VK_NULL_HANDLE;
     uint32_t m_imageCount;
+    VkPresentModeKHR m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    VkPresentModeKHR m_requestedPresentMode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+    uint32_t m_requestedImageCount = 0;
     std::vector<VkImage> m_images;
     std::vector<SwapChainBuffer> m_buffers;
     uint32_t m_queueNodeIndex = UINT32_MAX;
+    VkDeviceMemory m_offscreenMemory = VK_NULL_HANDLE;  // Memory of the offscreen image, null with a swap chain
 
     VkInstance m_instance;
     VkDevice m_logicalDevice;
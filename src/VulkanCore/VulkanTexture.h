@@ -44,4 +44,24 @@ public:
         VkImageUsageFlags  imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
         VkImageLayout      imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
         bool               forceLinear = false);
+};
+
+class Texture3D : public Texture
+{
+public:
+    uint32_t m_depth;
+
+    // Create a single mip level 3D texture from a tightly packed buffer (x fastest, then y, then z)
+    void FromBuffer(
+        const void        *data,
+        VkDeviceSize       size,
+        VkFormat           format,
+        uint32_t           width,
+        uint32_t           height,
+        uint32_t           depth,
+        VulkanDevice      *device,
+        VkQueue            copyQueue,
+        VkFilter           filter = VK_FILTER_LINEAR,
+        VkImageUsageFlags  imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+        VkImageLayout      imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 };
\ No newline at end of file
@@ -160,6 +160,11 @@ namespace Utils
             }
             imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
             break;
+
+        case VK_IMAGE_LAYOUT_GENERAL:
+            // Image will be both read in a shader and updated by transfers (streamed textures)
+            imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+            break;
         default:
             // Other source layouts aren't handled (yet)
             break;